@@ -6,23 +6,51 @@
 #include "Mesh.h"
 
 /// <summary>
-/// Information used by both raster and shape entities 
+/// Generational entity ID, handed out by a Registry.
+/// The generation tells a live entity apart from a destroyed one whose index was reused
 /// </summary>
-struct UInfo
+struct Entity
 {
-	std::string name; // Hierachy displayed name 
-	std::shared_ptr<Transform> transform;
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
 };
 
-struct SEntity
+// Components
+// Plain data, stored packed per type by the Registry
+// Transform (see Transform.h) is a component too: a handle into the scene's TransformSystem
+
+// Hierachy displayed name 
+struct Name
 {
-	std::shared_ptr<UInfo> info;
-	uint32_t shapeType; 
+	std::string name;
 };
 
-struct REntity
+// Rasterized mesh
+// Renderers sharing all three keys are drawn as one instanced draw
+struct MeshRenderer
 {
-	std::shared_ptr<UInfo> info; 
-	//std::shared_ptr<Mesh> mesh;
 	MeshType meshType; // Todo: Remove to be generic mesh 
-};
\ No newline at end of file
+	uint32_t material = 0;
+	uint32_t pipeline = 0; // only pipeline 0 exists for now
+};
+
+// SDF primitives, numbered as in the raymarch shaders
+enum ShapeType : uint32_t
+{
+	SHAPE_SPHERE,
+	SHAPE_BOX,
+	SHAPE_ROUND_BOX
+};
+
+// Raymarched SDF shape, centered on its transform's world position
+struct Shape
+{
+	uint32_t shapeType = SHAPE_SPHERE;
+
+	// sphere: x = radius
+	// box: xyz = half extents
+	// round box: xyz = half extents, w = rounding
+	glm::vec4 parameters = glm::vec4(1.0f);
+
+	bool operator==(const Shape&) const = default;
+};
@@ -0,0 +1,82 @@
+#include "Registry.h"
+
+Entity Registry::Create()
+{
+	Entity entity;
+
+	if (!freeIndices.empty())
+	{
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = static_cast<uint32_t>(generations.size());
+		generations.push_back(0);
+	}
+
+	entity.generation = generations[entity.index];
+	count++;
+
+	return entity;
+}
+
+void Registry::Destroy(Entity entity)
+{
+	if (!IsValid(entity))
+	{
+		return;
+	}
+
+	for (std::unique_ptr<ComponentPoolBase>& pool : pools)
+	{
+		if (pool)
+		{
+			pool->Remove(entity);
+		}
+	}
+
+	generations[entity.index]++;
+	freeIndices.push_back(entity.index);
+	count--;
+}
+
+bool Registry::IsValid(Entity entity) const
+{
+	return entity.index < generations.size() && generations[entity.index] == entity.generation;
+}
+
+void Registry::Clear()
+{
+	for (std::unique_ptr<ComponentPoolBase>& pool : pools)
+	{
+		if (pool)
+		{
+			pool->Clear();
+		}
+	}
+
+	// Every index not already free was live: retire its generation
+	std::vector<bool> isFree(generations.size(), false);
+
+	for (uint32_t index : freeIndices)
+	{
+		isFree[index] = true;
+	}
+
+	for (uint32_t index = 0; index < generations.size(); index++)
+	{
+		if (!isFree[index])
+		{
+			generations[index]++;
+			freeIndices.push_back(index);
+		}
+	}
+
+	count = 0;
+}
+
+size_t Registry::Size() const
+{
+	return count;
+}
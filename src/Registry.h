@@ -0,0 +1,236 @@
+#pragma once
+
+#include "config.h"
+#include "Entity.h"
+
+#include <memory>
+#include <tuple>
+
+// Lets the registry strip a destroyed entity from every pool without knowing the types
+class ComponentPoolBase
+{
+public:
+	virtual ~ComponentPoolBase() = default;
+
+	// Does nothing if the entity has no such component
+	virtual void Remove(Entity entity) = 0;
+	virtual void Clear() = 0;
+};
+
+/// <summary>
+/// Sparse set of one component type.
+/// Components (and the entities owning them) are packed densely in parallel arrays,
+/// the sparse array maps an entity index onto its packed position.
+/// Removing a component moves the last one into its place
+/// </summary>
+template <typename T>
+class ComponentPool : public ComponentPoolBase
+{
+public:
+	bool Has(Entity entity) const
+	{
+		return entity.index < sparse.size()
+			&& sparse[entity.index] != UINT32_MAX
+			&& entities[sparse[entity.index]].generation == entity.generation;
+	}
+
+	// Replaces the entity's component if it has one already
+	// Returns nullptr (and adds nothing) if another generation of the index owns the slot
+	T* Add(Entity entity, T component)
+	{
+		if (Has(entity))
+		{
+			return &(components[sparse[entity.index]] = std::move(component));
+		}
+
+		if (entity.index >= sparse.size())
+		{
+			sparse.resize(entity.index + 1, UINT32_MAX);
+		}
+		else if (sparse[entity.index] != UINT32_MAX)
+		{
+			return nullptr;
+		}
+
+		sparse[entity.index] = static_cast<uint32_t>(entities.size());
+		entities.push_back(entity);
+		components.push_back(std::move(component));
+
+		return &components.back();
+	}
+
+	void Remove(Entity entity) override
+	{
+		if (!Has(entity))
+		{
+			return;
+		}
+
+		uint32_t dense = sparse[entity.index];
+
+		if (dense + 1 != entities.size())
+		{
+			entities[dense] = entities.back();
+			components[dense] = std::move(components.back());
+			sparse[entities[dense].index] = dense;
+		}
+
+		entities.pop_back();
+		components.pop_back();
+		sparse[entity.index] = UINT32_MAX;
+	}
+
+	void Clear() override
+	{
+		sparse.clear();
+		entities.clear();
+		components.clear();
+	}
+
+	// The entity must have the component
+	T& Get(Entity entity)
+	{
+		return components[sparse[entity.index]];
+	}
+
+	T* TryGet(Entity entity)
+	{
+		return Has(entity) ? &components[sparse[entity.index]] : nullptr;
+	}
+
+	size_t Size() const
+	{
+		return entities.size();
+	}
+
+	// Packed arrays, in the same order
+	const std::vector<Entity>& GetEntities() const
+	{
+		return entities;
+	}
+
+	std::vector<T>& GetComponents()
+	{
+		return components;
+	}
+
+private:
+	std::vector<uint32_t> sparse;
+	std::vector<Entity> entities;
+	std::vector<T> components;
+};
+
+/// <summary>
+/// Sparse-set entity component system.
+/// Entities are generational IDs, each component type has its own packed pool,
+/// and queries walk the packed array of their first component type
+/// </summary>
+class Registry
+{
+public:
+	Entity Create();
+
+	// Also removes all of its components
+	void Destroy(Entity entity);
+	bool IsValid(Entity entity) const;
+
+	// Destroys every entity
+	void Clear();
+
+	size_t Size() const;
+
+	// Returns nullptr (and adds nothing) if the entity was destroyed
+	template <typename T>
+	T* Add(Entity entity, T component = T{})
+	{
+		if (!IsValid(entity))
+		{
+			return nullptr;
+		}
+
+		return Pool<T>().Add(entity, std::move(component));
+	}
+
+	template <typename T>
+	void Remove(Entity entity)
+	{
+		Pool<T>().Remove(entity);
+	}
+
+	template <typename T>
+	bool Has(Entity entity)
+	{
+		return Pool<T>().Has(entity);
+	}
+
+	// The entity must have the component
+	template <typename T>
+	T& Get(Entity entity)
+	{
+		return Pool<T>().Get(entity);
+	}
+
+	template <typename T>
+	T* TryGet(Entity entity)
+	{
+		return Pool<T>().TryGet(entity);
+	}
+
+	template <typename T>
+	ComponentPool<T>& Pool()
+	{
+		size_t type = TypeIndex<T>();
+
+		if (type >= pools.size())
+		{
+			pools.resize(type + 1);
+		}
+
+		if (!pools[type])
+		{
+			pools[type] = std::make_unique<ComponentPool<T>>();
+		}
+
+		return static_cast<ComponentPool<T>&>(*pools[type]);
+	}
+
+	// Calls function(entity, T&, Others&...) for every entity that has all of the components,
+	// in the packed order of T (so T should be the rarest)
+	// Components must not be added or removed from inside the function
+	template <typename T, typename... Others, typename Function>
+	void Each(Function&& function)
+	{
+		ComponentPool<T>& pool = Pool<T>();
+		std::tuple<ComponentPool<Others>&...> others{ Pool<Others>()... };
+
+		const std::vector<Entity>& entities = pool.GetEntities();
+		std::vector<T>& components = pool.GetComponents();
+
+		for (size_t ii = 0; ii < entities.size(); ii++)
+		{
+			Entity entity = entities[ii];
+
+			if ((std::get<ComponentPool<Others>&>(others).Has(entity) && ...))
+			{
+				function(entity, components[ii], std::get<ComponentPool<Others>&>(others).Get(entity)...);
+			}
+		}
+	}
+
+private:
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> freeIndices;
+	size_t count = 0;
+
+	std::vector<std::unique_ptr<ComponentPoolBase>> pools;
+
+	// Small, dense ID per component type, assigned on first use
+	inline static size_t nextTypeIndex = 0;
+
+	template <typename T>
+	static size_t TypeIndex()
+	{
+		static const size_t index = nextTypeIndex++;
+		return index;
+	}
+};
@@ -1,162 +1,109 @@
 #include "Transform.h"
 
-Transform::Transform() :
-	position(glm::vec3(0.0f, 0.0f, 0.0f)),
-	quatRot(1.0f, 0.0f, 0.0f, 0.0f),
-	scale(1.0f, 1.0f, 1.0f)
+Transform::Transform(TransformSystem& system, TransformHandle handle) :
+	system(&system),
+	handle(handle)
 {
-	worldMatrix = glm::mat4x4();
-	worldInverseTransposeMatrix = glm::mat4x4();
-
-	matIsDirty = true;
-	dirIsDirty = true;
-
-	CleanVectors();
-	CleanMatrices();
 }
 
-#pragma region HELPERS
+TransformHandle Transform::GetHandle() const
+{
+	return handle;
+}
 
-void Transform::CleanMatrices()
+bool Transform::SetParent(const Transform* parent)
 {
-	// Create a new world if transform has been mutated 
-	if (matIsDirty)
-	{
-		// Get each of parts that represent the world matrix 
-		glm::mat4x4 pos = glm::translate(glm::mat4(1.0f), position);
-		glm::mat4x4 rot = glm::rotate(glm::mat4(1.0f), quatRot.w, glm::vec3(quatRot.x, quatRot.y, quatRot.z));
-		glm::mat4x4 sca = glm::scale(glm::mat4(1.0f), scale);
-
-		// Final results set here 
-		worldMatrix = sca * rot * pos;
-		worldInverseTransposeMatrix = glm::inverse(glm::transpose(worldMatrix));
-
-		matIsDirty = false;
-	}
+	return system->SetParent(handle, parent ? parent->handle : TransformHandle{});
 }
 
-void Transform::CleanVectors()
+TransformHandle Transform::GetParent() const
 {
-	if (!dirIsDirty)
-		return;
-
-	right = QuatRot(quatRot, glm::vec3(1.0, 0.0, 0.0));
-	up = QuatRot(quatRot, glm::vec3(0.0, 1.0, 0.0));
-	forward = QuatRot(quatRot, glm::vec3(0.0, 0.0, 1.0));
-	
-	dirIsDirty = false;
+	return system->GetParent(handle);
 }
-#pragma endregion 
 
 #pragma region SETTERS
 
 void Transform::SetPosition(float x, float y, float z)
 {
-	// Was there a XMFloat function for this? 
-	position.x = x;
-	position.y = y;
-	position.z = z;
-
-	matIsDirty = true;
+	system->SetPosition(handle, glm::vec3(x, y, z));
 }
 
 void Transform::SetPosition(glm::vec3 position)
 {
-	position = position;
-	matIsDirty = true;
+	system->SetPosition(handle, position);
 }
 
 void Transform::SetEulerRotation(float pitch, float yaw, float roll)
 {
-	quatRot = ToQuat(roll, pitch, yaw);
-
-	matIsDirty = true;
-	dirIsDirty = true;
+	system->SetRotation(handle, ToQuat(roll, pitch, yaw));
 }
 
 void Transform::SetEulerRotation(glm::vec3 rotation)
 {
-	quatRot = ToQuat(rotation.x, rotation.y, rotation.z);
-
-	matIsDirty = true;
-	dirIsDirty = true;
+	system->SetRotation(handle, ToQuat(rotation.x, rotation.y, rotation.z));
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-
-	matIsDirty = true;
+	system->SetScale(handle, glm::vec3(x, y, z));
 }
 
 void Transform::SetScale(glm::vec3 scale)
 {
-	this->scale = scale;
-
-	matIsDirty = true;
+	system->SetScale(handle, scale);
 }
 
 void Transform::SetScale(float s)
 {
 	SetScale(s, s, s);
-
-	matIsDirty = true;
 }
 
 #pragma endregion
 
 #pragma region GETTERS
-glm::vec3 Transform::GetPosition()
+uint64_t Transform::GetVersion() const
 {
-	return position;
+	return system->GetVersion(handle);
 }
 
-glm::vec3 Transform::GetEulerRotation()
+glm::vec3 Transform::GetPosition() const
 {
-	return ToEuler(quatRot);
+	return system->GetPosition(handle);
 }
 
-glm::vec3 Transform::GetScale()
+glm::vec3 Transform::GetEulerRotation() const
 {
-	return scale;
+	return ToEuler(system->GetRotation(handle));
 }
 
-glm::mat4x4 Transform::GetWorldMatrix()
+glm::vec3 Transform::GetScale() const
 {
-	CleanMatrices();
-	return worldMatrix;
+	return system->GetScale(handle);
 }
 
-glm::mat4x4 Transform::GetWorldInverseTransposeMatrix()
+glm::mat4x4 Transform::GetWorldMatrix() const
 {
-	CleanMatrices();
-	return worldInverseTransposeMatrix;
+	return system->GetWorldMatrix(handle);
 }
 
-glm::vec3 Transform::GetRight()
+glm::mat4x4 Transform::GetWorldInverseTransposeMatrix() const
 {
-	if (dirIsDirty)
-		CleanVectors();
-
-	return right;
+	return glm::inverse(glm::transpose(system->GetWorldMatrix(handle)));
 }
 
-glm::vec3 Transform::GetUp()
+glm::vec3 Transform::GetRight() const
 {
-	if (dirIsDirty)
-		CleanVectors();
-
-	return up;
+	return QuatRot(system->GetRotation(handle), glm::vec3(1.0, 0.0, 0.0));
 }
 
-glm::vec3 Transform::GetForward()
+glm::vec3 Transform::GetUp() const
 {
-	if (dirIsDirty)
-		CleanVectors();
+	return QuatRot(system->GetRotation(handle), glm::vec3(0.0, 1.0, 0.0));
+}
 
-	return forward;
+glm::vec3 Transform::GetForward() const
+{
+	return QuatRot(system->GetRotation(handle), glm::vec3(0.0, 0.0, 1.0));
 }
 
 #pragma endregion
@@ -164,95 +111,53 @@ glm::vec3 Transform::GetForward()
 #pragma region MUTATORS 
 void Transform::MoveAbs(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
-	matIsDirty = true;
+	MoveAbs(glm::vec3(x, y, z));
 }
 
 void Transform::MoveAbs(glm::vec3 offset)
 {
-	position.x += offset.x;
-	position.y += offset.y;
-	position.z += offset.z;
-	matIsDirty = true;
+	system->SetPosition(handle, system->GetPosition(handle) + offset);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
-	// Creat the movement variable 
-	glm::vec3 toMove = glm::vec3(x, y, z);
-
-	// Convert to local space 
-	toMove = QuatRot(quatRot, toMove);
-
-	// Add in local space 
-	toMove = position + toMove;
-
-	// Store 
-	position = toMove;
-	matIsDirty = true;
+	MoveRelative(glm::vec3(x, y, z));
 }
 
 void Transform::MoveRelative(glm::vec3 vec)
 {
-	glm::vec3 toMove = vec;
-
 	// Convert to local space 
-	toMove = QuatRot(quatRot, toMove);
+	glm::vec3 toMove = QuatRot(system->GetRotation(handle), vec);
 
 	// Add in local space 
-	toMove = position + toMove;
-
-	// Store 
-	position = toMove;
-
-	matIsDirty = true;
+	system->SetPosition(handle, system->GetPosition(handle) + toMove);
 }
 
 void Transform::RotateEuler(float pitch, float yaw, float roll)
 {
 	glm::vec4 mutQuat = ToQuat(roll, pitch, yaw);
-	quatRot = quatRot * mutQuat;
-
-	matIsDirty = true;
-	dirIsDirty = true;
+	system->SetRotation(handle, QuatMul(system->GetRotation(handle), mutQuat));
 }
 
 void Transform::RotateEuler(glm::vec3 rotation)
 {
 	glm::vec4 mutQuat = ToQuat(rotation.z, rotation.x, rotation.y);
-	quatRot = quatRot * mutQuat;
-
-	matIsDirty = true;
-	dirIsDirty = true;
+	system->SetRotation(handle, QuatMul(system->GetRotation(handle), mutQuat));
 }
 
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x += x;
-	scale.y += y;
-	scale.z += z;
-
-	matIsDirty = true;
+	Scale(glm::vec3(x, y, z));
 }
 
 void Transform::Scale(glm::vec3 scale)
 {
-	this->scale.x += scale.x;
-	this->scale.y += scale.y;
-	this->scale.z += scale.z;
-
-	matIsDirty = true;
+	system->SetScale(handle, system->GetScale(handle) + scale);
 }
 
 void Transform::Scale(float scale)
 {
-	this->scale.x += scale;
-	this->scale.y += scale;
-	this->scale.z += scale;
-
-	matIsDirty = true;
+	Scale(glm::vec3(scale));
 }
 
-#pragma endregion
\ No newline at end of file
+#pragma endregion
@@ -2,13 +2,24 @@
 
 #include "config.h"
 #include "cmath"
+#include "TransformSystem.h"
 
 // Modified from: https://github.com/vixorien/AdvancedDX11Starter/blob/main/Transform.h
 
+// Handle-based facade over one transform in a TransformSystem
+// The data itself lives in the system's packed arrays, so this is cheap to copy and
+// doesn't own anything: whoever created the handle destroys it (see Scene::DestroyEntity)
 class Transform
 {
 public:
-	Transform();
+	Transform(TransformSystem& system, TransformHandle handle);
+
+	TransformHandle GetHandle() const;
+
+	// Position, rotation and scale are relative to the parent (nullptr for none)
+	// Returns false if the parent is this transform or one of its descendants
+	bool SetParent(const Transform* parent);
+	TransformHandle GetParent() const;
 
 	// Transformers
 	void MoveAbs(float x, float y, float z);
@@ -31,39 +42,26 @@ public:
 	void SetScale(glm::vec3 scale);
 
 	// Getters
-	glm::vec3 GetPosition();
-	glm::vec3 GetEulerRotation();
-	glm::vec3 GetScale();
+	glm::vec3 GetPosition() const;
+	glm::vec3 GetEulerRotation() const;
+	glm::vec3 GetScale() const;
 
 	// Local direction vector getters
-	glm::vec3 GetUp();
-	glm::vec3 GetRight();
-	glm::vec3 GetForward();
+	glm::vec3 GetUp() const;
+	glm::vec3 GetRight() const;
+	glm::vec3 GetForward() const;
+
+	// Changes whenever the world matrix does, and is never shared by two transforms
+	// Lets renderers skip matrices they already uploaded
+	uint64_t GetVersion() const;
 
 	// Matrix getters
-	glm::mat4x4 GetWorldMatrix();
-	glm::mat4x4 GetWorldInverseTransposeMatrix();
+	glm::mat4x4 GetWorldMatrix() const;
+	glm::mat4x4 GetWorldInverseTransposeMatrix() const;
 	
 private:
-	// Raw transformation data
-	glm::vec3 position;
-	glm::vec4 quatRot;
-	glm::vec3 scale;
-
-	// Local orientation vectors
-	bool dirIsDirty;
-	glm::vec3 up;
-	glm::vec3 right;
-	glm::vec3 forward;
-
-	// World matrix and inverse transpose of the world matrix
-	bool matIsDirty;
-	glm::mat4x4 worldMatrix;
-	glm::mat4x4 worldInverseTransposeMatrix;
-
-	// Helper to update both matrices if necessary
-	void CleanMatrices();
-	void CleanVectors();
+	TransformSystem* system;
+	TransformHandle handle;
 };
 
 inline static glm::vec3 QuatRot(glm::vec4 q, glm::vec3 v)
@@ -75,6 +73,16 @@ inline static glm::vec3 QuatRot(glm::vec4 q, glm::vec3 v)
 	return v + 2.0f * c;
 }
 
+// Hamilton product: rotating by the result = rotating by b, then by a
+inline static glm::vec4 QuatMul(glm::vec4 a, glm::vec4 b)
+{
+	return glm::vec4(
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
 inline static glm::vec4 ToQuat(double roll, double pitch, double yaw) // roll (x), pitch (y), yaw (z), angles are in radians
 {
 	// Reference: https://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles
@@ -0,0 +1,621 @@
+#include "TransformSystem.h"
+
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SYSTEM_SSE
+#include <emmintrin.h>
+#endif
+
+// Shared by all transform systems, so that a version also tells transforms apart
+static std::atomic<uint64_t> nextVersion{ 1 };
+
+// Below this many transforms, a job costs more than it saves
+static constexpr uint32_t PARALLEL_MIN_TRANSFORMS = 16384;
+
+static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+// values[ii] = old values[order[ii]]
+template <typename T>
+static void permute(std::vector<T>& values, const std::vector<uint32_t>& order)
+{
+	std::vector<T> permuted(values.size());
+
+	for (size_t ii = 0; ii < order.size(); ii++)
+	{
+		permuted[ii] = values[order[ii]];
+	}
+
+	values.swap(permuted);
+}
+
+#pragma region HANDLES
+
+TransformHandle TransformSystem::Create()
+{
+	TransformHandle handle;
+
+	if (!freeHandles.empty())
+	{
+		handle.index = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle.index = static_cast<uint32_t>(denseIndices.size());
+		denseIndices.push_back(0);
+		generations.push_back(0);
+	}
+
+	handle.generation = generations[handle.index];
+
+	uint32_t dense = count++;
+	Reserve(count);
+
+	denseIndices[handle.index] = dense;
+	handleIndices[dense] = handle.index;
+
+	positionX[dense] = 0.0f;
+	positionY[dense] = 0.0f;
+	positionZ[dense] = 0.0f;
+
+	// identity quaternion (x, y, z, w)
+	rotationX[dense] = 0.0f;
+	rotationY[dense] = 0.0f;
+	rotationZ[dense] = 0.0f;
+	rotationW[dense] = 1.0f;
+
+	scaleX[dense] = 1.0f;
+	scaleY[dense] = 1.0f;
+	scaleZ[dense] = 1.0f;
+
+	// A new root goes last, which keeps the depth-first order intact
+	parents[dense] = TransformHandle{};
+	parentIndices[dense] = NO_PARENT;
+	subtreeStarts.push_back(dense);
+
+	MarkDirty(dense);
+
+	return handle;
+}
+
+void TransformSystem::Destroy(TransformHandle handle)
+{
+	if (!IsValid(handle))
+	{
+		return;
+	}
+
+	// Move the last transform into the hole
+	uint32_t dense = denseIndices[handle.index];
+	uint32_t last = --count;
+
+	if (dense != last)
+	{
+		positionX[dense] = positionX[last];
+		positionY[dense] = positionY[last];
+		positionZ[dense] = positionZ[last];
+		rotationX[dense] = rotationX[last];
+		rotationY[dense] = rotationY[last];
+		rotationZ[dense] = rotationZ[last];
+		rotationW[dense] = rotationW[last];
+		scaleX[dense] = scaleX[last];
+		scaleY[dense] = scaleY[last];
+		scaleZ[dense] = scaleZ[last];
+
+		localMatrices[dense] = localMatrices[last];
+		worldMatrices[dense] = worldMatrices[last];
+		versions[dense] = versions[last];
+		dirty[dense] = dirty[last];
+		parents[dense] = parents[last];
+
+		handleIndices[dense] = handleIndices[last];
+		denseIndices[handleIndices[dense]] = dense;
+	}
+
+	dirty[last] = 0;
+
+	// Children of the destroyed transform are detached when the order is restored
+	hierarchyChanged = true;
+
+	generations[handle.index]++;
+	freeHandles.push_back(handle.index);
+}
+
+bool TransformSystem::IsValid(TransformHandle handle) const
+{
+	return handle.index < generations.size() && generations[handle.index] == handle.generation;
+}
+
+uint32_t TransformSystem::GetDenseIndex(TransformHandle handle) const
+{
+	return denseIndices[handle.index];
+}
+
+size_t TransformSystem::Size() const
+{
+	return count;
+}
+
+void TransformSystem::Reserve(uint32_t size)
+{
+	size_t padded = (static_cast<size_t>(size) + 3) & ~static_cast<size_t>(3);
+
+	if (positionX.size() >= padded)
+	{
+		return;
+	}
+
+	padded = std::max(padded, positionX.size() * 2);
+
+	for (std::vector<float>* component : { &positionX, &positionY, &positionZ,
+		&rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+	{
+		component->resize(padded, 0.0f);
+	}
+
+	localMatrices.resize(padded, glm::mat4(1.0f));
+	worldMatrices.resize(padded, glm::mat4(1.0f));
+	versions.resize(padded, 0);
+	dirty.resize(padded, 0);
+	worldChanged.resize(padded, 0);
+	parents.resize(padded);
+	parentIndices.resize(padded, NO_PARENT);
+	handleIndices.resize(padded, 0);
+}
+
+#pragma endregion
+
+#pragma region SETTERS
+
+void TransformSystem::MarkDirty(uint32_t dense)
+{
+	dirty[dense] = 1;
+	anyDirty = true;
+}
+
+bool TransformSystem::SetParent(TransformHandle handle, TransformHandle parent)
+{
+	// Walk up from the new parent, making sure we don't pass through ourselves
+	for (TransformHandle ancestor = parent; IsValid(ancestor); ancestor = parents[denseIndices[ancestor.index]])
+	{
+		if (ancestor.index == handle.index)
+		{
+			return false;
+		}
+	}
+
+	uint32_t dense = denseIndices[handle.index];
+
+	parents[dense] = IsValid(parent) ? parent : TransformHandle{};
+	hierarchyChanged = true;
+
+	MarkDirty(dense);
+
+	return true;
+}
+
+void TransformSystem::SetPosition(TransformHandle handle, glm::vec3 position)
+{
+	uint32_t dense = denseIndices[handle.index];
+
+	positionX[dense] = position.x;
+	positionY[dense] = position.y;
+	positionZ[dense] = position.z;
+
+	MarkDirty(dense);
+}
+
+void TransformSystem::SetRotation(TransformHandle handle, glm::vec4 rotation)
+{
+	uint32_t dense = denseIndices[handle.index];
+
+	rotationX[dense] = rotation.x;
+	rotationY[dense] = rotation.y;
+	rotationZ[dense] = rotation.z;
+	rotationW[dense] = rotation.w;
+
+	MarkDirty(dense);
+}
+
+void TransformSystem::SetScale(TransformHandle handle, glm::vec3 scale)
+{
+	uint32_t dense = denseIndices[handle.index];
+
+	scaleX[dense] = scale.x;
+	scaleY[dense] = scale.y;
+	scaleZ[dense] = scale.z;
+
+	MarkDirty(dense);
+}
+
+#pragma endregion
+
+#pragma region GETTERS
+
+glm::vec3 TransformSystem::GetPosition(TransformHandle handle) const
+{
+	uint32_t dense = denseIndices[handle.index];
+	return glm::vec3(positionX[dense], positionY[dense], positionZ[dense]);
+}
+
+glm::vec4 TransformSystem::GetRotation(TransformHandle handle) const
+{
+	uint32_t dense = denseIndices[handle.index];
+	return glm::vec4(rotationX[dense], rotationY[dense], rotationZ[dense], rotationW[dense]);
+}
+
+glm::vec3 TransformSystem::GetScale(TransformHandle handle) const
+{
+	uint32_t dense = denseIndices[handle.index];
+	return glm::vec3(scaleX[dense], scaleY[dense], scaleZ[dense]);
+}
+
+TransformHandle TransformSystem::GetParent(TransformHandle handle) const
+{
+	TransformHandle parent = parents[denseIndices[handle.index]];
+	return IsValid(parent) ? parent : TransformHandle{};
+}
+
+uint64_t TransformSystem::GetVersion(TransformHandle handle) const
+{
+	return versions[denseIndices[handle.index]];
+}
+
+glm::mat4 TransformSystem::GetWorldMatrix(TransformHandle handle) const
+{
+	uint32_t dense = denseIndices[handle.index];
+
+	if (!anyDirty && !hierarchyChanged)
+	{
+		return worldMatrices[dense];
+	}
+
+	// Something changed, possibly an ancestor, so walk the chain instead of trusting the cache
+	glm::mat4 world = ComputeLocalMatrix(dense);
+
+	for (TransformHandle parent = parents[dense]; IsValid(parent); parent = parents[denseIndices[parent.index]])
+	{
+		world = ComputeLocalMatrix(denseIndices[parent.index]) * world;
+	}
+
+	return world;
+}
+
+const glm::mat4* TransformSystem::GetWorldMatrices() const
+{
+	return worldMatrices.data();
+}
+
+const uint64_t* TransformSystem::GetVersions() const
+{
+	return versions.data();
+}
+
+#pragma endregion
+
+#pragma region MATRICES
+
+// Local = Translation * Rotation * Scale
+// Column c of the rotation is the quaternion's rotated basis vector, scaled by scale[c]
+glm::mat4 TransformSystem::ComputeLocalMatrix(uint32_t dense) const
+{
+	float x = rotationX[dense], y = rotationY[dense], z = rotationZ[dense], w = rotationW[dense];
+	float sx = scaleX[dense], sy = scaleY[dense], sz = scaleZ[dense];
+
+	glm::mat4 m;
+
+	m[0][0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+	m[0][1] = 2.0f * (x * y + w * z) * sx;
+	m[0][2] = 2.0f * (x * z - w * y) * sx;
+	m[0][3] = 0.0f;
+
+	m[1][0] = 2.0f * (x * y - w * z) * sy;
+	m[1][1] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+	m[1][2] = 2.0f * (y * z + w * x) * sy;
+	m[1][3] = 0.0f;
+
+	m[2][0] = 2.0f * (x * z + w * y) * sz;
+	m[2][1] = 2.0f * (y * z - w * x) * sz;
+	m[2][2] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+	m[2][3] = 0.0f;
+
+	m[3][0] = positionX[dense];
+	m[3][1] = positionY[dense];
+	m[3][2] = positionZ[dense];
+	m[3][3] = 1.0f;
+
+	return m;
+}
+
+// Same math as ComputeLocalMatrix, for transforms [first, first + 4)
+// Each register holds one matrix element for 4 transforms, and is transposed back
+// into per-transform columns on the way out
+void TransformSystem::CleanBatch(uint32_t first)
+{
+#ifdef TRANSFORM_SYSTEM_SSE
+	__m128 x = _mm_loadu_ps(&rotationX[first]);
+	__m128 y = _mm_loadu_ps(&rotationY[first]);
+	__m128 z = _mm_loadu_ps(&rotationZ[first]);
+	__m128 w = _mm_loadu_ps(&rotationW[first]);
+
+	__m128 sx = _mm_loadu_ps(&scaleX[first]);
+	__m128 sy = _mm_loadu_ps(&scaleY[first]);
+	__m128 sz = _mm_loadu_ps(&scaleZ[first]);
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+	__m128 columns[4][4];
+
+	columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+	columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+	columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+	columns[0][3] = _mm_setzero_ps();
+
+	columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+	columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+	columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+	columns[1][3] = _mm_setzero_ps();
+
+	columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+	columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+	columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+	columns[2][3] = _mm_setzero_ps();
+
+	columns[3][0] = _mm_loadu_ps(&positionX[first]);
+	columns[3][1] = _mm_loadu_ps(&positionY[first]);
+	columns[3][2] = _mm_loadu_ps(&positionZ[first]);
+	columns[3][3] = one;
+
+	for (int column = 0; column < 4; column++)
+	{
+		_MM_TRANSPOSE4_PS(columns[column][0], columns[column][1], columns[column][2], columns[column][3]);
+
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			_mm_storeu_ps(&localMatrices[first + lane][column][0], columns[column][lane]);
+		}
+	}
+#else
+	for (uint32_t dense = first; dense < first + 4; dense++)
+	{
+		localMatrices[dense] = ComputeLocalMatrix(dense);
+	}
+#endif
+}
+
+void TransformSystem::UpdateRange(uint32_t first, uint32_t last)
+{
+	// Local matrices: whole batches of 4 in SIMD, the unaligned ends one at a time,
+	// so that neighbouring ranges never write the same batch
+	uint32_t batchFirst = std::min((first + 3) & ~3u, last);
+	uint32_t batchLast = std::max(last & ~3u, batchFirst);
+
+	for (uint32_t dense = first; dense < batchFirst; dense++)
+	{
+		if (dirty[dense])
+		{
+			localMatrices[dense] = ComputeLocalMatrix(dense);
+		}
+	}
+
+	for (uint32_t batch = batchFirst; batch < batchLast; batch += 4)
+	{
+		uint32_t batchDirty;
+		memcpy(&batchDirty, &dirty[batch], sizeof(uint32_t));
+
+		if (batchDirty)
+		{
+			CleanBatch(batch);
+		}
+	}
+
+	for (uint32_t dense = batchLast; dense < last; dense++)
+	{
+		if (dirty[dense])
+		{
+			localMatrices[dense] = ComputeLocalMatrix(dense);
+		}
+	}
+
+	// Which world matrices change: parents come first, so a changed parent has already been seen
+	// by the time its children are reached
+	uint32_t changedCount = 0;
+
+	for (uint32_t dense = first; dense < last; dense++)
+	{
+		uint32_t parent = parentIndices[dense];
+		bool changed = dirty[dense] || (parent != NO_PARENT && worldChanged[parent]);
+
+		worldChanged[dense] = changed;
+		changedCount += changed;
+	}
+
+	if (changedCount == 0)
+	{
+		return;
+	}
+
+	// Every job runs this at once, so versions are reserved as one block per range
+	// instead of contending over the counter for every matrix
+	uint64_t version = nextVersion.fetch_add(changedCount, std::memory_order_relaxed);
+
+	for (uint32_t dense = first; dense < last; dense++)
+	{
+		if (!worldChanged[dense])
+		{
+			continue;
+		}
+
+		uint32_t parent = parentIndices[dense];
+
+		worldMatrices[dense] = parent == NO_PARENT
+			? localMatrices[dense]
+			: worldMatrices[parent] * localMatrices[dense];
+
+		versions[dense] = version++;
+		dirty[dense] = 0;
+	}
+}
+
+void TransformSystem::UpdateWorldMatrices(vkUtil::JobSystem* jobs)
+{
+	if (hierarchyChanged)
+	{
+		SortHierarchy();
+	}
+
+	if (!anyDirty)
+	{
+		return;
+	}
+
+	uint32_t jobCount = jobs ? std::min(jobs->get_thread_count(), count / PARALLEL_MIN_TRANSFORMS) : 1;
+
+	if (jobCount <= 1)
+	{
+		UpdateRange(0, count);
+	}
+	else
+	{
+		// Split into runs of whole subtrees of roughly equal size
+		std::vector<uint32_t> splits = { 0 };
+		uint32_t target = count / jobCount;
+
+		for (uint32_t start : subtreeStarts)
+		{
+			if (start >= splits.back() + target && splits.size() < jobCount)
+			{
+				splits.push_back(start);
+			}
+		}
+
+		splits.push_back(count);
+
+		jobs->parallel_for(static_cast<uint32_t>(splits.size() - 1), [this, &splits](uint32_t job)
+			{
+				UpdateRange(splits[job], splits[job + 1]);
+			});
+	}
+
+	anyDirty = false;
+}
+
+void TransformSystem::SortHierarchy()
+{
+	// Resolve parent handles to packed indices, detaching children of destroyed transforms
+	std::vector<uint32_t> childCounts(count + 1, 0);
+
+	for (uint32_t dense = 0; dense < count; dense++)
+	{
+		if (parents[dense].index != UINT32_MAX && !IsValid(parents[dense]))
+		{
+			parents[dense] = TransformHandle{};
+			MarkDirty(dense);
+		}
+
+		parentIndices[dense] = IsValid(parents[dense]) ? denseIndices[parents[dense].index] : NO_PARENT;
+
+		if (parentIndices[dense] != NO_PARENT)
+		{
+			childCounts[parentIndices[dense] + 1]++;
+		}
+	}
+
+	// Children of every transform, grouped by parent (counting sort, keeps packed order within a group)
+	for (uint32_t dense = 0; dense < count; dense++)
+	{
+		childCounts[dense + 1] += childCounts[dense];
+	}
+
+	std::vector<uint32_t> children(childCounts[count]);
+	std::vector<uint32_t> childFill(childCounts.begin(), childCounts.end() - 1);
+
+	for (uint32_t dense = 0; dense < count; dense++)
+	{
+		if (parentIndices[dense] != NO_PARENT)
+		{
+			children[childFill[parentIndices[dense]]++] = dense;
+		}
+	}
+
+	// Depth-first walk from every root, in packed order
+	std::vector<uint32_t> order;
+	order.reserve(parents.size());
+
+	std::vector<uint32_t> stack;
+	subtreeStarts.clear();
+
+	for (uint32_t root = 0; root < count; root++)
+	{
+		if (parentIndices[root] != NO_PARENT)
+		{
+			continue;
+		}
+
+		subtreeStarts.push_back(static_cast<uint32_t>(order.size()));
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			uint32_t dense = stack.back();
+			stack.pop_back();
+
+			order.push_back(dense);
+
+			// Pushed in reverse, so siblings keep their order
+			for (uint32_t child = childCounts[dense + 1]; child > childCounts[dense]; child--)
+			{
+				stack.push_back(children[child - 1]);
+			}
+		}
+	}
+
+	// The padding past count stays where it is
+	for (uint32_t dense = count; dense < parents.size(); dense++)
+	{
+		order.push_back(dense);
+	}
+
+	bool sorted = true;
+
+	for (uint32_t dense = 0; dense < count && sorted; dense++)
+	{
+		sorted = order[dense] == dense;
+	}
+
+	if (!sorted)
+	{
+		for (std::vector<float>* component : { &positionX, &positionY, &positionZ,
+			&rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+		{
+			permute(*component, order);
+		}
+
+		permute(localMatrices, order);
+		permute(worldMatrices, order);
+		permute(versions, order);
+		permute(dirty, order);
+		permute(parents, order);
+		permute(handleIndices, order);
+
+		for (uint32_t dense = 0; dense < count; dense++)
+		{
+			denseIndices[handleIndices[dense]] = dense;
+		}
+	}
+
+	for (uint32_t dense = 0; dense < count; dense++)
+	{
+		parentIndices[dense] = IsValid(parents[dense]) ? denseIndices[parents[dense].index] : NO_PARENT;
+	}
+
+	hierarchyChanged = false;
+}
+
+#pragma endregion
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "config.h"
+#include "job_system.h"
+
+// Stable reference to a transform in a TransformSystem
+// The generation tells a live transform apart from a destroyed one whose index was reused
+struct TransformHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+/// <summary>
+/// Owns every transform of a scene, stored as structure-of-arrays.
+/// Transforms are packed densely, handles map onto the packed index,
+/// and local matrices are recomputed in SIMD batches of 4.
+/// Transforms can be parented: the packed arrays are kept in depth-first order
+/// (every parent before its children, each root's subtree contiguous),
+/// so world matrices are propagated in one forward pass, one job per group of subtrees
+/// </summary>
+class TransformSystem
+{
+public:
+	TransformHandle Create();
+	void Destroy(TransformHandle handle);
+	bool IsValid(TransformHandle handle) const;
+
+	// Packed index of a live transform
+	// Valid until the next Destroy(), SetParent() or UpdateWorldMatrices()
+	uint32_t GetDenseIndex(TransformHandle handle) const;
+
+	size_t Size() const;
+
+	// Position, rotation and scale are relative to the parent
+	// An invalid parent handle makes the transform a root
+	// Fails (and changes nothing) if it would make the transform its own ancestor
+	bool SetParent(TransformHandle handle, TransformHandle parent);
+	TransformHandle GetParent(TransformHandle handle) const;
+
+	// Setters
+	void SetPosition(TransformHandle handle, glm::vec3 position);
+	void SetRotation(TransformHandle handle, glm::vec4 rotation);
+	void SetScale(TransformHandle handle, glm::vec3 scale);
+
+	// Getters
+	glm::vec3 GetPosition(TransformHandle handle) const;
+	glm::vec4 GetRotation(TransformHandle handle) const;
+	glm::vec3 GetScale(TransformHandle handle) const;
+
+	// Changes whenever the world matrix does, and is never shared by two transforms
+	// Lets renderers skip matrices they already uploaded
+	uint64_t GetVersion(TransformHandle handle) const;
+
+	// Computed from the ancestor chain if anything changed since the last UpdateWorldMatrices()
+	glm::mat4 GetWorldMatrix(TransformHandle handle) const;
+
+	// Restores depth-first order if the hierarchy changed, then recomputes the
+	// local matrices of changed transforms and the world matrices of their subtrees
+	// Large updates are split into jobs when given a job system
+	void UpdateWorldMatrices(vkUtil::JobSystem* jobs = nullptr);
+
+	// Packed arrays, indexed by GetDenseIndex()
+	// Matrices are only current after UpdateWorldMatrices()
+	const glm::mat4* GetWorldMatrices() const;
+	const uint64_t* GetVersions() const;
+
+private:
+	// Checks the SIMD batches against ComputeLocalMatrix (see tests/transform_system_tests.cpp)
+	friend struct TransformSystemTests;
+
+	// Raw transformation data
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	// Cached matrices
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<uint64_t> versions;
+	std::vector<uint8_t> dirty;
+
+	// Hierarchy
+	// Parents are stored as handles, so destroying a parent is noticed (its children become roots)
+	std::vector<TransformHandle> parents;
+
+	// Packed index of the parent (UINT32_MAX for roots) and the packed index each root's subtree starts at
+	// Only valid while the hierarchy is unchanged
+	std::vector<uint32_t> parentIndices;
+	std::vector<uint32_t> subtreeStarts;
+
+	// Scratch for UpdateWorldMatrices(): whether a world matrix was recomputed this update
+	std::vector<uint8_t> worldChanged;
+
+	// Handle <-> packed index
+	std::vector<uint32_t> denseIndices;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> handleIndices;
+	std::vector<uint32_t> freeHandles;
+
+	uint32_t count = 0;
+	bool anyDirty = false;
+	bool hierarchyChanged = false;
+
+	void MarkDirty(uint32_t dense);
+	glm::mat4 ComputeLocalMatrix(uint32_t dense) const;
+	void CleanBatch(uint32_t first);
+
+	// Sorts the packed arrays depth-first and rebuilds parentIndices and subtreeStarts
+	void SortHierarchy();
+
+	// Updates transforms [first, last), which must be a run of whole subtrees
+	void UpdateRange(uint32_t first, uint32_t last);
+
+	// Keeps the SoA arrays a multiple of 4 long, so a batch can always load 4 lanes
+	void Reserve(uint32_t size);
+};
@@ -0,0 +1,310 @@
+#include "allocator.h"
+#include "buffers.h"
+
+#include <algorithm>
+
+namespace vkUtil
+{
+	static vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+	{
+		return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+	}
+
+	void MemoryAllocator::init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice, bool debug)
+	{
+		this->device = device;
+		this->physicalDevice = physicalDevice;
+		this->debug = debug;
+
+		memoryProperties = physicalDevice.getMemoryProperties();
+	}
+
+	MemoryAllocator::Pool& MemoryAllocator::get_pool(uint32_t memoryTypeIdx, AllocationStrategy strategy, ResourceKind kind)
+	{
+		for (Pool& pool : pools)
+		{
+			if (pool.memoryTypeIdx == memoryTypeIdx && pool.strategy == strategy && pool.kind == kind)
+			{
+				return pool;
+			}
+		}
+
+		vk::MemoryType memoryType = memoryProperties.memoryTypes[memoryTypeIdx];
+		vk::DeviceSize heapSize = memoryProperties.memoryHeaps[memoryType.heapIndex].size;
+
+		Pool pool;
+		pool.memoryTypeIdx = memoryTypeIdx;
+		pool.strategy = strategy;
+		pool.kind = kind;
+		pool.hostVisible = static_cast<bool>(memoryType.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+
+		// Small heaps (e.g. 256MB host visible VRAM) get proportionally smaller blocks
+		pool.blockSize = std::min(DEFAULT_BLOCK_SIZE, heapSize / 8);
+
+		pools.push_back(std::move(pool));
+
+		return pools.back();
+	}
+
+	MemoryBlock* MemoryAllocator::make_block(Pool& pool, uint32_t poolIdx, vk::DeviceSize size)
+	{
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = pool.memoryTypeIdx;
+
+		std::unique_ptr<MemoryBlock> block = std::make_unique<MemoryBlock>();
+		block->memory = device.allocateMemory(allocInfo);
+		block->size = size;
+		block->poolIdx = poolIdx;
+		block->freeRanges.push_back(FreeRange{ 0, size });
+
+		if (pool.hostVisible)
+		{
+			block->mappedData = device.mapMemory(block->memory, 0, VK_WHOLE_SIZE);
+		}
+
+		if (debug)
+		{
+			std::cout << "Allocated a " << size << " byte memory block of type " << pool.memoryTypeIdx << "\n";
+		}
+
+		pool.blocks.push_back(std::move(block));
+
+		return pool.blocks.back().get();
+	}
+
+	bool MemoryAllocator::try_allocate(MemoryBlock& block, AllocationStrategy strategy,
+		vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset)
+	{
+		if (strategy == AllocationStrategy::LINEAR)
+		{
+			vk::DeviceSize alignedOffset = align_up(block.head, alignment);
+
+			if (alignedOffset + size > block.size)
+			{
+				return false;
+			}
+
+			offset = alignedOffset;
+			block.head = alignedOffset + size;
+
+			return true;
+		}
+
+		// First fit
+		for (size_t ii = 0; ii < block.freeRanges.size(); ii++)
+		{
+			FreeRange range = block.freeRanges[ii];
+			vk::DeviceSize alignedOffset = align_up(range.offset, alignment);
+			vk::DeviceSize rangeEnd = range.offset + range.size;
+
+			if (alignedOffset + size > rangeEnd)
+			{
+				continue;
+			}
+
+			offset = alignedOffset;
+
+			// Keep the alignment padding in front, and whatever is left behind
+			std::vector<FreeRange> remainder;
+
+			if (alignedOffset > range.offset)
+			{
+				remainder.push_back(FreeRange{ range.offset, alignedOffset - range.offset });
+			}
+
+			if (alignedOffset + size < rangeEnd)
+			{
+				remainder.push_back(FreeRange{ alignedOffset + size, rangeEnd - (alignedOffset + size) });
+			}
+
+			block.freeRanges.erase(block.freeRanges.begin() + ii);
+			block.freeRanges.insert(block.freeRanges.begin() + ii, remainder.begin(), remainder.end());
+
+			return true;
+		}
+
+		return false;
+	}
+
+	Allocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements,
+		vk::MemoryPropertyFlags properties, AllocationStrategy strategy, ResourceKind kind)
+	{
+		uint32_t memoryTypeIdx = find_memory_type_idx(physicalDevice, requirements.memoryTypeBits, properties);
+
+		Pool& pool = get_pool(memoryTypeIdx, strategy, kind);
+		uint32_t poolIdx = static_cast<uint32_t>(&pool - pools.data());
+
+		vk::DeviceSize offset = 0;
+		MemoryBlock* chosenBlock = nullptr;
+
+		for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+		{
+			if (try_allocate(*block, strategy, requirements.size, requirements.alignment, offset))
+			{
+				chosenBlock = block.get();
+				break;
+			}
+		}
+
+		// Nothing fits, so grab a new block
+		// (oversized requests get a block of their own)
+		if (!chosenBlock)
+		{
+			chosenBlock = make_block(pool, poolIdx, std::max(pool.blockSize, requirements.size));
+			try_allocate(*chosenBlock, strategy, requirements.size, requirements.alignment, offset);
+		}
+
+		chosenBlock->bytesUsed += requirements.size;
+		chosenBlock->allocationCount++;
+
+		Allocation allocation;
+		allocation.memory = chosenBlock->memory;
+		allocation.offset = offset;
+		allocation.size = requirements.size;
+		allocation.block = chosenBlock;
+
+		if (chosenBlock->mappedData)
+		{
+			allocation.mappedData = static_cast<char*>(chosenBlock->mappedData) + offset;
+		}
+
+		return allocation;
+	}
+
+	void MemoryAllocator::free(Allocation& allocation)
+	{
+		MemoryBlock* block = allocation.block;
+
+		if (!block)
+		{
+			return;
+		}
+
+		Pool& pool = pools[block->poolIdx];
+
+		block->bytesUsed -= allocation.size;
+		block->allocationCount--;
+
+		if (pool.strategy == AllocationStrategy::LINEAR)
+		{
+			// Linear blocks are recycled as a whole
+			if (block->allocationCount == 0)
+			{
+				block->head = 0;
+			}
+		}
+		else
+		{
+			// Insert in offset order, then merge with the neighbours
+			std::vector<FreeRange>& ranges = block->freeRanges;
+
+			auto it = std::lower_bound(ranges.begin(), ranges.end(), allocation.offset,
+				[](const FreeRange& range, vk::DeviceSize offset) { return range.offset < offset; });
+			it = ranges.insert(it, FreeRange{ allocation.offset, allocation.size });
+
+			auto next = it + 1;
+			if (next != ranges.end() && it->offset + it->size == next->offset)
+			{
+				it->size += next->size;
+				ranges.erase(next);
+			}
+
+			if (it != ranges.begin())
+			{
+				auto prev = it - 1;
+				if (prev->offset + prev->size == it->offset)
+				{
+					prev->size += it->size;
+					ranges.erase(it);
+				}
+			}
+		}
+
+		// Keep one empty block around per pool so we don't thrash vkAllocateMemory
+		if (block->allocationCount == 0 && pool.blocks.size() > 1)
+		{
+			release_block(pool, block);
+		}
+
+		allocation = Allocation{};
+	}
+
+	void MemoryAllocator::release_block(Pool& pool, MemoryBlock* block)
+	{
+		if (block->mappedData)
+		{
+			device.unmapMemory(block->memory);
+		}
+
+		device.freeMemory(block->memory);
+
+		pool.blocks.erase(std::remove_if(pool.blocks.begin(), pool.blocks.end(),
+			[block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }),
+			pool.blocks.end());
+	}
+
+	void MemoryAllocator::destroy()
+	{
+		for (Pool& pool : pools)
+		{
+			for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+			{
+				if (debug && block->allocationCount > 0)
+				{
+					std::cout << "Memory block still has " << block->allocationCount << " live allocations\n";
+				}
+
+				if (block->mappedData)
+				{
+					device.unmapMemory(block->memory);
+				}
+
+				device.freeMemory(block->memory);
+			}
+		}
+
+		pools.clear();
+	}
+
+	AllocatorStats MemoryAllocator::get_stats() const
+	{
+		AllocatorStats stats;
+
+		vk::DeviceSize totalFree = 0;
+		vk::DeviceSize largestFree = 0;
+
+		for (const Pool& pool : pools)
+		{
+			for (const std::unique_ptr<MemoryBlock>& block : pool.blocks)
+			{
+				stats.bytesUsed += block->bytesUsed;
+				stats.bytesReserved += block->size;
+				stats.blockCount++;
+				stats.allocationCount += block->allocationCount;
+
+				if (pool.strategy == AllocationStrategy::LINEAR)
+				{
+					vk::DeviceSize tail = block->size - block->head;
+					totalFree += tail;
+					largestFree = std::max(largestFree, tail);
+				}
+				else
+				{
+					for (const FreeRange& range : block->freeRanges)
+					{
+						totalFree += range.size;
+						largestFree = std::max(largestFree, range.size);
+					}
+				}
+			}
+		}
+
+		if (totalFree > 0)
+		{
+			stats.fragmentation = 1.0f - static_cast<float>(largestFree) / static_cast<float>(totalFree);
+		}
+
+		return stats;
+	}
+}
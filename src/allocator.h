@@ -0,0 +1,120 @@
+#pragma once
+
+#include "config.h"
+#include <memory>
+
+namespace vkUtil
+{
+	enum class AllocationStrategy
+	{
+		// Bump allocation, a block is recycled once everything in it is freed
+		// Good for short-lived allocations like staging buffers
+		LINEAR,
+
+		// First fit over a sorted free list, with neighbouring ranges merged on free
+		FREE_LIST
+	};
+
+	// Buffers and optimally tiled images are kept in separate blocks,
+	// so we never have to worry about bufferImageGranularity
+	enum class ResourceKind
+	{
+		BUFFER,
+		IMAGE
+	};
+
+	struct MemoryBlock;
+
+	struct Allocation
+	{
+		vk::DeviceMemory memory;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+
+		// Host visible blocks stay mapped, so this points straight at the allocation
+		void* mappedData = nullptr;
+
+		MemoryBlock* block = nullptr;
+	};
+
+	struct AllocatorStats
+	{
+		vk::DeviceSize bytesUsed = 0;
+		vk::DeviceSize bytesReserved = 0;
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+
+		// 1 - (largest free range / total free bytes)
+		// 0 means all free memory is contiguous
+		float fragmentation = 0.0f;
+	};
+
+	struct FreeRange
+	{
+		vk::DeviceSize offset;
+		vk::DeviceSize size;
+	};
+
+	struct MemoryBlock
+	{
+		vk::DeviceMemory memory;
+		vk::DeviceSize size = 0;
+		void* mappedData = nullptr;
+		uint32_t poolIdx = 0;
+
+		vk::DeviceSize bytesUsed = 0;
+		uint32_t allocationCount = 0;
+
+		// FREE_LIST: free ranges sorted by offset
+		std::vector<FreeRange> freeRanges;
+
+		// LINEAR: everything past the head is free
+		vk::DeviceSize head = 0;
+	};
+
+	// Sub-allocates buffers and images out of large vk::DeviceMemory blocks,
+	// with one set of blocks per (memory type, strategy, resource kind)
+	class MemoryAllocator
+	{
+	public:
+		static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ULL * 1024 * 1024;
+
+		void init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice, bool debug);
+
+		Allocation allocate(const vk::MemoryRequirements& requirements,
+			vk::MemoryPropertyFlags properties,
+			AllocationStrategy strategy = AllocationStrategy::FREE_LIST,
+			ResourceKind kind = ResourceKind::BUFFER);
+
+		void free(Allocation& allocation);
+
+		// Frees every block, all allocations must have been freed beforehand
+		void destroy();
+
+		AllocatorStats get_stats() const;
+
+	private:
+		struct Pool
+		{
+			uint32_t memoryTypeIdx;
+			AllocationStrategy strategy;
+			ResourceKind kind;
+			bool hostVisible;
+			vk::DeviceSize blockSize;
+			std::vector<std::unique_ptr<MemoryBlock>> blocks;
+		};
+
+		vk::Device device;
+		vk::PhysicalDevice physicalDevice;
+		vk::PhysicalDeviceMemoryProperties memoryProperties;
+		bool debug = false;
+
+		std::vector<Pool> pools;
+
+		Pool& get_pool(uint32_t memoryTypeIdx, AllocationStrategy strategy, ResourceKind kind);
+		MemoryBlock* make_block(Pool& pool, uint32_t poolIdx, vk::DeviceSize size);
+		bool try_allocate(MemoryBlock& block, AllocationStrategy strategy,
+			vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+		void release_block(Pool& pool, MemoryBlock* block);
+	};
+}
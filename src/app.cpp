@@ -1,13 +1,26 @@
 #include "app.h"
 
-App::App(int width, int height, bool debug)
+App::App(int width, int height, bool debug, const EngineSettings& settings)
 {
+	headless = false;
+	headlessFrameCount = 0;
+
 	build_glfw_window(width, height, debug);
 	
-	graphicsEngine = new Engine(width, height, window, appName, debug);
+	graphicsEngine = new Engine(width, height, window, appName, debug, settings);
 
 }
 
+App::App(int width, int height, bool debug, uint32_t headlessFrameCount,
+	const EngineSettings& settings)
+{
+	headless = true;
+	this->headlessFrameCount = headlessFrameCount;
+	window = nullptr;
+
+	graphicsEngine = new Engine(width, height, appName, debug, settings);
+}
+
 
 void App::build_glfw_window(int width, int height, bool debugMode)
 {
@@ -40,9 +53,20 @@ void App::build_glfw_window(int width, int height, bool debugMode)
 
 void App::run()
 {
+	if (headless)
+	{
+		for (uint32_t ii = 0; ii < headlessFrameCount; ii++)
+		{
+			graphicsEngine->render();
+		}
+
+		return;
+	}
+
 	while (!glfwWindowShouldClose(window))
 	{
 		glfwPollEvents();
+		graphicsEngine->mark_input_sampled();
 		graphicsEngine->render();
 		calculateFrameRate();
 	}
@@ -75,6 +99,12 @@ App::~App()
 {
 	delete graphicsEngine;
 
+	// We initialized glfw, so it's ours to shut down, after the engine is done with the window
+	if (!headless)
+	{
+		glfwTerminate();
+	}
+
 	// Let engine delete the scene 
 	//delete scene;
 }
\ No newline at end of file
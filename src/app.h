@@ -11,6 +11,10 @@ private:
 	Engine* graphicsEngine;
 	GLFWwindow* window;
 
+	// headless apps render a fixed number of frames offscreen, then exit
+	bool headless;
+	uint32_t headlessFrameCount;
+
 	double lastTime, currentTime;
 	int numFrames;
 	float frameTime;
@@ -22,7 +26,9 @@ private:
 	void calculateFrameRate();
 
 public:
-	App(int width, int height, bool debug);
+	App(int width, int height, bool debug, const EngineSettings& settings = EngineSettings());
+	App(int width, int height, bool debug, uint32_t headlessFrameCount,
+		const EngineSettings& settings = EngineSettings());
 	~App();
 	void run();
 };
\ No newline at end of file
@@ -0,0 +1,665 @@
+#include "engine.h"
+#include "benchmark_report.h"
+
+#include <functional>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+// Frame-time benchmark
+// Renders a fixed number of frames for each scripted scene and reports
+// per-phase CPU frame times and per-scope GPU times (mean, p50, p95, p99, max)
+// Also times engine startup with a cold (deleted) and warm pipeline cache
+// Windowed runs can sweep present policies (--present-policy all) to compare input latency
+// Any run can sweep job system thread counts (--threads all) to see how frame work scales with cores
+//
+// Usage: benchmark [--frames N] [--warmup N] [--scene NAME] [--width W] [--height H]
+//                  [--startup-runs N] [--frames-in-flight N]
+//                  [--present-policy NAME|all] [--image-count N] [--fps-limit F] [--gpu-culling]
+//                  [--brick-cache] [--no-cone-prepass]
+//                  [--threads N|all]
+//                  [--window] [--debug] [--csv FILE] [--json FILE]
+
+
+struct BenchmarkOptions
+{
+	uint32_t frames = 1000;
+	uint32_t warmup = 60;
+	std::string scene = "all";
+	uint32_t startupRuns = 5;
+	uint32_t framesInFlight = EngineSettings().framesInFlight;
+	std::vector<PresentPolicy> presentPolicies = { EngineSettings().presentPolicy };
+	uint32_t imageCount = 0;
+	double fpsLimit = 0.0;
+	bool gpuCulling = EngineSettings().gpuCulling;
+	bool brickCache = RaymarchSettings().brickCache;
+	bool conePrepass = RaymarchSettings().conePrepass;
+	std::vector<uint32_t> workerThreads = { EngineSettings().workerThreads };
+	int width = 1280;
+	int height = 720;
+	bool windowed = false;
+	bool debug = false;
+	std::string csvFile;
+	std::string jsonFile;
+};
+
+struct BenchmarkScene
+{
+	std::string name;
+
+	// Builds the scene's entities
+	std::function<void(Scene*)> setup;
+
+	// Scripted per-frame changes (optional)
+	std::function<void(Scene*, uint32_t)> update;
+};
+
+
+static void add_triangle_grid(Scene* scene, uint32_t count)
+{
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+
+	for (uint32_t ii = 0; ii < count; ii++)
+	{
+		Entity entity = scene->AddEntity("ID: Triangle " + std::to_string(ii), TRIANGLE);
+
+		float x = (static_cast<float>(ii % side) / side) * 2.0f - 1.0f;
+		float y = (static_cast<float>(ii / side) / side) * 2.0f - 1.0f;
+		scene->GetTransform(entity).SetPosition(x, y, 0.0f);
+	}
+}
+
+// Chains of joints, each parented to the one before, rooted on a grid
+// Returns the root joint of every arm
+static std::vector<Entity> add_articulated_arms(Scene* scene, uint32_t armCount, uint32_t jointCount)
+{
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(armCount))));
+
+	std::vector<Entity> roots;
+	roots.reserve(armCount);
+
+	for (uint32_t arm = 0; arm < armCount; arm++)
+	{
+		Entity parent;
+
+		for (uint32_t joint = 0; joint < jointCount; joint++)
+		{
+			Entity entity = scene->AddEntity(
+				"ID: Arm " + std::to_string(arm) + " Joint " + std::to_string(joint), TRIANGLE);
+
+			Transform& transform = scene->GetTransform(entity);
+
+			if (joint > 0)
+			{
+				scene->SetParent(entity, parent);
+				transform.SetPosition(0.0f, 0.5f / jointCount, 0.0f);
+				transform.SetEulerRotation(0.0f, 0.0f, 0.01f);
+			}
+			else
+			{
+				float x = (static_cast<float>(arm % side) / side) * 2.0f - 1.0f;
+				float y = (static_cast<float>(arm / side) / side) * 2.0f - 1.0f;
+				transform.SetPosition(x, y, 0.0f);
+
+				roots.push_back(entity);
+			}
+
+			parent = entity;
+		}
+	}
+
+	return roots;
+}
+
+// Small spheres and rounded boxes filling a block in front of the raymarch camera
+static void add_shape_field(Scene* scene, uint32_t count)
+{
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(count))));
+	float size = 0.4f / side;
+
+	for (uint32_t ii = 0; ii < count; ii++)
+	{
+		Shape shape = (ii % 2 == 0)
+			? Shape{ SHAPE_SPHERE, glm::vec4(size, 0.0f, 0.0f, 0.0f) }
+			: Shape{ SHAPE_ROUND_BOX, glm::vec4(size, size, size, 0.2f * size) };
+
+		Entity entity = scene->AddShape("ID: Shape " + std::to_string(ii), shape);
+
+		float x = (static_cast<float>(ii % side) / side) * 2.0f - 1.0f;
+		float y = (static_cast<float>((ii / side) % side) / side) * 2.0f - 1.0f;
+		float z = -2.0f - (static_cast<float>(ii / (side * side)) / side) * 2.0f;
+		scene->GetTransform(entity).SetPosition(x, y, z);
+	}
+}
+
+static std::vector<BenchmarkScene> make_scenes()
+{
+	std::vector<BenchmarkScene> scenes;
+
+	scenes.push_back({
+		"fullscreen",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+		},
+		nullptr
+	});
+
+	scenes.push_back({
+		"triangles_static",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 1000);
+		},
+		nullptr
+	});
+
+	scenes.push_back({
+		"triangles_100k",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 100000);
+		},
+		nullptr
+	});
+
+	// Compare with --gpu-culling: it records the same commands at any instance count
+	scenes.push_back({
+		"triangles_1m",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 1000000);
+		},
+		nullptr
+	});
+
+	// Mostly static: 100 of the 100k triangles move each frame
+	scenes.push_back({
+		"triangles_100k_sparse",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 100000);
+		},
+		[](Scene* scene, uint32_t frame)
+		{
+			float offset = 0.001f * std::sin(static_cast<float>(frame) * 0.1f);
+			std::vector<Transform>& transforms = scene->registry.Pool<Transform>().GetComponents();
+
+			for (size_t ii = frame % 1000; ii < transforms.size(); ii += 1000)
+			{
+				transforms[ii].MoveAbs(offset, 0.0f, 0.0f);
+			}
+		}
+	});
+
+	// 1000 arms of 100 joints, every root turns each frame, so all 100k of the arms' world matrices change
+	std::shared_ptr<std::vector<Entity>> armRoots = std::make_shared<std::vector<Entity>>();
+
+	scenes.push_back({
+		"hierarchy_100k",
+		[armRoots](Scene* scene)
+		{
+			scene->InitEntities();
+			*armRoots = add_articulated_arms(scene, 1000, 100);
+		},
+		[armRoots](Scene* scene, uint32_t frame)
+		{
+			for (Entity root : *armRoots)
+			{
+				scene->GetTransform(root).RotateEuler(0.0f, 0.0f, 0.01f);
+			}
+		}
+	});
+
+	// Same arms, but only 10 of them turn each frame
+	std::shared_ptr<std::vector<Entity>> sparseArmRoots = std::make_shared<std::vector<Entity>>();
+
+	scenes.push_back({
+		"hierarchy_100k_sparse",
+		[sparseArmRoots](Scene* scene)
+		{
+			scene->InitEntities();
+			*sparseArmRoots = add_articulated_arms(scene, 1000, 100);
+		},
+		[sparseArmRoots](Scene* scene, uint32_t frame)
+		{
+			for (size_t ii = frame % 100; ii < sparseArmRoots->size(); ii += 100)
+			{
+				scene->GetTransform((*sparseArmRoots)[ii]).RotateEuler(0.0f, 0.0f, 0.01f);
+			}
+		}
+	});
+
+	scenes.push_back({
+		"triangles_animated",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 1000);
+		},
+		[](Scene* scene, uint32_t frame)
+		{
+			float offset = 0.001f * std::sin(static_cast<float>(frame) * 0.1f);
+
+			scene->registry.Each<MeshRenderer, Transform>(
+				[offset](Entity, MeshRenderer& renderer, Transform& transform)
+				{
+					if (renderer.meshType == TRIANGLE)
+					{
+						transform.MoveAbs(offset, 0.0f, 0.0f);
+					}
+				});
+		}
+	});
+
+	// One batch per triangle: 10k draws to record from the CPU, split over the job system's threads
+	scenes.push_back({
+		"materials_10k",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_triangle_grid(scene, 10000);
+
+			uint32_t material = 0;
+
+			for (MeshRenderer& renderer : scene->registry.Pool<MeshRenderer>().GetComponents())
+			{
+				renderer.material = material++;
+			}
+		},
+		nullptr
+	});
+
+	// Raymarch cost with thousands of SDF shapes, walked through their BVH
+	scenes.push_back({
+		"shapes_4k",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_shape_field(scene, 4096);
+		},
+		nullptr
+	});
+
+	// Same shapes, 1 in 16 bobbing each frame, so the BVH is refit (and now and then rebuilt)
+	scenes.push_back({
+		"shapes_4k_animated",
+		[](Scene* scene)
+		{
+			scene->InitEntities();
+			add_shape_field(scene, 4096);
+		},
+		[](Scene* scene, uint32_t frame)
+		{
+			float offset = 0.002f * std::sin(static_cast<float>(frame) * 0.1f);
+
+			scene->registry.Each<Shape, Transform>(
+				[offset, frame](Entity entity, Shape&, Transform& transform)
+				{
+					if ((entity.index + frame) % 16 == 0)
+					{
+						transform.MoveAbs(0.0f, offset, 0.0f);
+					}
+				});
+		}
+	});
+
+	return scenes;
+}
+
+
+static bool parse_options(int argc, char** argv, BenchmarkOptions& options)
+{
+	for (int ii = 1; ii < argc; ii++)
+	{
+		std::string arg = argv[ii];
+		bool hasValue = ii + 1 < argc;
+
+		if (arg == "--frames" && hasValue)
+		{
+			options.frames = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			options.warmup = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		else if (arg == "--scene" && hasValue)
+		{
+			options.scene = argv[++ii];
+		}
+		else if (arg == "--width" && hasValue)
+		{
+			options.width = std::stoi(argv[++ii]);
+		}
+		else if (arg == "--height" && hasValue)
+		{
+			options.height = std::stoi(argv[++ii]);
+		}
+		else if (arg == "--startup-runs" && hasValue)
+		{
+			options.startupRuns = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		else if (arg == "--frames-in-flight" && hasValue)
+		{
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		else if (arg == "--present-policy" && hasValue)
+		{
+			std::string name = argv[++ii];
+			options.presentPolicies.clear();
+
+			for (size_t policy = 0; policy < PRESENT_POLICY_COUNT; policy++)
+			{
+				if (name == "all" || name == present_policy_name(static_cast<PresentPolicy>(policy)))
+				{
+					options.presentPolicies.push_back(static_cast<PresentPolicy>(policy));
+				}
+			}
+
+			if (options.presentPolicies.empty())
+			{
+				std::cerr << "Unknown present policy \"" << name << "\"\n";
+				return false;
+			}
+		}
+		else if (arg == "--image-count" && hasValue)
+		{
+			options.imageCount = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		else if (arg == "--fps-limit" && hasValue)
+		{
+			options.fpsLimit = std::stod(argv[++ii]);
+		}
+		else if (arg == "--csv" && hasValue)
+		{
+			options.csvFile = argv[++ii];
+		}
+		else if (arg == "--json" && hasValue)
+		{
+			options.jsonFile = argv[++ii];
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			std::string count = argv[++ii];
+			options.workerThreads.clear();
+
+			if (count == "all")
+			{
+				uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+				for (uint32_t threads = 1; threads < hardwareThreads; threads *= 2)
+				{
+					options.workerThreads.push_back(threads);
+				}
+
+				options.workerThreads.push_back(hardwareThreads);
+			}
+			else
+			{
+				options.workerThreads.push_back(static_cast<uint32_t>(std::stoul(count)));
+			}
+		}
+		else if (arg == "--gpu-culling")
+		{
+			options.gpuCulling = true;
+		}
+		else if (arg == "--brick-cache")
+		{
+			options.brickCache = true;
+		}
+		else if (arg == "--no-cone-prepass")
+		{
+			options.conePrepass = false;
+		}
+		else if (arg == "--window")
+		{
+			options.windowed = true;
+		}
+		else if (arg == "--debug")
+		{
+			options.debug = true;
+		}
+		else
+		{
+			std::cerr << "Unknown or incomplete argument \"" << arg << "\"\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+static GLFWwindow* make_window(const BenchmarkOptions& options)
+{
+	glfwInit();
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+	return glfwCreateWindow(options.width, options.height, "Benchmark", nullptr, nullptr);
+}
+
+
+static Engine* make_engine(GLFWwindow* window, const BenchmarkOptions& options, const EngineSettings& settings)
+{
+	if (window)
+	{
+		return new Engine(options.width, options.height, window, "Benchmark", options.debug, settings);
+	}
+
+	return new Engine(options.width, options.height, "Benchmark", options.debug, settings);
+}
+
+
+static void add_startup_samples(vkBench::SceneResult& result, const vkUtil::StartupTimings& timings)
+{
+	result.frameCount++;
+	result.add_sample("total", timings.totalMs);
+	result.add_sample("pipelines", timings.pipelineMs);
+}
+
+
+// The first run starts without a cache file, every later one loads what the previous run saved
+static void run_startup(GLFWwindow* window, const BenchmarkOptions& options, vkBench::Report& report)
+{
+	EngineSettings settings;
+	settings.pipelineCacheFile = "benchmark_pipeline_cache.bin";
+	settings.framesInFlight = options.framesInFlight;
+	settings.gpuCulling = options.gpuCulling;
+
+	std::error_code error;
+	std::filesystem::remove(settings.pipelineCacheFile, error);
+
+	vkBench::SceneResult cold;
+	cold.name = "startup_cold";
+
+	vkBench::SceneResult warm;
+	warm.name = "startup_warm";
+
+	for (uint32_t run = 0; run < options.startupRuns; run++)
+	{
+		Engine* engine = make_engine(window, options, settings);
+		vkUtil::StartupTimings timings = engine->get_startup_timings();
+		delete engine;
+
+		add_startup_samples(timings.pipelineCacheLoaded ? warm : cold, timings);
+	}
+
+	for (vkBench::SceneResult* result : { &cold, &warm })
+	{
+		if (result->frameCount > 0)
+		{
+			report.scenes.push_back(*result);
+		}
+	}
+}
+
+
+static vkBench::SceneResult run_scene(Engine* engine, GLFWwindow* window,
+	const BenchmarkScene& benchmarkScene, const BenchmarkOptions& options)
+{
+	Scene* scene = engine->get_scene();
+	scene->ClearEntities();
+	benchmarkScene.setup(scene);
+
+	vkBench::SceneResult result;
+	result.name = benchmarkScene.name;
+	result.frameCount = options.frames;
+
+	for (uint32_t frame = 0; frame < options.warmup + options.frames; frame++)
+	{
+		if (window)
+		{
+			glfwPollEvents();
+		}
+
+		if (benchmarkScene.update)
+		{
+			benchmarkScene.update(scene, frame);
+		}
+
+		// the scripted update stands in for input
+		engine->mark_input_sampled();
+		engine->render();
+
+		if (frame < options.warmup)
+		{
+			continue;
+		}
+
+		const vkUtil::FrameTimings& timings = engine->get_frame_timings();
+
+		for (size_t ii = 0; ii < vkUtil::FRAME_PHASE_COUNT; ii++)
+		{
+			vkUtil::FramePhase phase = static_cast<vkUtil::FramePhase>(ii);
+			result.add_sample(vkUtil::frame_phase_name(phase), timings[phase]);
+		}
+
+		result.add_sample("total", timings.totalMs);
+
+		// GPU results lag a few frames behind, so they're sampled whenever they arrive
+		for (const vkUtil::GpuScopeTiming& gpuTiming : engine->get_gpu_timings())
+		{
+			result.add_sample("gpu_" + gpuTiming.name, gpuTiming.ms);
+		}
+
+		// Job system counters cover everything since the previous frame
+		// Idle time is summed over the threads, so it isn't a frame time either
+		const vkUtil::JobStats& jobStats = engine->get_job_stats();
+		result.add_counter("job_steals", "jobs", static_cast<double>(jobStats.steals));
+		result.add_counter("job_idle", "thread_ms", jobStats.idleMs);
+		result.add_counter("job_queue_peak", "jobs", static_cast<double>(jobStats.peakQueueDepth));
+
+		// Same for latencies, which are known once a frame's GPU work has completed
+		for (double latency : engine->get_completed_latencies())
+		{
+			result.add_sample("input_latency", latency);
+		}
+	}
+
+	return result;
+}
+
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+
+	if (!parse_options(argc, argv, options))
+	{
+		return 1;
+	}
+
+	GLFWwindow* window = options.windowed ? make_window(options) : nullptr;
+
+	vkBench::Report report;
+	report.mode = options.windowed ? "windowed" : "headless";
+	report.width = static_cast<uint32_t>(options.width);
+	report.height = static_cast<uint32_t>(options.height);
+	report.framesInFlight = options.framesInFlight;
+
+	run_startup(window, options, report);
+	size_t startupSceneCount = report.scenes.size();
+
+	EngineSettings settings;
+	settings.framesInFlight = options.framesInFlight;
+	settings.swapchainImageCount = options.imageCount;
+	settings.frameRateLimit = options.fpsLimit;
+	settings.gpuCulling = options.gpuCulling;
+	settings.raymarch.brickCache = options.brickCache;
+	settings.raymarch.conePrepass = options.conePrepass;
+
+	// Headless frames are never presented, so there's nothing to sweep
+	if (!options.windowed)
+	{
+		options.presentPolicies.resize(1);
+	}
+
+	// The job system is set up with the engine, so each thread count gets an engine of its own
+	for (uint32_t workerThreads : options.workerThreads)
+	{
+		settings.workerThreads = workerThreads;
+
+		Engine* engine = make_engine(window, options, settings);
+
+		for (PresentPolicy policy : options.presentPolicies)
+		{
+			engine->set_present_policy(policy);
+
+			for (const BenchmarkScene& scene : make_scenes())
+			{
+				if (options.scene != "all" && options.scene != scene.name)
+				{
+					continue;
+				}
+
+				vkBench::SceneResult result = run_scene(engine, window, scene, options);
+
+				if (options.windowed)
+				{
+					result.name += std::string(" @") + present_policy_name(policy);
+				}
+
+				if (options.workerThreads.size() > 1)
+				{
+					result.name += " @" + std::to_string(workerThreads) + "t";
+				}
+
+				report.scenes.push_back(result);
+			}
+		}
+
+		delete engine;
+	}
+
+	// Every engine borrowed the one window, glfw goes once they're all gone
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+
+	if (report.scenes.size() == startupSceneCount)
+	{
+		std::cerr << "No scene named \"" << options.scene << "\"\n";
+		return 1;
+	}
+
+	vkBench::print_report(report, std::cout);
+
+	if (!options.csvFile.empty() && !vkBench::write_csv(report, options.csvFile))
+	{
+		std::cerr << "Failed to write \"" << options.csvFile << "\"\n";
+	}
+
+	if (!options.jsonFile.empty() && !vkBench::write_json(report, options.jsonFile))
+	{
+		std::cerr << "Failed to write \"" << options.jsonFile << "\"\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,221 @@
+#include "benchmark_report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+namespace vkBench
+{
+	static void add_to_series(std::vector<Series>& series, const std::string& name, const std::string& unit, double value)
+	{
+		for (Series& s : series)
+		{
+			if (s.name == name)
+			{
+				s.samples.push_back(value);
+				return;
+			}
+		}
+
+		series.push_back(Series{ name, unit, { value } });
+	}
+
+	void SceneResult::add_sample(const std::string& seriesName, double ms)
+	{
+		add_to_series(series, seriesName, "ms", ms);
+	}
+
+	void SceneResult::add_counter(const std::string& counterName, const std::string& unit, double value)
+	{
+		add_to_series(counters, counterName, unit, value);
+	}
+
+	// Nearest-rank percentile of sorted samples
+	static double percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+		rank = std::clamp(rank, static_cast<size_t>(1), sorted.size());
+
+		return sorted[rank - 1];
+	}
+
+	Stats compute_stats(std::vector<double> samples)
+	{
+		Stats stats;
+
+		if (samples.empty())
+		{
+			return stats;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		stats.p50 = percentile(samples, 50.0);
+		stats.p95 = percentile(samples, 95.0);
+		stats.p99 = percentile(samples, 99.0);
+		stats.max = samples.back();
+
+		return stats;
+	}
+
+	void print_report(const Report& report, std::ostream& out)
+	{
+		out << "Benchmark (" << report.mode << ", " << report.width << "x" << report.height
+			<< ", " << report.framesInFlight << " frames in flight)\n";
+
+		for (const SceneResult& scene : report.scenes)
+		{
+			out << "\nScene \"" << scene.name << "\", " << scene.frameCount << " frames\n";
+			out << std::left << std::setw(24) << "series (ms)"
+				<< std::right << std::setw(10) << "mean"
+				<< std::setw(10) << "p50"
+				<< std::setw(10) << "p95"
+				<< std::setw(10) << "p99"
+				<< std::setw(10) << "max" << "\n";
+
+			for (const Series& series : scene.series)
+			{
+				Stats stats = compute_stats(series.samples);
+
+				out << std::left << std::setw(24) << series.name
+					<< std::right << std::fixed << std::setprecision(3)
+					<< std::setw(10) << stats.mean
+					<< std::setw(10) << stats.p50
+					<< std::setw(10) << stats.p95
+					<< std::setw(10) << stats.p99
+					<< std::setw(10) << stats.max << "\n";
+			}
+
+			if (scene.counters.empty())
+			{
+				continue;
+			}
+
+			out << std::left << std::setw(24) << "counter"
+				<< std::setw(12) << "unit"
+				<< std::right << std::setw(10) << "mean"
+				<< std::setw(10) << "p50"
+				<< std::setw(10) << "p95"
+				<< std::setw(10) << "p99"
+				<< std::setw(10) << "max" << "\n";
+
+			for (const Series& counter : scene.counters)
+			{
+				Stats stats = compute_stats(counter.samples);
+
+				out << std::left << std::setw(24) << counter.name
+					<< std::setw(12) << counter.unit
+					<< std::right << std::fixed << std::setprecision(3)
+					<< std::setw(10) << stats.mean
+					<< std::setw(10) << stats.p50
+					<< std::setw(10) << stats.p95
+					<< std::setw(10) << stats.p99
+					<< std::setw(10) << stats.max << "\n";
+			}
+		}
+	}
+
+	bool write_csv(const Report& report, const std::string& filename)
+	{
+		std::ofstream file(filename);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		// Timings and counters share the table, the unit column tells them apart
+		file << "mode,width,height,frames_in_flight,scene,frames,series,unit,mean,p50,p95,p99,max\n";
+		file << std::fixed << std::setprecision(6);
+
+		for (const SceneResult& scene : report.scenes)
+		{
+			for (const std::vector<Series>* seriesList : { &scene.series, &scene.counters })
+			{
+				for (const Series& series : *seriesList)
+				{
+					Stats stats = compute_stats(series.samples);
+
+					file << report.mode << "," << report.width << "," << report.height << ","
+						<< report.framesInFlight << "," << scene.name << "," << scene.frameCount << ","
+						<< series.name << "," << series.unit << ","
+						<< stats.mean << "," << stats.p50 << "," << stats.p95 << ","
+						<< stats.p99 << "," << stats.max << "\n";
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool write_json(const Report& report, const std::string& filename)
+	{
+		std::ofstream file(filename);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		// Scene and series names are plain identifiers, so no escaping is needed
+		file << std::fixed << std::setprecision(6);
+		file << "{\n";
+		file << "  \"mode\": \"" << report.mode << "\",\n";
+		file << "  \"width\": " << report.width << ",\n";
+		file << "  \"height\": " << report.height << ",\n";
+		file << "  \"framesInFlight\": " << report.framesInFlight << ",\n";
+		file << "  \"scenes\": [\n";
+
+		for (size_t ii = 0; ii < report.scenes.size(); ii++)
+		{
+			const SceneResult& scene = report.scenes[ii];
+
+			file << "    {\n";
+			file << "      \"name\": \"" << scene.name << "\",\n";
+			file << "      \"frames\": " << scene.frameCount << ",\n";
+			file << "      \"series\": {\n";
+
+			for (size_t jj = 0; jj < scene.series.size(); jj++)
+			{
+				const Series& series = scene.series[jj];
+				Stats stats = compute_stats(series.samples);
+
+				file << "        \"" << series.name << "\": { "
+					<< "\"mean_ms\": " << stats.mean << ", "
+					<< "\"p50_ms\": " << stats.p50 << ", "
+					<< "\"p95_ms\": " << stats.p95 << ", "
+					<< "\"p99_ms\": " << stats.p99 << ", "
+					<< "\"max_ms\": " << stats.max << " }"
+					<< (jj + 1 < scene.series.size() ? "," : "") << "\n";
+			}
+
+			file << "      },\n";
+			file << "      \"counters\": {\n";
+
+			for (size_t jj = 0; jj < scene.counters.size(); jj++)
+			{
+				const Series& counter = scene.counters[jj];
+				Stats stats = compute_stats(counter.samples);
+
+				file << "        \"" << counter.name << "\": { "
+					<< "\"unit\": \"" << counter.unit << "\", "
+					<< "\"mean\": " << stats.mean << ", "
+					<< "\"p50\": " << stats.p50 << ", "
+					<< "\"p95\": " << stats.p95 << ", "
+					<< "\"p99\": " << stats.p99 << ", "
+					<< "\"max\": " << stats.max << " }"
+					<< (jj + 1 < scene.counters.size() ? "," : "") << "\n";
+			}
+
+			file << "      }\n";
+			file << "    }" << (ii + 1 < report.scenes.size() ? "," : "") << "\n";
+		}
+
+		file << "  ]\n";
+		file << "}\n";
+
+		return true;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "config.h"
+
+namespace vkBench
+{
+	struct Stats
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	// Per-frame samples of one measured quantity, e.g. a CPU frame phase (ms) or a job system counter
+	struct Series
+	{
+		std::string name;
+		std::string unit;
+		std::vector<double> samples;
+	};
+
+	struct SceneResult
+	{
+		std::string name;
+		uint32_t frameCount = 0;
+
+		// Timings (ms), kept in insertion order, so reports list phases in frame order
+		std::vector<Series> series;
+
+		// Everything that isn't a timing, reported apart so its stats aren't labelled as ms
+		std::vector<Series> counters;
+
+		void add_sample(const std::string& seriesName, double ms);
+		void add_counter(const std::string& counterName, const std::string& unit, double value);
+	};
+
+	struct Report
+	{
+		std::string mode;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t framesInFlight = 0;
+		std::vector<SceneResult> scenes;
+	};
+
+	Stats compute_stats(std::vector<double> samples);
+
+	void print_report(const Report& report, std::ostream& out);
+
+	// One row per (scene, series or counter) with its unit and mean/p50/p95/p99/max
+	bool write_csv(const Report& report, const std::string& filename);
+
+	bool write_json(const Report& report, const std::string& filename);
+}
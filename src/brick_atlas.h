@@ -0,0 +1,111 @@
+#pragma once
+
+#include "config.h"
+#include "frame.h"
+
+
+namespace vkInit
+{
+	// Half floats are plenty for distances clamped to the band, and half the size of R32
+	const vk::Format brickAtlasFormat = vk::Format::eR16Sfloat;
+
+
+	/// <summary>
+	/// Makes the 3D image the brick map's distance samples are baked into, with a trilinear sampler to read them.
+	/// The image is made even when the device can't bake into it, so the raymarch set always has something bound
+	/// </summary>
+	/// <param name="writable">Whether the bake pass will write it (DeviceCapabilities::brickCache)</param>
+	vkUtil::BrickAtlas make_brick_atlas(vk::Device logicalDevice, vkUtil::MemoryAllocator& allocator,
+		bool writable, bool debug)
+	{
+		uint32_t texels = vkUtil::BRICK_ATLAS_BRICKS * vkUtil::BRICK_SAMPLES;
+
+		vkUtil::BrickAtlas atlas{};
+
+		// Image
+		vk::ImageCreateInfo imageInfo = {};
+		imageInfo.imageType = vk::ImageType::e3D;
+		imageInfo.format = brickAtlasFormat;
+		imageInfo.extent = vk::Extent3D{ texels, texels, texels };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = vk::SampleCountFlagBits::e1;
+		imageInfo.tiling = vk::ImageTiling::eOptimal;
+		imageInfo.usage = vk::ImageUsageFlagBits::eSampled;
+
+		if (writable)
+		{
+			imageInfo.usage |= vk::ImageUsageFlagBits::eStorage;
+		}
+
+		imageInfo.sharingMode = vk::SharingMode::eExclusive;
+		imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+		try
+		{
+			atlas.image = logicalDevice.createImage(imageInfo);
+		}
+		catch (vk::SystemError err)
+		{
+			throw std::runtime_error("Failed to create brick atlas :/\n");
+		}
+
+		// Memory
+		vk::MemoryRequirements requirements = logicalDevice.getImageMemoryRequirements(atlas.image);
+
+		atlas.allocation = allocator.allocate(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+			vkUtil::AllocationStrategy::FREE_LIST, vkUtil::ResourceKind::IMAGE);
+
+		logicalDevice.bindImageMemory(atlas.image, atlas.allocation.memory, atlas.allocation.offset);
+
+		// Image view
+		vk::ImageViewCreateInfo viewInfo = {};
+		viewInfo.image = atlas.image;
+		viewInfo.viewType = vk::ImageViewType::e3D;
+		viewInfo.format = brickAtlasFormat;
+
+		viewInfo.components.r = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.g = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.b = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.a = vk::ComponentSwizzle::eIdentity;
+
+		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		atlas.view = logicalDevice.createImageView(viewInfo);
+
+		// Sampler
+		// Clamped so lookups at a slot's border never reach past the atlas,
+		// the shader keeps them inside the slot's samples
+		vk::SamplerCreateInfo samplerInfo = {};
+		samplerInfo.magFilter = vk::Filter::eLinear;
+		samplerInfo.minFilter = vk::Filter::eLinear;
+		samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+		samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+		samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+		samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+		samplerInfo.maxLod = 0.0f;
+		samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+		atlas.sampler = logicalDevice.createSampler(samplerInfo);
+
+		if (debug)
+		{
+			std::cout << "Created brick atlas (" << texels << "^3 samples, "
+				<< vkUtil::BRICK_ATLAS_CAPACITY << " bricks)\n";
+		}
+
+		return atlas;
+	}
+
+	void destroy_brick_atlas(vk::Device logicalDevice, vkUtil::MemoryAllocator& allocator, vkUtil::BrickAtlas& atlas)
+	{
+		logicalDevice.destroySampler(atlas.sampler);
+		logicalDevice.destroyImageView(atlas.view);
+		logicalDevice.destroyImage(atlas.image);
+		allocator.free(atlas.allocation);
+	}
+}
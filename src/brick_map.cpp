@@ -0,0 +1,233 @@
+#include "brick_map.h"
+
+#include <algorithm>
+
+namespace vkUtil
+{
+	constexpr uint32_t BRICK_COUNT = BRICK_GRID_SIZE * BRICK_GRID_SIZE * BRICK_GRID_SIZE;
+
+	// Queues every brick the box touches for an update
+	static void mark_bricks(BrickMap& map, glm::vec3 boundsMin, glm::vec3 boundsMax)
+	{
+		int first[3];
+		int last[3];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float low = (boundsMin[axis] - map.volumeMin[axis]) / map.brickSize;
+			float high = (boundsMax[axis] - map.volumeMin[axis]) / map.brickSize;
+
+			first[axis] = std::clamp(static_cast<int>(std::floor(low)), 0, static_cast<int>(BRICK_GRID_SIZE) - 1);
+			last[axis] = std::clamp(static_cast<int>(std::floor(high)), 0, static_cast<int>(BRICK_GRID_SIZE) - 1);
+		}
+
+		for (int z = first[2]; z <= last[2]; z++)
+		{
+			for (int y = first[1]; y <= last[1]; y++)
+			{
+				for (int x = first[0]; x <= last[0]; x++)
+				{
+					uint32_t brick = (z * BRICK_GRID_SIZE + y) * BRICK_GRID_SIZE + x;
+
+					if (!map.dirtyFlags[brick])
+					{
+						map.dirtyFlags[brick] = 1;
+						map.dirtyBricks.push_back(brick);
+					}
+				}
+			}
+		}
+	}
+
+	// Bounds of the shape grown by the stored band, the bricks whose distances it affects
+	static void band_bounds(const ShapeTable& table, size_t shapeIndex, float band,
+		glm::vec3& boundsMin, glm::vec3& boundsMax)
+	{
+		glm::vec3 halfExtents = shape_half_extents(table.sources[shapeIndex]) + glm::vec3(band);
+
+		boundsMin = table.shapes[shapeIndex].center - halfExtents;
+		boundsMax = table.shapes[shapeIndex].center + halfExtents;
+	}
+
+	static bool inside_volume(const BrickMap& map, glm::vec3 boundsMin, glm::vec3 boundsMax)
+	{
+		glm::vec3 volumeMax = map.volumeMin + glm::vec3(map.brickSize * BRICK_GRID_SIZE);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (boundsMin[axis] < map.volumeMin[axis] || boundsMax[axis] > volumeMax[axis])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Fits the volume around the shapes, frees every slot and queues every brick near a shape
+	static void lay_out(const ShapeTable& table, const ShapeBvh& bvh, BrickMap& map)
+	{
+		size_t shapeCount = table.shapes.size();
+
+		map.slots.assign(BRICK_COUNT, BRICK_EMPTY);
+
+		// handed out from the back, lowest slot first
+		map.freeSlots.resize(BRICK_ATLAS_CAPACITY);
+
+		for (uint32_t ii = 0; ii < BRICK_ATLAS_CAPACITY; ii++)
+		{
+			map.freeSlots[ii] = BRICK_ATLAS_CAPACITY - 1 - ii;
+		}
+
+		map.dirtyFlags.assign(BRICK_COUNT, 0);
+		map.dirtyBricks.clear();
+		map.overflowed = false;
+		map.revision++;
+
+		map.shapeRevisions.resize(shapeCount);
+		map.shapeMin.resize(shapeCount);
+		map.shapeMax.resize(shapeCount);
+
+		if (shapeCount == 0)
+		{
+			map.brickSize = 1.0f;
+			map.volumeMin = glm::vec3(-0.5f * BRICK_GRID_SIZE);
+			return;
+		}
+
+		// Cubic bricks, the longest side of the shapes' bounds spans all but the margin
+		const SdfBvhNode& root = bvh.nodes[0];
+		glm::vec3 extent = root.boundsMax - root.boundsMin;
+		float size = std::max({ extent.x, extent.y, extent.z, 0.001f });
+
+		map.brickSize = size / (BRICK_GRID_SIZE - 2 * BRICK_VOLUME_MARGIN);
+		map.volumeMin = 0.5f * (root.boundsMin + root.boundsMax) - glm::vec3(0.5f * BRICK_GRID_SIZE * map.brickSize);
+
+		for (size_t ii = 0; ii < shapeCount; ii++)
+		{
+			band_bounds(table, ii, BRICK_BAND * map.brickSize, map.shapeMin[ii], map.shapeMax[ii]);
+			map.shapeRevisions[ii] = table.revisions[ii];
+
+			mark_bricks(map, map.shapeMin[ii], map.shapeMax[ii]);
+		}
+	}
+
+	size_t update_brick_map(const ShapeTable& table, const ShapeBvh& bvh, BrickMap& map)
+	{
+		map.bakeJobs.clear();
+
+		size_t shapeCount = table.shapes.size();
+		bool layOut = map.brickSize == 0.0f || map.shapeRevisions.size() != shapeCount;
+
+		if (!layOut && map.overflowed)
+		{
+			return 0;
+		}
+
+		if (!layOut)
+		{
+			for (size_t ii = 0; ii < shapeCount; ii++)
+			{
+				if (map.shapeRevisions[ii] == table.revisions[ii])
+				{
+					continue;
+				}
+
+				glm::vec3 boundsMin;
+				glm::vec3 boundsMax;
+				band_bounds(table, ii, BRICK_BAND * map.brickSize, boundsMin, boundsMax);
+
+				if (!inside_volume(map, boundsMin, boundsMax))
+				{
+					layOut = true;
+					break;
+				}
+
+				// Both where the shape was and where it is now
+				mark_bricks(map, map.shapeMin[ii], map.shapeMax[ii]);
+				mark_bricks(map, boundsMin, boundsMax);
+
+				map.shapeMin[ii] = boundsMin;
+				map.shapeMax[ii] = boundsMax;
+				map.shapeRevisions[ii] = table.revisions[ii];
+			}
+		}
+
+		if (layOut)
+		{
+			lay_out(table, bvh, map);
+		}
+
+		bool slotsChanged = false;
+
+		for (uint32_t brick : map.dirtyBricks)
+		{
+			map.dirtyFlags[brick] = 0;
+
+			uint32_t x = brick % BRICK_GRID_SIZE;
+			uint32_t y = (brick / BRICK_GRID_SIZE) % BRICK_GRID_SIZE;
+			uint32_t z = brick / (BRICK_GRID_SIZE * BRICK_GRID_SIZE);
+
+			glm::vec3 brickMin = map.volumeMin + glm::vec3(x, y, z) * map.brickSize;
+			glm::vec3 brickMax = brickMin + glm::vec3(map.brickSize);
+
+			uint32_t& slot = map.slots[brick];
+
+			// Nothing within the band anymore, the brick is empty
+			if (!bvh_overlaps(bvh, brickMin, brickMax, BRICK_BAND * map.brickSize))
+			{
+				if (slot != BRICK_EMPTY)
+				{
+					map.freeSlots.push_back(slot);
+					slot = BRICK_EMPTY;
+					slotsChanged = true;
+				}
+
+				continue;
+			}
+
+			if (slot == BRICK_EMPTY)
+			{
+				if (map.freeSlots.empty())
+				{
+					map.overflowed = true;
+					continue;
+				}
+
+				slot = map.freeSlots.back();
+				map.freeSlots.pop_back();
+				slotsChanged = true;
+			}
+
+			map.bakeJobs.push_back(BrickBakeJob{ x, y, z, slot });
+		}
+
+		map.dirtyBricks.clear();
+
+		if (slotsChanged)
+		{
+			map.revision++;
+		}
+
+		// an incomplete map would have rays skip through the bricks that are missing
+		if (map.overflowed)
+		{
+			map.bakeJobs.clear();
+		}
+
+		return map.bakeJobs.size();
+	}
+
+	void reset_brick_map(BrickMap& map)
+	{
+		map.brickSize = 0.0f;
+		map.shapeRevisions.clear();
+		map.bakeJobs.clear();
+		map.overflowed = false;
+	}
+
+	uint32_t brick_map_used_slots(const BrickMap& map)
+	{
+		return map.brickSize > 0.0f ? BRICK_ATLAS_CAPACITY - static_cast<uint32_t>(map.freeSlots.size()) : 0;
+	}
+}
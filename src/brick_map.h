@@ -0,0 +1,88 @@
+#pragma once
+
+#include "sdf_scene.h"
+
+namespace vkUtil
+{
+	// Bricks per axis of the cached volume
+	constexpr uint32_t BRICK_GRID_SIZE = 64;
+
+	// Distance samples per brick axis, neighbouring bricks share their border samples
+	// (local_size of brick_bake.comp)
+	constexpr uint32_t BRICK_SAMPLES = 8;
+
+	// Bricks per axis of the atlas image, which holds BRICK_ATLAS_BRICKS^3 bricks
+	constexpr uint32_t BRICK_ATLAS_BRICKS = 32;
+	constexpr uint32_t BRICK_ATLAS_CAPACITY = BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS;
+
+	// Empty bricks around the shapes on every side, so they can move a little before the volume is laid out again
+	constexpr uint32_t BRICK_VOLUME_MARGIN = 4;
+
+	// Stored distances are clamped to this many brick widths, and bricks farther than that
+	// from every shape's bounds get no storage: their points are at least that far from any surface
+	constexpr float BRICK_BAND = 0.5f;
+
+	// Indirection entry of bricks without atlas storage
+	constexpr uint32_t BRICK_EMPTY = 0xFFFFFFFF;
+
+	// One brick for brick_bake.comp to (re)bake (std430 uvec4)
+	struct BrickBakeJob
+	{
+		uint32_t x, y, z;
+
+		// atlas slot to write its samples to
+		uint32_t slot;
+	};
+
+	/// <summary>
+	/// Sparse brick map over the shapes' distance field.
+	/// The volume is split into BRICK_GRID_SIZE^3 bricks, and only bricks within the band (BRICK_BAND)
+	/// of a shape's bounds get a slot in the atlas
+	/// </summary>
+	struct BrickMap
+	{
+		glm::vec3 volumeMin = glm::vec3(0.0f);
+
+		// Width of a brick, 0 until the map is laid out
+		float brickSize = 0.0f;
+
+		// Atlas slot of each brick, x fastest
+		std::vector<uint32_t> slots;
+		std::vector<uint32_t> freeSlots;
+
+		// Bumped whenever slots changes, frames rewrite their copy of it when theirs is older
+		uint64_t revision = 0;
+
+		// Bricks the last update left to bake
+		std::vector<BrickBakeJob> bakeJobs;
+
+		// ShapeTable revision and bounds (grown by the band) each shape was baked with
+		std::vector<uint64_t> shapeRevisions;
+		std::vector<glm::vec3> shapeMin;
+		std::vector<glm::vec3> shapeMax;
+
+		// More bricks were needed than the atlas holds, the map can't be used
+		// until the shape count changes and it's laid out afresh
+		bool overflowed = false;
+
+		// scratch
+		std::vector<uint32_t> dirtyBricks;
+		std::vector<uint8_t> dirtyFlags;
+	};
+
+	/// <summary>
+	/// Brings the brick map in step with the table and its (up to date) BVH:
+	/// the bricks around shapes that were repacked, both where they were and where they are now,
+	/// get (or give back) atlas slots and are queued in bakeJobs.
+	/// The map is laid out afresh when the shape count changes or a shape leaves the volume.
+	/// Pure CPU work, like pack_shapes
+	/// </summary>
+	/// <returns>Bricks to bake</returns>
+	size_t update_brick_map(const ShapeTable& table, const ShapeBvh& bvh, BrickMap& map);
+
+	// Forgets the layout, the next update lays the map out and bakes everything again
+	void reset_brick_map(BrickMap& map);
+
+	// Atlas slots in use
+	uint32_t brick_map_used_slots(const BrickMap& map);
+}
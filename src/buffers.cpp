@@ -1,5 +1,7 @@
 #include "buffers.h"
 
+#include <algorithm>
+
 namespace vkUtil
 {
 	uint32_t find_memory_type_idx(vk::PhysicalDevice physicalDevice,
@@ -33,14 +35,14 @@ namespace vkUtil
 		vk::MemoryRequirements requirements =
 			input.logicalDevice.getBufferMemoryRequirements(bufferData.buffer);
 
-		vk::MemoryAllocateInfo allocInfo;
-		allocInfo.memoryTypeIndex = find_memory_type_idx(input.physicalDevice,
-			requirements.memoryTypeBits,
-			input.memoryProperties);
-		allocInfo.allocationSize = std::max(requirements.size, input.size);
+		requirements.size = std::max(requirements.size, static_cast<vk::DeviceSize>(input.size));
+
+		// Sub-allocated from one of the allocator's blocks, rather than a vkAllocateMemory per buffer
+		bufferData.allocation = input.allocator->allocate(requirements, input.memoryProperties,
+			input.strategy, ResourceKind::BUFFER);
 
-		bufferData.bufferMemory = input.logicalDevice.allocateMemory(allocInfo);
-		input.logicalDevice.bindBufferMemory(bufferData.buffer, bufferData.bufferMemory, 0);
+		input.logicalDevice.bindBufferMemory(bufferData.buffer,
+			bufferData.allocation.memory, bufferData.allocation.offset);
 	}
 
 	BufferData create_buffer(const BufferInput& input)
@@ -51,6 +53,17 @@ namespace vkUtil
 		bufferCreateInfo.usage = input.usage;
 		bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
 
+		std::vector<uint32_t> uniqueFamilies(input.queueFamilyIndices);
+		std::sort(uniqueFamilies.begin(), uniqueFamilies.end());
+		uniqueFamilies.erase(std::unique(uniqueFamilies.begin(), uniqueFamilies.end()), uniqueFamilies.end());
+
+		if (uniqueFamilies.size() > 1)
+		{
+			bufferCreateInfo.sharingMode = vk::SharingMode::eConcurrent;
+			bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(uniqueFamilies.size());
+			bufferCreateInfo.pQueueFamilyIndices = uniqueFamilies.data();
+		}
+
 		BufferData bufferData;
 		bufferData.buffer = input.logicalDevice.createBuffer(bufferCreateInfo);
 
@@ -59,30 +72,11 @@ namespace vkUtil
 		return bufferData;
 	}
 
-	void copy_buffer(const BufferData& srcBufferData, const BufferData& dstBufferData,
-		const vk::DeviceSize& size, const vk::Queue& queue, const vk::CommandBuffer& commandBuffer)
+	void destroy_buffer(const vk::Device& logicalDevice, MemoryAllocator& allocator, BufferData& bufferData)
 	{
-		commandBuffer.reset();
-
-		vk::CommandBufferBeginInfo beginInfo{};
-		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-		commandBuffer.begin(beginInfo);
-
-		vk::BufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
-		copyRegion.size = size;
-		
-		commandBuffer.copyBuffer(srcBufferData.buffer, dstBufferData.buffer, 1, &copyRegion);
-
-		commandBuffer.end();
-
-		vk::SubmitInfo submitInfo{};
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
+		logicalDevice.destroyBuffer(bufferData.buffer);
+		allocator.free(bufferData.allocation);
 
-		queue.submit(1, &submitInfo, nullptr);
-		queue.waitIdle();
+		bufferData.buffer = nullptr;
 	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "config.h"
+#include "allocator.h"
 
 namespace vkUtil
 {
@@ -11,12 +12,18 @@ namespace vkUtil
 		vk::Device logicalDevice;
 		vk::PhysicalDevice physicalDevice;
 		vk::MemoryPropertyFlags memoryProperties;
+		MemoryAllocator* allocator;
+		AllocationStrategy strategy = AllocationStrategy::FREE_LIST;
+
+		// Queue families that will access the buffer
+		// More than one (e.g. graphics + transfer) makes the buffer concurrently shared
+		std::vector<uint32_t> queueFamilyIndices;
 	};
 
 	struct BufferData
 	{
 		vk::Buffer buffer;
-		vk::DeviceMemory bufferMemory;
+		Allocation allocation;
 	};
 
 	uint32_t find_memory_type_idx(vk::PhysicalDevice physicalDevice,
@@ -27,6 +34,5 @@ namespace vkUtil
 
 	BufferData create_buffer(const BufferInput& input);
 
-	void copy_buffer(const BufferData& srcBufferData, const BufferData& dstBufferData,
-		const vk::DeviceSize& size, const vk::Queue& queue, const vk::CommandBuffer& commandBuffer);
+	void destroy_buffer(const vk::Device& logicalDevice, MemoryAllocator& allocator, BufferData& bufferData);
 }
\ No newline at end of file
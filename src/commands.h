@@ -9,7 +9,7 @@ namespace vkInit
 	{
 		vk::Device device;
 		vk::CommandPool commandPool;
-		std::vector<vkUtil::SwapchainFrame>& frames;
+		std::vector<vkUtil::FrameContext>& frames;
 
 		// imgui
 		vk::CommandPool imguiCommandPool;
@@ -87,7 +87,12 @@ namespace vkInit
 			try
 			{
 				inputChunk.frames[ii].commandBuffer = inputChunk.device.allocateCommandBuffers(allocInfo)[0];
-				inputChunk.frames[ii].imguiCommandBuffer = inputChunk.device.allocateCommandBuffers(imguiAllocInfo)[0];
+
+				// headless engines have no imgui command pool
+				if (inputChunk.imguiCommandPool)
+				{
+					inputChunk.frames[ii].imguiCommandBuffer = inputChunk.device.allocateCommandBuffers(imguiAllocInfo)[0];
+				}
 
 				if (debug)
 				{
@@ -103,4 +108,59 @@ namespace vkInit
 			}
 		}
 	}
+
+	/// <summary>
+	/// Makes each frame's recording pools, one per recording task, with one secondary command buffer each,
+	/// plus the overlay command buffer. Every task records through its own pool, so no two threads ever share one
+	/// </summary>
+	/// <param name="taskCount">recording tasks (threads) per frame</param>
+	void make_record_command_buffers(commandBufferInputChunk inputChunk, uint32_t queueFamilyIdx,
+		uint32_t taskCount, bool debug)
+	{
+		// short lived buffers, reset by resetting the whole pool
+		vk::CommandPoolCreateInfo poolInfo = {};
+		poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+		poolInfo.queueFamilyIndex = queueFamilyIdx;
+
+		for (int ii = 0; ii < inputChunk.frames.size(); ii++)
+		{
+			vkUtil::FrameContext& frame = inputChunk.frames[ii];
+
+			try
+			{
+				for (uint32_t task = 0; task < taskCount; task++)
+				{
+					vk::CommandPool pool = inputChunk.device.createCommandPool(poolInfo);
+					frame.recordCommandPools.push_back(pool);
+
+					vk::CommandBufferAllocateInfo allocInfo = {};
+					allocInfo.commandPool = pool;
+					allocInfo.level = vk::CommandBufferLevel::eSecondary;
+					allocInfo.commandBufferCount = 1;
+
+					frame.recordCommandBuffers.push_back(inputChunk.device.allocateCommandBuffers(allocInfo)[0]);
+				}
+
+				// recorded after the tasks' buffers, so it can share the first pool
+				vk::CommandBufferAllocateInfo overlayAllocInfo = {};
+				overlayAllocInfo.commandPool = frame.recordCommandPools[0];
+				overlayAllocInfo.level = vk::CommandBufferLevel::eSecondary;
+				overlayAllocInfo.commandBufferCount = 1;
+
+				frame.overlayCommandBuffer = inputChunk.device.allocateCommandBuffers(overlayAllocInfo)[0];
+
+				if (debug)
+				{
+					std::cout << "Allocated " << taskCount << " recording command buffers for frame " << ii << std::endl;
+				}
+			}
+			catch (vk::SystemError err)
+			{
+				if (debug)
+				{
+					std::cout << "Failed to allocate recording command buffers for frame " << ii << std::endl;
+				}
+			}
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "config.h"
+#include "frame.h"
+
+
+namespace vkInit
+{
+	// A float per tile is all the pre-pass writes, and R32 float storage images need no extra features
+	const vk::Format coneDepthFormat = vk::Format::eR32Sfloat;
+
+
+	/// <summary>
+	/// Makes the image the cone marching pre-pass writes each tile's safe distance to,
+	/// one texel per vkUtil::CONE_TILE_SIZE^2 pixels of the swapchain
+	/// </summary>
+	vkUtil::ConeDepthImage make_cone_depth_image(vk::Device logicalDevice, vkUtil::MemoryAllocator& allocator,
+		vk::Extent2D swapchainExtent, bool debug)
+	{
+		vkUtil::ConeDepthImage coneDepth{};
+		coneDepth.extent.width = (swapchainExtent.width + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE;
+		coneDepth.extent.height = (swapchainExtent.height + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE;
+
+		// Image
+		vk::ImageCreateInfo imageInfo = {};
+		imageInfo.imageType = vk::ImageType::e2D;
+		imageInfo.format = coneDepthFormat;
+		imageInfo.extent = vk::Extent3D{ coneDepth.extent.width, coneDepth.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = vk::SampleCountFlagBits::e1;
+		imageInfo.tiling = vk::ImageTiling::eOptimal;
+		imageInfo.usage = vk::ImageUsageFlagBits::eStorage;
+		imageInfo.sharingMode = vk::SharingMode::eExclusive;
+		imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+		try
+		{
+			coneDepth.image = logicalDevice.createImage(imageInfo);
+		}
+		catch (vk::SystemError err)
+		{
+			throw std::runtime_error("Failed to create cone depth image :/\n");
+		}
+
+		// Memory
+		vk::MemoryRequirements requirements = logicalDevice.getImageMemoryRequirements(coneDepth.image);
+
+		coneDepth.allocation = allocator.allocate(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+			vkUtil::AllocationStrategy::FREE_LIST, vkUtil::ResourceKind::IMAGE);
+
+		logicalDevice.bindImageMemory(coneDepth.image, coneDepth.allocation.memory, coneDepth.allocation.offset);
+
+		// Image view
+		vk::ImageViewCreateInfo viewInfo = {};
+		viewInfo.image = coneDepth.image;
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.format = coneDepthFormat;
+
+		viewInfo.components.r = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.g = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.b = vk::ComponentSwizzle::eIdentity;
+		viewInfo.components.a = vk::ComponentSwizzle::eIdentity;
+
+		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		coneDepth.view = logicalDevice.createImageView(viewInfo);
+
+		if (debug)
+		{
+			std::cout << "Created cone depth image (" << coneDepth.extent.width
+				<< "x" << coneDepth.extent.height << " tiles)\n";
+		}
+
+		return coneDepth;
+	}
+
+	void destroy_cone_depth_image(vk::Device logicalDevice, vkUtil::MemoryAllocator& allocator,
+		vkUtil::ConeDepthImage& coneDepth)
+	{
+		if (coneDepth.extent.width == 0)
+		{
+			return;
+		}
+
+		logicalDevice.destroyImageView(coneDepth.view);
+		logicalDevice.destroyImage(coneDepth.image);
+		allocator.free(coneDepth.allocation);
+
+		coneDepth = vkUtil::ConeDepthImage{};
+	}
+}
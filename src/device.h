@@ -3,6 +3,7 @@
 #include "config.h"
 #include "logging.h"
 #include "queue_families.h"
+#include "render_structs.h"
 
 namespace vkInit
 {
@@ -39,7 +40,7 @@ namespace vkInit
 	}
 
 
-	bool isSuitable(const vk::PhysicalDevice& device, const bool debug)
+	bool isSuitable(const vk::PhysicalDevice& device, const bool headless, const bool debug)
 	{
 		if (debug)
 		{
@@ -48,10 +49,13 @@ namespace vkInit
 
 		// For now, we consider a device suitable if it can present to the screen
 		// i.e., Support the swapchain extension
-		const std::vector<const char*> requestedExtensions =
+		// Headless devices render offscreen, so any device will do
+		std::vector<const char*> requestedExtensions;
+
+		if (!headless)
 		{
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
-		};
+			requestedExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
 
 		if (debug)
 		{
@@ -86,7 +90,7 @@ namespace vkInit
 	}
 
 
-	vk::PhysicalDevice choose_physical_device(vk::Instance& instance, bool debug)
+	vk::PhysicalDevice choose_physical_device(vk::Instance& instance, bool headless, bool debug)
 	{
 		// Physical devices are neither created nor destroyed. Merely chosen.
 		
@@ -126,7 +130,7 @@ namespace vkInit
 				log_device_properties(device);
 			}
 
-			if (isSuitable(device, debug))
+			if (isSuitable(device, headless, debug))
 			{
 				vk::PhysicalDeviceProperties properties = device.getProperties();
 
@@ -185,7 +189,37 @@ namespace vkInit
 	}
 
 
-	vk::Device create_logical_device(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, bool debug)
+	vkUtil::DeviceCapabilities query_device_capabilities(const vk::PhysicalDevice& physicalDevice, bool debug)
+	{
+		vkUtil::DeviceCapabilities capabilities;
+
+		vk::PhysicalDeviceFeatures features = physicalDevice.getFeatures();
+
+		capabilities.multiDrawIndirect = features.multiDrawIndirect;
+		capabilities.drawIndirectFirstInstance = features.drawIndirectFirstInstance;
+		capabilities.fragmentStoresAndAtomics = features.fragmentStoresAndAtomics;
+		capabilities.drawIndirectCount = checkDeviceExtensionSupport(physicalDevice,
+			{ VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME }, false);
+
+		vk::FormatProperties atlasFormat = physicalDevice.getFormatProperties(vk::Format::eR16Sfloat);
+		capabilities.brickCache = features.shaderStorageImageExtendedFormats
+			&& (atlasFormat.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage);
+
+		if (debug)
+		{
+			std::cout << "multiDrawIndirect: " << (capabilities.multiDrawIndirect ? "yes" : "no")
+				<< ", drawIndirectFirstInstance: " << (capabilities.drawIndirectFirstInstance ? "yes" : "no")
+				<< ", drawIndirectCount: " << (capabilities.drawIndirectCount ? "yes" : "no")
+				<< ", fragmentStoresAndAtomics: " << (capabilities.fragmentStoresAndAtomics ? "yes" : "no")
+				<< ", brickCache: " << (capabilities.brickCache ? "yes" : "no") << "\n";
+		}
+
+		return capabilities;
+	}
+
+
+	vk::Device create_logical_device(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface,
+		const vkUtil::DeviceCapabilities& capabilities, bool debug)
 	{
 		vkUtil::QueueFamilyIndices indices = vkUtil::findQueueFamilies(physicalDevice, surface, debug);
 
@@ -193,11 +227,20 @@ namespace vkInit
 		std::vector<uint32_t> uniqueIndices;
 		uniqueIndices.push_back(indices.graphicsFamily.value());
 
-		if (indices.graphicsFamily.value() != indices.presentFamily.value())
+		if (indices.presentFamily.has_value()
+			&& indices.graphicsFamily.value() != indices.presentFamily.value())
 		{
 			uniqueIndices.push_back(indices.presentFamily.value());
 		}
 
+		// Dedicated transfer queue for async uploads
+		// (each family gets a single DeviceQueueCreateInfo)
+		if (indices.transferFamily.has_value()
+			&& std::find(uniqueIndices.begin(), uniqueIndices.end(), indices.transferFamily.value()) == uniqueIndices.end())
+		{
+			uniqueIndices.push_back(indices.transferFamily.value());
+		}
+
 		// Queue priority determines how GPU allocates its resources towards different queues
 		// in the same queue family
 		// 0.0 = lowest, 1.0 = highest
@@ -220,10 +263,18 @@ namespace vkInit
 		}
 
 		// Request swapchain extension
-		std::vector<const char*> deviceExtensions =
+		// (not needed when we have no surface to present to)
+		std::vector<const char*> deviceExtensions;
+
+		if (surface)
 		{
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
-		};
+			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+
+		if (capabilities.drawIndirectCount)
+		{
+			deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
 
 
 
@@ -231,6 +282,10 @@ namespace vkInit
 		// We can enable features in this if we want
 		// e.g., deviceFeatures.samplerAnisotropy = true
 		vk::PhysicalDeviceFeatures deviceFeatures = vk::PhysicalDeviceFeatures();
+		deviceFeatures.multiDrawIndirect = capabilities.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = capabilities.drawIndirectFirstInstance;
+		deviceFeatures.fragmentStoresAndAtomics = capabilities.fragmentStoresAndAtomics;
+		deviceFeatures.shaderStorageImageExtendedFormats = capabilities.brickCache;
 
 
 		// Enabled layers
@@ -286,10 +341,11 @@ namespace vkInit
 		vkUtil::QueueFamilyIndices indices = vkUtil::findQueueFamilies(physicalDevice, surface, debug);
 
 		// queue family index, queue index
+		// Headless devices have no present family, so the graphics queue stands in for it
 		return
 		{
 			device.getQueue(indices.graphicsFamily.value(), 0),
-			device.getQueue(indices.presentFamily.value(), 0)
+			device.getQueue(indices.presentFamily.value_or(indices.graphicsFamily.value()), 0)
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "draw_list.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace vkUtil
+{
+	static DrawKey draw_key(const MeshRenderer& renderer)
+	{
+		return DrawKey{ renderer.pipeline, renderer.material, renderer.meshType };
+	}
+
+	void build_draw_list(const std::vector<MeshRenderer>& renderers, DrawList& drawList)
+	{
+		drawList.batches.clear();
+		drawList.instances.resize(renderers.size());
+		drawList.rendererBatches.resize(renderers.size());
+
+		// Count the renderers of every key
+		// There are few keys and neighbours usually share one, so the last batch is tried first
+		uint32_t lastBatch = 0;
+
+		for (size_t ii = 0; ii < renderers.size(); ii++)
+		{
+			DrawKey key = draw_key(renderers[ii]);
+
+			if (drawList.batches.empty() || !(drawList.batches[lastBatch].key == key))
+			{
+				auto found = std::find_if(drawList.batches.begin(), drawList.batches.end(),
+					[&key](const DrawBatch& batch) { return batch.key == key; });
+
+				if (found == drawList.batches.end())
+				{
+					drawList.batches.push_back(DrawBatch{ key, 0, 0 });
+					found = drawList.batches.end() - 1;
+				}
+
+				lastBatch = static_cast<uint32_t>(found - drawList.batches.begin());
+			}
+
+			drawList.batches[lastBatch].instanceCount++;
+			drawList.rendererBatches[ii] = lastBatch;
+		}
+
+		// Group batches by pipeline, remembering where each one went
+		// Otherwise they stay in order of first appearance: there's no depth buffer,
+		// so reordering meshes would change what ends up on top
+		std::vector<uint32_t> order(drawList.batches.size());
+		std::iota(order.begin(), order.end(), 0);
+
+		std::stable_sort(order.begin(), order.end(),
+			[&drawList](uint32_t a, uint32_t b)
+			{
+				return drawList.batches[a].key.pipeline < drawList.batches[b].key.pipeline;
+			});
+
+		std::vector<DrawBatch> sorted(drawList.batches.size());
+		std::vector<uint32_t> sortedIndex(drawList.batches.size());
+		uint32_t firstInstance = 0;
+
+		for (uint32_t ii = 0; ii < order.size(); ii++)
+		{
+			sorted[ii] = drawList.batches[order[ii]];
+			sorted[ii].firstInstance = firstInstance;
+			sortedIndex[order[ii]] = ii;
+
+			firstInstance += sorted[ii].instanceCount;
+		}
+
+		drawList.batches.swap(sorted);
+
+		// Scatter renderers into their batch's model slots
+		std::vector<uint32_t> next(drawList.batches.size());
+
+		for (size_t ii = 0; ii < drawList.batches.size(); ii++)
+		{
+			next[ii] = drawList.batches[ii].firstInstance;
+		}
+
+		for (size_t ii = 0; ii < renderers.size(); ii++)
+		{
+			uint32_t batch = sortedIndex[drawList.rendererBatches[ii]];
+			drawList.instances[next[batch]++] = static_cast<uint32_t>(ii);
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Entity.h"
+
+namespace vkUtil
+{
+	// What a batch of instances has in common: one pipeline, one material, one mesh
+	struct DrawKey
+	{
+		uint32_t pipeline;
+		uint32_t material;
+		MeshType meshType;
+
+		bool operator==(const DrawKey&) const = default;
+	};
+
+	// One instanced draw
+	// Its instances use model slots [firstInstance, firstInstance + instanceCount)
+	struct DrawBatch
+	{
+		DrawKey key;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+
+		bool operator==(const DrawBatch&) const = default;
+	};
+
+	struct DrawList
+	{
+		// Grouped by pipeline, otherwise in the order their first renderer appeared
+		std::vector<DrawBatch> batches;
+
+		// Model slot -> index of the renderer drawn with it
+		// Each batch's renderers keep their relative order
+		std::vector<uint32_t> instances;
+
+		// Scratch, kept to reuse its storage: the batch of every renderer
+		std::vector<uint32_t> rendererBatches;
+	};
+
+	/// <summary>
+	/// Buckets renderers by DrawKey into one instanced draw per bucket.
+	/// Pure CPU work, so it can be checked against expected draw lists without a device
+	/// </summary>
+	/// <param name="renderers">renderers to draw, e.g. a MeshRenderer pool's packed array</param>
+	/// <param name="drawList">rebuilt from scratch</param>
+	void build_draw_list(const std::vector<MeshRenderer>& renderers, DrawList& drawList);
+}
@@ -3,11 +3,18 @@
 #include "logging.h"
 #include "device.h"
 #include "swapchain.h"
+#include "offscreen.h"
 #include "pipeline.h"
 #include "framebuffer.h"
 #include "commands.h"
 #include "sync.h"
 #include "descriptors.h"
+#include "pipeline_cache.h"
+#include "brick_atlas.h"
+#include "cone_depth.h"
+
+#include <algorithm>
+#include <thread>
 
 // Imgui
 #include "imgui/imgui.h"
@@ -16,36 +23,74 @@
 #define APP_USE_VULKAN_DEBUG_REPORT
 
 
-Engine::Engine(int width, int height, GLFWwindow* window, const char* appName, bool debugMode)
+Engine::Engine(int width, int height, GLFWwindow* window, const char* appName, bool debugMode,
+	const EngineSettings& settings)
 {
+	vkUtil::CpuTimer startupTimer;
+
+	this->settings = settings;
 	this->width = width;
 	this->height = height;
 	this->window = window;
+	this->headless = (window == nullptr);
 	this->debugMode = debugMode;
 	this->appName = appName;
 	this->scene = new Scene();
 
+	// at least one frame must always be recordable
+	maxFramesInFlight = static_cast<int>(std::max(settings.framesInFlight, 1u));
+
+	swapchainSettingsChanged = false;
+	inputPending = false;
+	nextFrameTime = std::chrono::steady_clock::now();
+
 	if (debugMode)
 	{
 		std::cout << "Creating our Graphics Engine\n";
 	}
 
+	jobs.init(settings.workerThreads);
+
 	make_instance();
 	make_device();
 
+	make_pipeline_cache();
 	make_descriptor_set_layout();
+	make_cull_descriptor_set_layout();
+	make_raymarch_descriptor_set_layout();
+	make_brick_bake_descriptor_set_layout();
+
+	vkUtil::CpuTimer pipelineTimer;
+
+	// Independent pipelines, loaded and built side by side
+	vkUtil::JobCounter pipelinesMade;
+	jobs.submit(pipelinesMade, [this]() { make_cull_pipeline(); });
+	jobs.submit(pipelinesMade, [this]() { make_raymarch_pipeline(); });
+	jobs.submit(pipelinesMade, [this]() { make_brick_bake_pipeline(); });
+	jobs.submit(pipelinesMade, [this]() { make_cone_prepass_pipeline(); });
 	make_pipeline();
+	jobs.wait(pipelinesMade);
+
+	startupTimings.pipelineMs = pipelineTimer.total();
 
 	finalize_setup();
 
 	make_assets();
 	scene->InitEntities();
+
+	startupTimings.totalMs = startupTimer.total();
+}
+
+Engine::Engine(int width, int height, const char* appName, bool debugMode,
+	const EngineSettings& settings)
+	: Engine(width, height, nullptr, appName, debugMode, settings)
+{
 }
 
 void Engine::make_instance()
 {
 	// Create Vulkan instance
-	instance = vkInit::make_instance(debugMode, appName);
+	instance = vkInit::make_instance(debugMode, headless, appName);
 	
 	// Create dispatch loader to assist with debug messenger
 	dldi = vk::DispatchLoaderDynamic(instance, vkGetInstanceProcAddr);
@@ -56,6 +101,13 @@ void Engine::make_instance()
 		debugMessenger = vkInit::make_debug_messenger(instance, dldi);
 	}
 
+	// Headless engines have nothing to present to
+	if (headless)
+	{
+		surface = nullptr;
+		return;
+	}
+
 	// Create surface
 	VkSurfaceKHR c_style_surface;
 	if (glfwCreateWindowSurface(instance, window, nullptr, &c_style_surface) != VK_SUCCESS)
@@ -75,7 +127,11 @@ void Engine::make_instance()
 
 void Engine::make_swapchain()
 {
-	vkInit::SwapchainBundle bundle = vkInit::create_swapchain(device, physicalDevice, surface, width, height, debugMode);
+	// Headless engines give each frame context its own offscreen image
+	vkInit::SwapchainBundle bundle = headless
+		? vkInit::create_offscreen_frames(device, allocator, width, height, static_cast<uint32_t>(maxFramesInFlight), debugMode)
+		: vkInit::create_swapchain(device, physicalDevice, surface, width, height,
+			present_policy_mode(settings.presentPolicy), settings.swapchainImageCount, nullptr, debugMode);
 	swapchain = bundle.swapchain;
 	swapchainFrames = bundle.frames;
 	swapchainFormat = bundle.format;
@@ -83,11 +139,32 @@ void Engine::make_swapchain()
 
 	minImageCount = bundle.minImageCount;
 	imageCount = bundle.imageCount;
+	presentMode = bundle.presentMode;
 
-	maxFramesInFlight = static_cast<int>(swapchainFrames.size());
+	if (!headless)
+	{
+		supportedPresentModes = physicalDevice.getSurfacePresentModesKHR(surface);
+	}
+
+	make_swapchain_sync();
+}
+
+void Engine::make_swapchain_sync()
+{
+	// headless frames are never presented
+	if (headless)
+	{
+		return;
+	}
+
+	for (vkUtil::SwapchainFrame& frame : swapchainFrames)
+	{
+		frame.renderFinished = vkInit::make_semaphore(device, debugMode);
+	}
 }
 
-// TODO: How to adapt this for Imgui?
+// Only the swapchain images and what's built on them (framebuffers, present semaphores) are replaced.
+// Frame contexts and ImGui stay alive, and the old images are destroyed once the frames still using them have finished
 void Engine::recreate_swapchain()
 {
 	// if minimized, wait until our window is reopened
@@ -100,33 +177,126 @@ void Engine::recreate_swapchain()
 		glfwWaitEvents();
 	}
 
-	device.waitIdle();
+	vk::SwapchainKHR oldSwapchain = swapchain;
+	retire_swapchain();
 
-	cleanup_swapchain();
+	vkInit::SwapchainBundle bundle = vkInit::create_swapchain(device, physicalDevice, surface, width, height,
+		present_policy_mode(settings.presentPolicy), settings.swapchainImageCount, oldSwapchain, debugMode);
 
-	make_swapchain();
-	make_framebuffers();
-	make_frame_resources();
+	swapchain = bundle.swapchain;
+	swapchainFormat = bundle.format;
+	swapchainExtent = bundle.extent;
+	imageCount = bundle.imageCount;
+	presentMode = bundle.presentMode;
 
-	vkInit::commandBufferInputChunk commandBufferInput = { device, commandPool, swapchainFrames, imguiMainCommandPool };
-	vkInit::make_frame_command_buffers(commandBufferInput, debugMode);
+	// The image count may change, frame contexts don't care
+	swapchainFrames = bundle.frames;
+	make_swapchain_sync();
+	make_framebuffers();
 
 	// update imgui imagecount
-	ImGui_ImplVulkan_SetMinImageCount(std::max(minImageCount, static_cast<uint32_t>(2)));
+	// (the backend idles the device when this changes, so only tell it when it does)
+	if (bundle.minImageCount != minImageCount)
+	{
+		minImageCount = bundle.minImageCount;
+		ImGui_ImplVulkan_SetMinImageCount(std::max(minImageCount, static_cast<uint32_t>(2)));
+	}
 
-	// TODO: Identify potentially redundant steps in the following code
-	// Remove these lines if we don't want to make the render adapt to screen resizing
-	cleanup_pipeline();
-	make_pipeline();
+	// The pipelines and render passes only depend on the swapchain format, which
+	// choose_swapchain_surface_format picks the same way every time, so they're kept
+}
+
+void Engine::retire_swapchain()
+{
+	vkUtil::RetiredSwapchain retired;
+	retired.swapchain = swapchain;
+	retired.retiredAt = submittedFrameCount;
+
+	for (vkUtil::SwapchainFrame& frame : swapchainFrames)
+	{
+		retired.imageViews.push_back(frame.imageView);
+		retired.framebuffers.push_back(frame.frameBuffer);
+		retired.framebuffers.push_back(frame.imguiFrameBuffer);
+
+		// present may still be waiting on it
+		retired.semaphores.push_back(frame.renderFinished);
+	}
+
+	retiredSwapchains.push_back(retired);
+	swapchainFrames.clear();
+	swapchain = nullptr;
+}
+
+// Called right after a frame slot's fence wait. Frames complete in submission order,
+// so once every slot has been waited on again, nothing recorded before the retirement is in flight.
+// Fences only cover the submits though, not the presents waiting on the retired renderFinished semaphores:
+// without VK_EXT_swapchain_maintenance1's present fences there's no way to tell when those are done,
+// so the present queue is idled before anything is destroyed. That stall only happens once per retirement
+void Engine::destroy_retired_swapchains(bool force)
+{
+	size_t kept = 0;
+	bool presentsIdle = false;
+
+	for (vkUtil::RetiredSwapchain& retired : retiredSwapchains)
+	{
+		if (!force && submittedFrameCount < retired.retiredAt + maxFramesInFlight)
+		{
+			retiredSwapchains[kept++] = retired;
+			continue;
+		}
+
+		if (!presentsIdle && presentQueue)
+		{
+			presentQueue.waitIdle();
+			presentsIdle = true;
+		}
+
+		for (vk::Framebuffer framebuffer : retired.framebuffers)
+		{
+			device.destroyFramebuffer(framebuffer);
+		}
+
+		for (vk::ImageView imageView : retired.imageViews)
+		{
+			device.destroyImageView(imageView);
+		}
+
+		for (vk::Semaphore semaphore : retired.semaphores)
+		{
+			device.destroySemaphore(semaphore);
+		}
+
+		device.destroySwapchainKHR(retired.swapchain);
+	}
+
+	retiredSwapchains.resize(kept);
 }
 
 void Engine::make_device()
 {
 	// physical device
-	physicalDevice = vkInit::choose_physical_device(instance, debugMode);
+	physicalDevice = vkInit::choose_physical_device(instance, headless, debugMode);
 
 	// logical device
-	device = vkInit::create_logical_device(physicalDevice, surface, debugMode);
+	deviceCapabilities = vkInit::query_device_capabilities(physicalDevice, debugMode);
+	device = vkInit::create_logical_device(physicalDevice, surface, deviceCapabilities, debugMode);
+
+	// Culled batches are drawn from their own firstInstance on (see prepare_culling),
+	// which indirect draws can only do with drawIndirectFirstInstance
+	if (settings.gpuCulling && !deviceCapabilities.drawIndirectFirstInstance)
+	{
+		settings.gpuCulling = false;
+
+		if (debugMode)
+		{
+			std::cout << "drawIndirectFirstInstance is not supported, drawing from the CPU instead of culling\n";
+		}
+	}
+
+	// device level extension functions (vkCmdDrawIndirectCountKHR) go through the dynamic dispatcher too
+	dldi.init(device);
+
+	allocator.init(device, physicalDevice, debugMode);
 
 	// Queues
 	std::array<vk::Queue, 2> queues = vkInit::get_queue(physicalDevice, device, surface, debugMode);
@@ -136,30 +306,56 @@ void Engine::make_device()
 	// Get queue family index
 	// Required for Imgui
 	// TODO: Reduce redundancy
-	graphicsQueueFamilyIdx = vkUtil::findQueueFamilies(physicalDevice, surface, debugMode).graphicsFamily.value();
+	vkUtil::QueueFamilyIndices queueFamilyIndices = vkUtil::findQueueFamilies(physicalDevice, surface, debugMode);
+	graphicsQueueFamilyIdx = queueFamilyIndices.graphicsFamily.value();
+
+	// Uploads share the graphics queue when there is no dedicated transfer family
+	transferQueueFamilyIdx = queueFamilyIndices.transferFamily.value_or(graphicsQueueFamilyIdx);
+	transferQueue = device.getQueue(transferQueueFamilyIdx, 0);
+
+	uploadQueue.init(device, physicalDevice, allocator, transferQueue, transferQueueFamilyIdx, debugMode);
 
 	make_swapchain();
 	
 	frameNum = 0;
+	submittedFrameCount = 0;
+}
+
+void Engine::make_pipeline_cache()
+{
+	if (settings.pipelineCacheFile.empty())
+	{
+		pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo{});
+		return;
+	}
+
+	pipelineCache = vkInit::make_pipeline_cache(device, physicalDevice,
+		settings.pipelineCacheFile, startupTimings.pipelineCacheLoaded, debugMode);
 }
 
 void Engine::make_descriptor_set_layout()
 {
 	vkInit::DescriptorSetLayoutData bindings{};
-	bindings.count = 2;
+	bindings.count = 3;
 	bindings.indices.reserve(bindings.count);
 	bindings.types.reserve(bindings.count);
 	bindings.counts.reserve(bindings.count);
 	bindings.stages.reserve(bindings.count);
 
 	// Uniform buffer
-	bindings.indices.push_back(0);
+	bindings.indices.push_back(vkUtil::CAMERA_BINDING);
 	bindings.types.push_back(vk::DescriptorType::eUniformBuffer);
 	bindings.counts.push_back(1);
 	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
 
 	// Storage buffer
-	bindings.indices.push_back(1);
+	bindings.indices.push_back(vkUtil::MODEL_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+
+	// Visible instances (GPU culling output)
+	bindings.indices.push_back(vkUtil::VISIBLE_BINDING);
 	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
 	bindings.counts.push_back(1);
 	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
@@ -176,9 +372,10 @@ void Engine::make_pipeline()
 	specification.device = device;
 	specification.vertexFilepath = "./shaders/vertex.spv";
 	specification.fragmentFilepath = "./shaders/fragment.spv";
-	specification.swapchainExtent = swapchainExtent;
 	specification.swapchainImageFormat = swapchainFormat;
 	specification.descriptorSetLayout = descriptorSetLayout;
+	specification.pipelineCache = pipelineCache;
+	specification.culledInstances = settings.gpuCulling;
 
 	// TODO: Handle File IO errors
 	vkInit::GraphicsPipelineOutBundle output = vkInit::make_graphics_pipeline(specification, debugMode);
@@ -187,7 +384,193 @@ void Engine::make_pipeline()
 	pipeline = output.pipeline;
 
 	// imgui renderpass
-	create_imgui_renderpass();
+	if (!headless)
+	{
+		create_imgui_renderpass();
+	}
+}
+
+void Engine::make_cull_descriptor_set_layout()
+{
+	if (!settings.gpuCulling)
+	{
+		return;
+	}
+
+	// Model matrices, batch table, indirect draws and visible instances: all storage buffers
+	vkInit::DescriptorSetLayoutData bindings{};
+	bindings.count = 4;
+
+	for (uint32_t binding : { vkUtil::CULL_MODEL_BINDING, vkUtil::CULL_BATCH_BINDING,
+		vkUtil::CULL_DRAW_BINDING, vkUtil::CULL_VISIBLE_BINDING })
+	{
+		bindings.indices.push_back(binding);
+		bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
+	}
+
+	cullDescriptorSetLayout = vkInit::make_descriptor_set_layout(device, bindings);
+}
+
+void Engine::make_cull_pipeline()
+{
+	if (!settings.gpuCulling)
+	{
+		return;
+	}
+
+	vkInit::ComputePipelineInBundle specification{};
+	specification.device = device;
+	specification.computeFilepath = "./shaders/cull.spv";
+	specification.descriptorSetLayout = cullDescriptorSetLayout;
+	specification.pushConstantSize = sizeof(vkUtil::CullPushConstants);
+	specification.pipelineCache = pipelineCache;
+
+	vkInit::ComputePipelineOutBundle output = vkInit::make_compute_pipeline(specification, debugMode);
+	cullLayout = output.layout;
+	cullPipeline = output.pipeline;
+}
+
+// Bindings of the raymarch set, shared by its layout and its descriptor pool
+// The set is also bound by the cone marching pre-pass (a compute pipeline), for the shapes, BVH and cone depth
+static vkInit::DescriptorSetLayoutData raymarch_descriptor_bindings()
+{
+	// SDF shapes
+	vkInit::DescriptorSetLayoutData bindings{};
+
+	bindings.indices.push_back(vkUtil::RAYMARCH_SHAPE_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute);
+
+	// BVH over the shapes
+	bindings.indices.push_back(vkUtil::RAYMARCH_BVH_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute);
+
+	// Step counters
+	bindings.indices.push_back(vkUtil::RAYMARCH_STEP_COUNTER_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment);
+
+	// Brick atlas and the brick map's indirection table
+	bindings.indices.push_back(vkUtil::RAYMARCH_BRICK_ATLAS_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment);
+
+	bindings.indices.push_back(vkUtil::RAYMARCH_BRICK_INDIRECTION_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment);
+
+	// Cone depth, written by the pre-pass and read by the fragment shader
+	bindings.indices.push_back(vkUtil::RAYMARCH_CONE_DEPTH_BINDING);
+	bindings.types.push_back(vk::DescriptorType::eStorageImage);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute);
+
+	bindings.count = bindings.indices.size();
+
+	return bindings;
+}
+
+void Engine::make_raymarch_descriptor_set_layout()
+{
+	raymarchDescriptorSetLayout = vkInit::make_descriptor_set_layout(device, raymarch_descriptor_bindings());
+}
+
+void Engine::make_cone_prepass_pipeline()
+{
+	// Same set and push constants as the raymarch pass
+	vkInit::ComputePipelineInBundle specification{};
+	specification.device = device;
+	specification.computeFilepath = "./shaders/cone_prepass.spv";
+	specification.descriptorSetLayout = raymarchDescriptorSetLayout;
+	specification.pushConstantSize = sizeof(vkUtil::RaymarchPushConstants);
+	specification.pipelineCache = pipelineCache;
+
+	vkInit::ComputePipelineOutBundle output = vkInit::make_compute_pipeline(specification, debugMode);
+	conePrepassLayout = output.layout;
+	conePrepassPipeline = output.pipeline;
+}
+
+void Engine::make_brick_bake_descriptor_set_layout()
+{
+	if (!deviceCapabilities.brickCache)
+	{
+		return;
+	}
+
+	// Shapes, BVH, atlas and bake jobs
+	vkInit::DescriptorSetLayoutData bindings{};
+	bindings.count = 4;
+
+	bindings.indices = { vkUtil::BRICK_BAKE_SHAPE_BINDING, vkUtil::BRICK_BAKE_BVH_BINDING,
+		vkUtil::BRICK_BAKE_ATLAS_BINDING, vkUtil::BRICK_BAKE_JOB_BINDING };
+	bindings.types = { vk::DescriptorType::eStorageBuffer, vk::DescriptorType::eStorageBuffer,
+		vk::DescriptorType::eStorageImage, vk::DescriptorType::eStorageBuffer };
+	bindings.counts.assign(bindings.count, 1);
+	bindings.stages.assign(bindings.count, vk::ShaderStageFlagBits::eCompute);
+
+	brickBakeDescriptorSetLayout = vkInit::make_descriptor_set_layout(device, bindings);
+}
+
+void Engine::make_brick_bake_pipeline()
+{
+	if (!deviceCapabilities.brickCache)
+	{
+		return;
+	}
+
+	vkInit::ComputePipelineInBundle specification{};
+	specification.device = device;
+	specification.computeFilepath = "./shaders/brick_bake.spv";
+	specification.descriptorSetLayout = brickBakeDescriptorSetLayout;
+	specification.pushConstantSize = sizeof(vkUtil::BrickBakePushConstants);
+	specification.pipelineCache = pipelineCache;
+
+	vkInit::ComputePipelineOutBundle output = vkInit::make_compute_pipeline(specification, debugMode);
+	brickBakeLayout = output.layout;
+	brickBakePipeline = output.pipeline;
+}
+
+void Engine::make_raymarch_pipeline()
+{
+	vkInit::GraphicsPipelineInBundle specification{};
+	specification.device = device;
+	specification.vertexFilepath = "./shaders/raymarch_vertex.spv";
+	specification.fragmentFilepath = "./shaders/raymarch_fragment.spv";
+	specification.swapchainImageFormat = swapchainFormat;
+	specification.descriptorSetLayout = raymarchDescriptorSetLayout;
+	specification.pipelineCache = pipelineCache;
+	specification.culledInstances = false;
+	specification.pushConstantSize = sizeof(vkUtil::RaymarchPushConstants);
+
+	vkInit::GraphicsPipelineOutBundle output = vkInit::make_graphics_pipeline(specification, debugMode);
+	raymarchLayout = output.layout;
+	raymarchPipeline = output.pipeline;
+
+	// Drawn in the scene pass, its own (compatible) render pass was only needed to build it
+	device.destroyRenderPass(output.renderpass);
+
+	// Writing the counters from the fragment stage is invalid without the feature, even behind a flag,
+	// so they come with a shader compiled apart (see shaders/shader_compile.bat)
+	if (!deviceCapabilities.fragmentStoresAndAtomics)
+	{
+		return;
+	}
+
+	specification.fragmentFilepath = "./shaders/raymarch_fragment_counters.spv";
+
+	output = vkInit::make_graphics_pipeline(specification, debugMode);
+	raymarchCounterLayout = output.layout;
+	raymarchCounterPipeline = output.pipeline;
+
+	device.destroyRenderPass(output.renderpass);
 }
 
 void Engine::make_framebuffers()
@@ -206,42 +589,106 @@ void Engine::make_framebuffers()
 void Engine::make_frame_resources()
 {
 	vkInit::DescriptorSetLayoutData bindings{};
-	bindings.count = 2;
+	bindings.count = 3;
 	bindings.types.reserve(bindings.count);
 
 	bindings.types.push_back(vk::DescriptorType::eUniformBuffer);
 	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
 
 	descriptorPool = vkInit::make_descriptor_pool(device,
-		static_cast<uint32_t>(swapchainFrames.size()), bindings);
+		static_cast<uint32_t>(frameContexts.size()), bindings);
 
+	if (settings.gpuCulling)
+	{
+		vkInit::DescriptorSetLayoutData cullBindings{};
+		cullBindings.count = 4;
+		cullBindings.types.assign(cullBindings.count, vk::DescriptorType::eStorageBuffer);
 
-	for (vkUtil::SwapchainFrame& frame : swapchainFrames)
+		cullDescriptorPool = vkInit::make_descriptor_pool(device,
+			static_cast<uint32_t>(frameContexts.size()), cullBindings);
+	}
+
+	raymarchDescriptorPool = vkInit::make_descriptor_pool(device,
+		static_cast<uint32_t>(frameContexts.size()), raymarch_descriptor_bindings());
+
+	if (deviceCapabilities.brickCache)
+	{
+		vkInit::DescriptorSetLayoutData brickBakeBindings{};
+		brickBakeBindings.count = 4;
+		brickBakeBindings.types.assign(brickBakeBindings.count, vk::DescriptorType::eStorageBuffer);
+		brickBakeBindings.types[vkUtil::BRICK_BAKE_ATLAS_BINDING] = vk::DescriptorType::eStorageImage;
+
+		brickBakeDescriptorPool = vkInit::make_descriptor_pool(device,
+			static_cast<uint32_t>(frameContexts.size()), brickBakeBindings);
+	}
+
+	// One atlas for every frame: bakes are ordered on the graphics queue, and only ever touch bricks
+	// the map just (re)assigned, which earlier frames' raymarch passes are done reading by then
+	brickAtlas = vkInit::make_brick_atlas(device, allocator, deviceCapabilities.brickCache, debugMode);
+	brickAtlasReady = false;
+
+
+	for (vkUtil::FrameContext& frame : frameContexts)
 	{
 		frame.imageAvailable = vkInit::make_semaphore(device, debugMode);
-		frame.renderFinished = vkInit::make_semaphore(device, debugMode);
 		frame.inFlight = vkInit::make_fence(device, debugMode);
 
-		frame.make_descriptor_resources(device, physicalDevice);
+		frame.make_descriptor_resources(device, physicalDevice, allocator);
 
 		frame.descriptorSet = vkInit::allocate_descriptor_set(
 			device, descriptorPool, descriptorSetLayout);
+
+		if (settings.gpuCulling)
+		{
+			frame.cullDescriptorSet = vkInit::allocate_descriptor_set(
+				device, cullDescriptorPool, cullDescriptorSetLayout);
+		}
+
+		frame.raymarchDescriptorSet = vkInit::allocate_descriptor_set(
+			device, raymarchDescriptorPool, raymarchDescriptorSetLayout);
+
+		if (deviceCapabilities.brickCache)
+		{
+			frame.brickBakeDescriptorSet = vkInit::allocate_descriptor_set(
+				device, brickBakeDescriptorPool, brickBakeDescriptorSetLayout);
+		}
+
+		frame.set_brick_atlas(brickAtlas);
 	}
 }
 
 void Engine::finalize_setup()
 {
 	// imgui
-	init_imgui();
+	// (its pipeline is created here, so it counts towards pipeline creation time)
+	if (!headless)
+	{
+		vkUtil::CpuTimer pipelineTimer;
+		init_imgui();
+		startupTimings.pipelineMs += pipelineTimer.total();
+	}
 
 	make_framebuffers();
 
 	commandPool = vkInit::make_command_pool(device, physicalDevice, surface, debugMode);
 
-	vkInit::commandBufferInputChunk commandBufferInput = { device, commandPool, swapchainFrames, imguiMainCommandPool };
+	gpuProfiler.init(device, physicalDevice, graphicsQueueFamilyIdx,
+		static_cast<uint32_t>(maxFramesInFlight), debugMode);
+
+	frameContexts.resize(maxFramesInFlight);
+
+	vkInit::commandBufferInputChunk commandBufferInput = { device, commandPool, frameContexts, imguiMainCommandPool };
 	mainCommandBuffer = vkInit::make_main_command_buffer(commandBufferInput, debugMode);
 	vkInit::make_frame_command_buffers(commandBufferInput, debugMode);
 
+	// A single thread records inline, without any secondary command buffers
+	if (jobs.get_thread_count() > 1)
+	{
+		vkInit::make_record_command_buffers(commandBufferInput, graphicsQueueFamilyIdx,
+			jobs.get_thread_count(), debugMode);
+	}
+
 	make_frame_resources();
 }
 
@@ -321,17 +768,95 @@ void Engine::make_assets()
 		 2.0f,  0.0f,				// UV
 	};
 
-	scene->consume(MeshType::TRIANGLE_FULLSCREEN, vertexData);
+	// Already in clip space, so it's never culled
+	scene->consume(MeshType::TRIANGLE_FULLSCREEN, vertexData, false);
 
 
-	FinalizationChunk finalizationChunk{device, physicalDevice, graphicsQueue, mainCommandBuffer};
+	FinalizationChunk finalizationChunk{device, physicalDevice, allocator, uploadQueue, graphicsQueueFamilyIdx};
 	scene->finalize(finalizationChunk);
 }
 
-void Engine::prepare_frame(const uint32_t imageIndex, const Scene* scene)
+const vkUtil::FrameTimings& Engine::get_frame_timings() const
+{
+	return frameTimings;
+}
+
+const vkUtil::JobStats& Engine::get_job_stats() const
+{
+	return jobStats;
+}
+
+const std::vector<vkUtil::GpuScopeTiming>& Engine::get_gpu_timings() const
+{
+	return gpuProfiler.get_latest_timings();
+}
+
+const vkUtil::StartupTimings& Engine::get_startup_timings() const
+{
+	return startupTimings;
+}
+
+void Engine::set_present_policy(PresentPolicy policy)
+{
+	if (policy != settings.presentPolicy)
+	{
+		settings.presentPolicy = policy;
+		swapchainSettingsChanged = true;
+	}
+}
+
+void Engine::set_swapchain_image_count(uint32_t count)
+{
+	if (count != settings.swapchainImageCount)
+	{
+		settings.swapchainImageCount = count;
+		swapchainSettingsChanged = true;
+	}
+}
+
+void Engine::set_frame_rate_limit(double framesPerSecond)
+{
+	settings.frameRateLimit = framesPerSecond;
+}
+
+const EngineSettings& Engine::get_settings() const
+{
+	return settings;
+}
+
+void Engine::set_raymarch_settings(const RaymarchSettings& raymarchSettings)
+{
+	settings.raymarch = raymarchSettings;
+}
+
+const vkUtil::RaymarchStepCounters& Engine::get_raymarch_step_counters() const
 {
-	vkUtil::SwapchainFrame& frame = swapchainFrames[imageIndex];
+	return raymarchStepCounters;
+}
+
+void Engine::mark_input_sampled()
+{
+	inputTime = std::chrono::steady_clock::now();
+	inputPending = true;
+}
+
+const std::vector<double>& Engine::get_completed_latencies() const
+{
+	return completedLatencies;
+}
 
+Scene* Engine::get_scene()
+{
+	return scene;
+}
+
+vkUtil::AllocatorStats Engine::get_memory_stats() const
+{
+	return allocator.get_stats();
+}
+
+void Engine::prepare_frame(vkUtil::FrameContext& frame, Scene* scene)
+{
 	glm::vec3 eye{ 1.0f, 0.0f, -1.0f };
 	glm::vec3 center{ 0.0f, 0.0f, 0.0f };
 	glm::vec3 up{ 0.0f, 0.0f, -1.0f };
@@ -356,17 +881,307 @@ void Engine::prepare_frame(const uint32_t imageIndex, const Scene* scene)
 		sizeof(vkUtil::UBOData));
 
 	// Individual matricies are set here! 
-	uint32_t ii = 0; 
-	for (ii = 0; ii < scene->entities.size(); ii++)
+	// Only the ones whose transform changed since this frame context last wrote them,
+	// copied in runs straight from the transform system's packed matrices
+	TransformSystem& transforms = scene->transforms;
+
+	// One model slot per renderer, in draw list order so every batch's instances are contiguous
+	ComponentPool<MeshRenderer>& renderers = scene->registry.Pool<MeshRenderer>();
+	ComponentPool<Transform>& rendererTransforms = scene->registry.Pool<Transform>();
+	const std::vector<Entity>& rendererEntities = renderers.GetEntities();
+
+	size_t entityCount = renderers.Size();
+
+	frame.reserve_models(entityCount, device, physicalDevice, allocator);
+	frame.modelVersions.resize(entityCount, 0);
+
+	// buffers are only ever (re)allocated here, on the main thread: the allocator isn't thread safe.
+	// The draw list isn't built yet, but it never has more batches than there are renderers
+	if (settings.gpuCulling)
+	{
+		frame.reserve_batches(entityCount, device, physicalDevice, allocator);
+	}
+
+	frame.reserve_shapes(scene->registry.Pool<Shape>().Size(), device, physicalDevice, allocator);
+
+	// The frame's previous pre-pass is done with its cone depth image (its fence signaled), so it can be remade
+	// when the swapchain changed size
+	vk::Extent2D coneTiles{
+		(swapchainExtent.width + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE,
+		(swapchainExtent.height + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE };
+
+	if (frame.coneDepth.extent != coneTiles)
+	{
+		vkInit::destroy_cone_depth_image(device, allocator, frame.coneDepth);
+		frame.set_cone_depth(vkInit::make_cone_depth_image(device, allocator, swapchainExtent, debugMode));
+	}
+
+	// The draw list only depends on the renderers, so it's built while the transforms update,
+	// and the culling batch table is filled as soon as it's there
+	vkUtil::JobCounter drawListBuilt;
+	vkUtil::JobCounter cullingPrepared;
+
+	jobs.submit(drawListBuilt, [this, &renderers]()
+		{
+			vkUtil::build_draw_list(renderers.GetComponents(), drawList);
+		});
+
+	if (settings.gpuCulling)
+	{
+		jobs.submit_after(drawListBuilt, cullingPrepared, [this, &frame, scene]()
+			{
+				prepare_culling(frame, scene);
+			});
+	}
+
+	transforms.UpdateWorldMatrices(&jobs);
+
+	// Shapes only need their transforms, so they're packed alongside the model uploads
+	vkUtil::JobCounter shapesPrepared;
+
+	jobs.submit(shapesPrepared, [this, &frame, scene]()
+		{
+			prepare_shapes(frame, scene);
+		});
+
+	jobs.wait(drawListBuilt);
+
+	const glm::mat4* worldMatrices = transforms.GetWorldMatrices();
+	const uint64_t* versions = transforms.GetVersions();
+	glm::mat4* modelTransforms = static_cast<glm::mat4*>(frame.modelBufferWriteLocation);
+
+	// Every job gathers and copies the dirty runs of its own range of slots
+	uint32_t modelJobCount = static_cast<uint32_t>(
+		(entityCount + vkUtil::MODEL_SLOTS_PER_JOB - 1) / vkUtil::MODEL_SLOTS_PER_JOB);
+
+	if (modelRanges.size() < modelJobCount)
 	{
-		frame.modelTransforms[ii] = scene->entities[ii].info->transform->GetWorldMatrix();
+		modelRanges.resize(modelJobCount);
 	}
 
-	memcpy(frame.modelBufferWriteLocation,
-		frame.modelTransforms.data(),
-		sizeof(glm::mat4) * ii);
+	jobs.parallel_for(modelJobCount, [&](uint32_t job)
+		{
+			std::vector<vkUtil::ModelRange>& ranges = modelRanges[job];
+			ranges.clear();
+
+			size_t first = job * vkUtil::MODEL_SLOTS_PER_JOB;
+			size_t last = std::min(first + vkUtil::MODEL_SLOTS_PER_JOB, entityCount);
+
+			for (size_t ii = first; ii < last; ii++)
+			{
+				Entity entity = rendererEntities[drawList.instances[ii]];
+				uint32_t dense = transforms.GetDenseIndex(rendererTransforms.Get(entity).GetHandle());
+
+				if (frame.modelVersions[ii] == versions[dense])
+				{
+					continue;
+				}
+
+				frame.modelVersions[ii] = versions[dense];
+
+				uint32_t slot = static_cast<uint32_t>(ii);
+
+				if (!ranges.empty()
+					&& ranges.back().first + ranges.back().count == slot
+					&& ranges.back().source + ranges.back().count == dense)
+				{
+					ranges.back().count++;
+				}
+				else
+				{
+					ranges.push_back({ slot, dense, 1 });
+				}
+			}
+
+			for (const vkUtil::ModelRange& range : ranges)
+			{
+				memcpy(modelTransforms + range.first, worldMatrices + range.source, sizeof(glm::mat4) * range.count);
+			}
+		});
+
+	jobs.wait(cullingPrepared);
+	jobs.wait(shapesPrepared);
 
-	frame.fill_descriptor_set(device);
+	frame.update_descriptor_set(device);
+}
+
+// Batch table, zeroed indirect draws and frustum planes for cull.comp
+void Engine::prepare_culling(vkUtil::FrameContext& frame, Scene* scene)
+{
+	// prepare_frame reserved room for every renderer in a batch of its own
+	size_t batchCount = drawList.batches.size();
+
+	vkUtil::CullBatch* cullBatches = static_cast<vkUtil::CullBatch*>(frame.cullBatchWriteLocation);
+
+	vkUtil::DrawCommandHeader* header = static_cast<vkUtil::DrawCommandHeader*>(frame.drawCommandWriteLocation);
+	vk::DrawIndirectCommand* drawCommands = reinterpret_cast<vk::DrawIndirectCommand*>(header + 1);
+
+	header->drawCount = static_cast<uint32_t>(batchCount);
+
+	for (size_t ii = 0; ii < batchCount; ii++)
+	{
+		const vkUtil::DrawBatch& batch = drawList.batches[ii];
+		std::pair<size_t, size_t> offset_size = scene->lookupOffsetSize(batch.key.meshType);
+
+		vkUtil::CullBatch& cullBatch = cullBatches[ii];
+		cullBatch.boundingSphere = scene->lookupBounds(batch.key.meshType);
+		cullBatch.firstVertex = static_cast<uint32_t>(offset_size.first);
+		cullBatch.vertexCount = static_cast<uint32_t>(offset_size.second);
+		cullBatch.firstInstance = batch.firstInstance;
+		cullBatch.instanceCount = batch.instanceCount;
+
+		// cull.comp counts the survivors up from 0
+		vk::DrawIndirectCommand& drawCommand = drawCommands[ii];
+		drawCommand.vertexCount = cullBatch.vertexCount;
+		drawCommand.instanceCount = 0;
+		drawCommand.firstVertex = cullBatch.firstVertex;
+		drawCommand.firstInstance = batch.firstInstance;
+	}
+
+	// Frustum planes from the rows of the view projection (Gribb & Hartmann)
+	// prepare_frame's projection maps depth to -1..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE isn't defined), hence w + z for near
+	glm::mat4 m = glm::transpose(frame.camData.viewProjection);
+
+	std::array<glm::vec4, 6>& planes = frame.cullParameters.frustumPlanes;
+	planes[0] = m[3] + m[0]; // left
+	planes[1] = m[3] - m[0]; // right
+	planes[2] = m[3] + m[1]; // bottom
+	planes[3] = m[3] - m[1]; // top
+	planes[4] = m[3] + m[2]; // near
+	planes[5] = m[3] - m[2]; // far
+
+	for (glm::vec4& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	frame.cullParameters.instanceCount = static_cast<uint32_t>(drawList.instances.size());
+	frame.cullParameters.batchCount = static_cast<uint32_t>(batchCount);
+}
+
+// Repacks the shapes that changed and refits their BVH, then writes the records this frame's buffers are missing
+void Engine::prepare_shapes(vkUtil::FrameContext& frame, Scene* scene)
+{
+	// The frame's fence has signaled, so the counters its last commands added to are final
+	if (frame.stepCountersRecorded)
+	{
+		memcpy(&raymarchStepCounters, frame.stepCounterLocation, sizeof(vkUtil::RaymarchStepCounters));
+		memset(frame.stepCounterLocation, 0, sizeof(vkUtil::RaymarchStepCounters));
+		frame.stepCountersRecorded = false;
+	}
+
+	TransformSystem& transforms = scene->transforms;
+	ComponentPool<Shape>& shapes = scene->registry.Pool<Shape>();
+	ComponentPool<Transform>& shapeTransforms = scene->registry.Pool<Transform>();
+
+	size_t shapeCount = shapes.Size();
+
+	shapeTransformIndices.resize(shapeCount);
+
+	for (size_t ii = 0; ii < shapeCount; ii++)
+	{
+		Entity entity = shapes.GetEntities()[ii];
+		shapeTransformIndices[ii] = transforms.GetDenseIndex(shapeTransforms.Get(entity).GetHandle());
+	}
+
+	vkUtil::pack_shapes(shapes.GetComponents(), shapeTransformIndices,
+		transforms.GetWorldMatrices(), transforms.GetVersions(), shapeTable);
+
+	vkUtil::update_shape_bvh(shapeTable, shapeBvh);
+
+	vkUtil::write_stale_records(shapeTable.shapes, shapeTable.revisions, frame.shapeRevisions, frame.shapeWriteLocation);
+	vkUtil::write_stale_records(shapeBvh.nodes, shapeBvh.revisions, frame.bvhRevisions, frame.bvhWriteLocation);
+
+	const RaymarchSettings& raymarch = settings.raymarch;
+
+	// Brick map: the bricks around shapes that moved are baked by this frame,
+	// every frame after it samples them instead of walking the BVH
+	bool useBrickCache = raymarch.brickCache && deviceCapabilities.brickCache && shapeCount > 0;
+	frame.brickJobCount = 0;
+
+	if (useBrickCache)
+	{
+		frame.brickJobCount = static_cast<uint32_t>(vkUtil::update_brick_map(shapeTable, shapeBvh, brickMap));
+
+		if (frame.brickJobCount > 0)
+		{
+			memcpy(frame.brickJobLocation, brickMap.bakeJobs.data(), frame.brickJobCount * sizeof(vkUtil::BrickBakeJob));
+		}
+
+		if (frame.brickMapRevision != brickMap.revision)
+		{
+			memcpy(frame.brickIndirectionLocation, brickMap.slots.data(), brickMap.slots.size() * sizeof(uint32_t));
+			frame.brickMapRevision = brickMap.revision;
+		}
+
+		useBrickCache = !brickMap.overflowed;
+	}
+	else
+	{
+		vkUtil::reset_brick_map(brickMap);
+	}
+
+	glm::vec4 brickVolume(brickMap.volumeMin, brickMap.brickSize);
+
+	frame.brickBakeParameters.brickVolume = brickVolume;
+	frame.brickBakeParameters.shapeCount = static_cast<uint32_t>(shapeCount);
+
+	vkUtil::RaymarchPushConstants& parameters = frame.raymarchParameters;
+	parameters.resolution = glm::vec2(swapchainExtent.width, swapchainExtent.height);
+	parameters.shapeCount = static_cast<uint32_t>(shapeCount);
+	parameters.maxSteps = raymarch.maxSteps;
+	parameters.brickVolume = brickVolume;
+	parameters.maxDistance = raymarch.maxDistance;
+	parameters.hitEpsilon = raymarch.hitEpsilon;
+	parameters.relaxation = std::clamp(raymarch.relaxation, 1.0f, 1.99f);
+	parameters.fixedStep = raymarch.sphereTracing ? 0.0f : raymarch.fixedStep;
+	parameters.flags = 0;
+
+	if (raymarch.showSteps)
+	{
+		parameters.flags |= vkUtil::RAYMARCH_SHOW_STEPS;
+	}
+
+	if (raymarch.collectStepCounters && deviceCapabilities.fragmentStoresAndAtomics)
+	{
+		parameters.flags |= vkUtil::RAYMARCH_COLLECT_STEP_COUNTERS;
+	}
+
+	if (useBrickCache)
+	{
+		parameters.flags |= vkUtil::RAYMARCH_USE_BRICK_CACHE;
+	}
+
+	if (raymarch.conePrepass)
+	{
+		parameters.flags |= vkUtil::RAYMARCH_CONE_PREPASS;
+	}
+}
+
+void Engine::record_cull_commands(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame)
+{
+	gpuProfiler.begin_scope(commandBuffer, frameNum, "cull_pass");
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullLayout, 0, frame.cullDescriptorSet, nullptr);
+	commandBuffer.pushConstants(cullLayout, vk::ShaderStageFlagBits::eCompute,
+		0, sizeof(vkUtil::CullPushConstants), &frame.cullParameters);
+
+	uint32_t groupCount = (frame.cullParameters.instanceCount + vkUtil::CULL_WORKGROUP_SIZE - 1)
+		/ vkUtil::CULL_WORKGROUP_SIZE;
+	commandBuffer.dispatch(groupCount, 1, 1);
+
+	// The draws read the instance counts as indirect parameters, and the vertex shader the visible list
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+	gpuProfiler.end_scope(commandBuffer, frameNum);
 }
 
 void Engine::prepare_scene(const vk::CommandBuffer& commandBuffer)
@@ -374,7 +1189,239 @@ void Engine::prepare_scene(const vk::CommandBuffer& commandBuffer)
 	vk::Buffer vertexBuffers[] = { scene->getVertexBuffer() };
 	vk::DeviceSize offsets[] = { 0 };
 
-	commandBuffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+	commandBuffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
+}
+
+// Everything the scene's draws need bound, recorded into every command buffer that draws them
+void Engine::bind_scene_state(vk::CommandBuffer commandBuffer)
+{
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+	set_dynamic_state(commandBuffer);
+
+	commandBuffer.bindDescriptorSets(
+		vk::PipelineBindPoint::eGraphics,
+		layout,
+		0,
+		frameContexts[frameNum].descriptorSet,
+		nullptr
+	);
+
+	prepare_scene(commandBuffer);
+}
+
+// Viewport and scissor, dynamic in every graphics pipeline
+void Engine::set_dynamic_state(vk::CommandBuffer commandBuffer)
+{
+	vk::Viewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(swapchainExtent.width);
+	viewport.height = static_cast<float>(swapchainExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	commandBuffer.setViewport(0, 1, &viewport);
+
+	vk::Rect2D scissor = {};
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent = swapchainExtent;
+	commandBuffer.setScissor(0, 1, &scissor);
+}
+
+// One instanced draw per batch in [firstBatch, lastBatch) of the draw list
+void Engine::record_batches(vk::CommandBuffer commandBuffer, Scene* scene, size_t firstBatch, size_t lastBatch)
+{
+	for (size_t ii = firstBatch; ii < lastBatch; ii++)
+	{
+		const vkUtil::DrawBatch& batch = drawList.batches[ii];
+
+		std::pair<size_t, size_t> offset_size = scene->lookupOffsetSize(batch.key.meshType);
+
+		size_t offset = offset_size.first;
+		size_t vertexCount = offset_size.second;
+
+		commandBuffer.draw(vertexCount, batch.instanceCount, offset, batch.firstInstance);
+	}
+}
+
+/// <summary>
+/// Splits the draw list into contiguous runs of batches and records each run
+/// into its own secondary command buffer, on its own thread.
+/// </summary>
+/// <returns>Secondary command buffers recorded, to execute in order (0 when the list is too short to split)</returns>
+uint32_t Engine::record_secondary_draws(vkUtil::FrameContext& frame, uint32_t imageIndex, Scene* scene)
+{
+	size_t batchCount = drawList.batches.size();
+
+	uint32_t taskCount = static_cast<uint32_t>(std::min<size_t>(
+		frame.recordCommandBuffers.size(), batchCount / vkUtil::MIN_BATCHES_PER_RECORD_TASK));
+
+	if (taskCount < 2)
+	{
+		return 0;
+	}
+
+	jobs.parallel_for(taskCount, [&](uint32_t task)
+		{
+			vk::CommandBuffer commandBuffer = frame.recordCommandBuffers[task];
+
+			// The frame's fence has been waited on, nothing from this pool is still in flight
+			device.resetCommandPool(frame.recordCommandPools[task]);
+
+			begin_secondary(commandBuffer, imageIndex);
+
+			bind_scene_state(commandBuffer);
+			record_batches(commandBuffer, scene, batchCount * task / taskCount, batchCount * (task + 1) / taskCount);
+
+			try
+			{
+				commandBuffer.end();
+			}
+			catch (vk::SystemError err)
+			{
+				if (debugMode)
+				{
+					std::cout << "Failed to finish recording secondary command buffer " << task << " :/" << std::endl;
+				}
+			}
+		});
+
+	return taskCount;
+}
+
+// The secondaries continue the scene render pass, the primary begins it
+void Engine::begin_secondary(vk::CommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	vk::CommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapchainFrames[imageIndex].frameBuffer;
+
+	vk::CommandBufferBeginInfo beginInfo = {};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+		| vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	try
+	{
+		commandBuffer.begin(beginInfo);
+	}
+	catch (vk::SystemError err)
+	{
+		if (debugMode)
+		{
+			std::cout << "Failed to begin recording secondary command buffer :/" << std::endl;
+		}
+	}
+}
+
+// SDF shapes over whatever the scene pass drew so far, as one fullscreen triangle
+void Engine::record_raymarch(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame, Scene* scene)
+{
+	gpuProfiler.begin_scope(commandBuffer, frameNum, "raymarch_pass");
+
+	// The flag is only set when the device can run the counter variant (see prepare_shapes)
+	// Both layouts are built from the same set layout and push constants, so either binds the set below
+	bool countSteps = (frame.raymarchParameters.flags & vkUtil::RAYMARCH_COLLECT_STEP_COUNTERS) != 0;
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, countSteps ? raymarchCounterPipeline : raymarchPipeline);
+
+	set_dynamic_state(commandBuffer);
+	prepare_scene(commandBuffer);
+
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, raymarchLayout, 0,
+		frame.raymarchDescriptorSet, nullptr);
+	commandBuffer.pushConstants(raymarchLayout,
+		vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+		0, sizeof(vkUtil::RaymarchPushConstants), &frame.raymarchParameters);
+
+	std::pair<size_t, size_t> offset_size = scene->lookupOffsetSize(TRIANGLE_FULLSCREEN);
+	commandBuffer.draw(offset_size.second, 1, offset_size.first, 0);
+
+	gpuProfiler.end_scope(commandBuffer, frameNum);
+}
+
+void Engine::record_cone_prepass(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame)
+{
+	// Every texel is rewritten, so the old contents can go.
+	// The raymarch set expects the general layout even when the pre-pass is off
+	vk::ImageMemoryBarrier transition;
+	transition.srcAccessMask = vk::AccessFlags();
+	transition.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+	transition.oldLayout = vk::ImageLayout::eUndefined;
+	transition.newLayout = vk::ImageLayout::eGeneral;
+	transition.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	transition.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	transition.image = frame.coneDepth.image;
+	transition.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTopOfPipe,
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), nullptr, nullptr, transition);
+
+	if ((frame.raymarchParameters.flags & vkUtil::RAYMARCH_CONE_PREPASS) == 0)
+	{
+		return;
+	}
+
+	gpuProfiler.begin_scope(commandBuffer, frameNum, "cone_prepass");
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, conePrepassPipeline);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, conePrepassLayout, 0,
+		frame.raymarchDescriptorSet, nullptr);
+	commandBuffer.pushConstants(conePrepassLayout, vk::ShaderStageFlagBits::eCompute,
+		0, sizeof(vkUtil::RaymarchPushConstants), &frame.raymarchParameters);
+
+	// An invocation per tile, in CONE_TILE_SIZE^2 workgroups
+	uint32_t groupsX = (frame.coneDepth.extent.width + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE;
+	uint32_t groupsY = (frame.coneDepth.extent.height + vkUtil::CONE_TILE_SIZE - 1) / vkUtil::CONE_TILE_SIZE;
+	commandBuffer.dispatch(groupsX, groupsY, 1);
+
+	// The raymarch pass reads each pixel's tile
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eFragmentShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+	gpuProfiler.end_scope(commandBuffer, frameNum);
+}
+
+void Engine::record_brick_bake(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame)
+{
+	gpuProfiler.begin_scope(commandBuffer, frameNum, "brick_bake_pass");
+
+	// Earlier frames' raymarch passes may still be sampling the bricks whose slots are about to be rewritten
+	// (the barrier's first scope covers everything submitted before it on the queue)
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eFragmentShader,
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), nullptr, nullptr, nullptr);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, brickBakePipeline);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, brickBakeLayout, 0,
+		frame.brickBakeDescriptorSet, nullptr);
+	commandBuffer.pushConstants(brickBakeLayout, vk::ShaderStageFlagBits::eCompute,
+		0, sizeof(vkUtil::BrickBakePushConstants), &frame.brickBakeParameters);
+
+	// A workgroup per brick, an invocation per sample
+	commandBuffer.dispatch(frame.brickJobCount, 1, 1);
+
+	// The raymarch pass samples the atlas
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eFragmentShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+	gpuProfiler.end_scope(commandBuffer, frameNum);
 }
 
 void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, Scene* scene)
@@ -393,6 +1440,54 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 		}
 	}
 
+	// This is the first command buffer submitted for the frame
+	gpuProfiler.reset_queries(commandBuffer, frameNum);
+
+	// nothing to draw until the scene's vertex upload has landed
+	bool sceneReady = scene->isReady(uploadQueue);
+	bool culled = settings.gpuCulling && sceneReady && !drawList.batches.empty();
+
+	// The atlas lives in the general layout, sampled and written alike
+	if (!brickAtlasReady)
+	{
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlags();
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		barrier.oldLayout = vk::ImageLayout::eUndefined;
+		barrier.newLayout = vk::ImageLayout::eGeneral;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = brickAtlas.image;
+		barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTopOfPipe,
+			vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+			vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+		brickAtlasReady = true;
+	}
+
+	// Culling and brick baking are compute dispatches, so they go before the render pass
+	if (culled)
+	{
+		record_cull_commands(commandBuffer, frameContexts[frameNum]);
+	}
+
+	// Shapes come from host-visible buffers, no need to wait on the scene
+	if (frameContexts[frameNum].brickJobCount > 0)
+	{
+		record_brick_bake(commandBuffer, frameContexts[frameNum]);
+	}
+
+	// The raymarch pass starts its rays where the pre-pass says (same condition as the pass itself, below)
+	if (sceneReady && frameContexts[frameNum].raymarchParameters.shapeCount > 0)
+	{
+		record_cone_prepass(commandBuffer, frameContexts[frameNum]);
+	}
+
+	gpuProfiler.begin_scope(commandBuffer, frameNum, "scene_pass");
+
 	vk::RenderPassBeginInfo renderPassInfo = {};
 	renderPassInfo.renderPass = renderPass;
 	renderPassInfo.framebuffer = swapchainFrames[imageIndex].frameBuffer;
@@ -404,62 +1499,92 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 	renderPassInfo.clearValueCount = 1;
 	renderPassInfo.pClearValues = &clearColor;
 
-	commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
-
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-
-	commandBuffer.bindDescriptorSets(
-		vk::PipelineBindPoint::eGraphics,
-		layout,
-		0,
-		swapchainFrames[imageIndex].descriptorSet,
-		nullptr
-	);
-
-	prepare_scene(commandBuffer);
-
+	// Many CPU driven batches are split across the recording threads, everything else is recorded inline
+	uint32_t secondaryCount = (!culled && sceneReady) ? record_secondary_draws(frameContexts[frameNum], imageIndex, scene) : 0;
 
+	if (secondaryCount > 0)
+	{
+		commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
 
-	// Draw each shape and instance duplicates 
-	uint32_t i = 0;
-	while (i < scene->entities.size())
+		// in task order, so batches are still drawn in draw list order
+		commandBuffer.executeCommands(secondaryCount, frameContexts[frameNum].recordCommandBuffers.data());
+	}
+	else
 	{
-		auto entity = scene->entities[i];
-		std::pair<size_t, size_t> offset_size = scene->lookupOffsetSize(entity.meshType);
+		commandBuffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
 
-		size_t offset = offset_size.first;
-		size_t vertexCount = offset_size.second;
-		uint32_t startInstance = 0;
+		bind_scene_state(commandBuffer);
+	}
 
-		// TODO: Create a lookup table for amount of instances for a given type 
-		//		 instead of this brute foce search method. Combine scene and sceneData 
+	// GPU driven: the draws culling filled in, a constant amount of recording however many instances there are
+	if (culled)
+	{
+		vk::Buffer drawCommandBuffer = frameContexts[frameNum].drawCommandBuffer.buffer;
+		vk::DeviceSize commandOffset = sizeof(vkUtil::DrawCommandHeader);
+		uint32_t stride = sizeof(vk::DrawIndirectCommand);
+		uint32_t drawCount = static_cast<uint32_t>(drawList.batches.size());
 
-		// Search for amount of instances. Assume organized into groups 
-		uint32_t instanceCount = 0;
-		uint32_t ii = i;
-		for (ii = i + 1; ii < scene->entities.size(); ii++)
+		if (deviceCapabilities.drawIndirectCount)
 		{
-			// Iterate until you find entity with a different
-			// shape type. Then break. 
-
-			auto entityNeighbor = scene->entities[ii];
-
-			if (entityNeighbor.meshType != entity.meshType)
+			commandBuffer.drawIndirectCountKHR(drawCommandBuffer, commandOffset,
+				drawCommandBuffer, 0, drawCount, stride, dldi);
+		}
+		else if (deviceCapabilities.multiDrawIndirect)
+		{
+			commandBuffer.drawIndirect(drawCommandBuffer, commandOffset, drawCount, stride);
+		}
+		else
+		{
+			for (uint32_t ii = 0; ii < drawCount; ii++)
 			{
-				// Difference found 
-				break; 
+				commandBuffer.drawIndirect(drawCommandBuffer, commandOffset + ii * stride, 1, stride);
 			}
 		}
+	}
+	// CPU driven: one instanced draw per batch of the draw list built by prepare_frame
+	else if (sceneReady && secondaryCount == 0)
+	{
+		record_batches(commandBuffer, scene, 0, drawList.batches.size());
+	}
+
+	// Raymarched shapes go over the meshes
+	vkUtil::FrameContext& frame = frameContexts[frameNum];
+
+	if (sceneReady && frame.raymarchParameters.shapeCount > 0)
+	{
+		if (secondaryCount > 0)
+		{
+			begin_secondary(frame.overlayCommandBuffer, imageIndex);
+			record_raymarch(frame.overlayCommandBuffer, frame, scene);
+			frame.overlayCommandBuffer.end();
 
-		instanceCount = ii; 
-		i += instanceCount;
+			commandBuffer.executeCommands(1, &frame.overlayCommandBuffer);
+		}
+		else
+		{
+			record_raymarch(commandBuffer, frame, scene);
+		}
 
-		commandBuffer.draw(vertexCount, instanceCount, offset, startInstance);
-		startInstance += instanceCount;
+		frame.stepCountersRecorded = (frame.raymarchParameters.flags & vkUtil::RAYMARCH_COLLECT_STEP_COUNTERS) != 0;
 	}
 	
 	commandBuffer.endRenderPass();
 
+	// Counter writes have to be made visible to the host before it reads them back
+	if (frame.stepCountersRecorded)
+	{
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(), barrier, nullptr, nullptr);
+	}
+
+	gpuProfiler.end_scope(commandBuffer, frameNum);
+
 
 	try
 	{
@@ -476,22 +1601,65 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 
 void Engine::render()
 {
-	device.waitForFences(1, &swapchainFrames[frameNum].inFlight, VK_TRUE, UINT64_MAX);
-	device.resetFences(1, &swapchainFrames[frameNum].inFlight);
+	if (headless)
+	{
+		render_headless();
+		return;
+	}
+
+	if (swapchainSettingsChanged)
+	{
+		swapchainSettingsChanged = false;
+		recreate_swapchain();
+	}
+
+	frameTimings = vkUtil::FrameTimings{};
+	vkUtil::CpuTimer timer;
+
+	vkUtil::FrameContext& frame = frameContexts[frameNum];
+
+	device.waitForFences(1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+
+	frameTimings[vkUtil::FramePhase::FENCE_WAIT] = timer.lap();
+
+	collect_latencies();
+	destroy_retired_swapchains(false);
 
 	// Acquire next image
 	uint32_t imageIndex;
 
 	// Using C-based functions because we don't want a try/catch overhead
-	VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, swapchainFrames[frameNum].imageAvailable, nullptr, &imageIndex);
+	VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.imageAvailable, nullptr, &imageIndex);
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	// Nothing was acquired, so the fence must stay signaled for the next attempt.
+	// A suboptimal image was acquired (and its semaphore will signal), so it's rendered
+	// and presented as usual and the swapchain is recreated after presenting
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
 		recreate_swapchain();
 		return;
 	}
 
-	VkCommandBuffer commandBuffer = swapchainFrames[frameNum].commandBuffer;
+	bool swapchainSuboptimal = (result == VK_SUBOPTIMAL_KHR);
+
+	// With more images than frames in flight, the image may still be in use by another frame context
+	vkUtil::SwapchainFrame& image = swapchainFrames[imageIndex];
+
+	if (image.inFlight && image.inFlight != frame.inFlight)
+	{
+		device.waitForFences(1, &image.inFlight, VK_TRUE, UINT64_MAX);
+	}
+
+	image.inFlight = frame.inFlight;
+
+	device.resetFences(1, &frame.inFlight);
+
+	frameTimings[vkUtil::FramePhase::ACQUIRE] = timer.lap();
+
+	// This frame slot's GPU work is done, so its timestamps can be read without stalling
+	gpuProfiler.begin_frame(frameNum);
+
+	VkCommandBuffer commandBuffer = frame.commandBuffer;
 
 	vkResetCommandBuffer(commandBuffer, 0);
 
@@ -505,21 +1673,28 @@ void Engine::render()
 	ImGui::Begin("Another Window");
 	ImGui::Text("Hello from another window!");
 	ImGui::End();
+	gpuProfiler.draw_imgui_panel();
+	draw_memory_panel();
+	draw_presentation_panel();
+	draw_raymarch_panel();
 	ImGui::Render();
 
 	// Imgui
 	{
-		vkResetCommandBuffer(swapchainFrames[frameNum].imguiCommandBuffer, 0);
+		vkResetCommandBuffer(frame.imguiCommandBuffer, 0);
 
 		vk::CommandBufferBeginInfo info{};
 		info.flags |= vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
-		swapchainFrames[frameNum].imguiCommandBuffer.begin(info);
+		frame.imguiCommandBuffer.begin(info);
 	}
+
+	gpuProfiler.begin_scope(frame.imguiCommandBuffer, frameNum, "imgui_pass");
+
 	{
 		vk::RenderPassBeginInfo info{};
 		info.renderPass = imguiRenderPass;
-		info.framebuffer = swapchainFrames[imageIndex].imguiFrameBuffer;
+		info.framebuffer = image.imguiFrameBuffer;
 		info.renderArea.extent.width = swapchainExtent.width;
 		info.renderArea.extent.height = swapchainExtent.height;
 		info.clearValueCount = 1;
@@ -527,26 +1702,33 @@ void Engine::render()
 		vk::ClearValue clearColor = { std::array<float, 4>{0.9f, 0.1f, 0.1f, 1.0f} };
 		info.pClearValues = &clearColor;
 
-		swapchainFrames[frameNum].imguiCommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
+		frame.imguiCommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
 	}
 
 	// Record Imgui Draw Data and draw funcs into command buffer
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), swapchainFrames[frameNum].imguiCommandBuffer);
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.imguiCommandBuffer);
 	// Submit command buffer
-	vkCmdEndRenderPass(swapchainFrames[frameNum].imguiCommandBuffer);
-	vkEndCommandBuffer(swapchainFrames[frameNum].imguiCommandBuffer);
+	vkCmdEndRenderPass(frame.imguiCommandBuffer);
+	gpuProfiler.end_scope(frame.imguiCommandBuffer, frameNum);
+	vkEndCommandBuffer(frame.imguiCommandBuffer);
 
+	frameTimings[vkUtil::FramePhase::IMGUI_BUILD] = timer.lap();
 
-	prepare_frame(imageIndex, scene);
+
+	prepare_frame(frame, scene);
+
+	frameTimings[vkUtil::FramePhase::PREPARE_FRAME] = timer.lap();
 
 	record_draw_commands(commandBuffer, imageIndex, scene);
 
+	frameTimings[vkUtil::FramePhase::RECORD_DRAW_COMMANDS] = timer.lap();
+
 	std::array<VkCommandBuffer, 2> submitCommandBuffers =
-	{ commandBuffer, swapchainFrames[imageIndex].imguiCommandBuffer };
+	{ commandBuffer, frame.imguiCommandBuffer };
 
 	VkSubmitInfo submitInfo{};
 
-	VkSemaphore waitSemaphores[] = { swapchainFrames[frameNum].imageAvailable };
+	VkSemaphore waitSemaphores[] = { frame.imageAvailable };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -558,11 +1740,11 @@ void Engine::render()
 	//submitInfo.pCommandBuffers = &commandBuffer;
 	submitInfo.pCommandBuffers = submitCommandBuffers.data();
 
-	VkSemaphore signalSemaphores[] = { swapchainFrames[frameNum].renderFinished };
+	VkSemaphore signalSemaphores[] = { image.renderFinished };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, swapchainFrames[frameNum].inFlight);
+	result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlight);
 
 	if (result != VK_SUCCESS)
 	{
@@ -572,6 +1754,14 @@ void Engine::render()
 		}
 	}
 
+	submittedFrameCount++;
+
+	frame.inputTime = inputTime;
+	frame.latencyPending = inputPending;
+	inputPending = false;
+
+	frameTimings[vkUtil::FramePhase::SUBMIT] = timer.lap();
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
@@ -583,15 +1773,255 @@ void Engine::render()
 
 	result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	frameTimings[vkUtil::FramePhase::PRESENT] = timer.lap();
+
+	limit_frame_rate();
+
+	frameTimings[vkUtil::FramePhase::FRAME_LIMIT] = timer.lap();
+	frameTimings.totalMs = timer.total();
+	jobStats = jobs.collect_stats();
+
+	frameNum = (frameNum + 1) % maxFramesInFlight;
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || swapchainSuboptimal)
 	{
 		recreate_swapchain();
-		return;
 	}
+}
+
+void Engine::draw_memory_panel()
+{
+	vkUtil::AllocatorStats stats = allocator.get_stats();
+
+	ImGui::Begin("GPU Memory");
+	ImGui::Text("Used: %.2f MB", stats.bytesUsed / (1024.0 * 1024.0));
+	ImGui::Text("Reserved: %.2f MB", stats.bytesReserved / (1024.0 * 1024.0));
+	ImGui::Text("Blocks: %u, Allocations: %u", stats.blockCount, stats.allocationCount);
+	ImGui::Text("Fragmentation: %.1f%%", stats.fragmentation * 100.0f);
+	ImGui::End();
+}
+
+void Engine::draw_presentation_panel()
+{
+	ImGui::Begin("Presentation");
+	ImGui::Text("Present mode: %s", vk::to_string(presentMode).c_str());
+	ImGui::Text("Swapchain images: %u (surface minimum %u)", imageCount, minImageCount);
+	ImGui::Text("Frames in flight: %d", maxFramesInFlight);
+
+	if (ImGui::BeginCombo("Policy", present_policy_name(settings.presentPolicy)))
+	{
+		for (size_t ii = 0; ii < PRESENT_POLICY_COUNT; ii++)
+		{
+			PresentPolicy policy = static_cast<PresentPolicy>(ii);
+
+			bool supported = std::find(supportedPresentModes.begin(), supportedPresentModes.end(),
+				present_policy_mode(policy)) != supportedPresentModes.end();
+
+			std::string label = present_policy_name(policy);
+			if (!supported)
+			{
+				label += " (unsupported, uses fifo)";
+			}
+
+			if (ImGui::Selectable(label.c_str(), policy == settings.presentPolicy))
+			{
+				set_present_policy(policy);
+			}
+		}
+
+		ImGui::EndCombo();
+	}
+
+	int requestedImageCount = static_cast<int>(settings.swapchainImageCount);
+	if (ImGui::InputInt("Image count (0 = auto)", &requestedImageCount))
+	{
+		set_swapchain_image_count(static_cast<uint32_t>(std::max(requestedImageCount, 0)));
+	}
+
+	float frameRateLimit = static_cast<float>(settings.frameRateLimit);
+	if (ImGui::InputFloat("FPS limit (0 = off)", &frameRateLimit, 10.0f, 60.0f, "%.0f"))
+	{
+		set_frame_rate_limit(std::max(static_cast<double>(frameRateLimit), 0.0));
+	}
+
+	ImGui::End();
+}
+
+void Engine::draw_raymarch_panel()
+{
+	RaymarchSettings raymarch = settings.raymarch;
+
+	ImGui::Begin("Raymarching");
+
+	ImGui::Checkbox("Sphere tracing", &raymarch.sphereTracing);
+
+	if (raymarch.sphereTracing)
+	{
+		ImGui::SliderFloat("Relaxation", &raymarch.relaxation, 1.0f, 1.99f);
+	}
+	else
+	{
+		ImGui::InputFloat("Step size", &raymarch.fixedStep, 0.001f, 0.01f, "%.4f");
+		raymarch.fixedStep = std::max(raymarch.fixedStep, 0.0001f);
+	}
+
+	int maxSteps = static_cast<int>(raymarch.maxSteps);
+	if (ImGui::SliderInt("Max steps", &maxSteps, 1, 1024))
+	{
+		raymarch.maxSteps = static_cast<uint32_t>(maxSteps);
+	}
+
+	ImGui::InputFloat("Max distance", &raymarch.maxDistance, 1.0f, 10.0f, "%.1f");
+	ImGui::InputFloat("Hit epsilon", &raymarch.hitEpsilon, 0.0001f, 0.001f, "%.5f");
+	raymarch.maxDistance = std::max(raymarch.maxDistance, 0.0f);
+	raymarch.hitEpsilon = std::max(raymarch.hitEpsilon, 0.0f);
+
+	ImGui::Checkbox("Cone pre-pass", &raymarch.conePrepass);
+	ImGui::Checkbox("Show steps", &raymarch.showSteps);
+
+	if (deviceCapabilities.fragmentStoresAndAtomics)
+	{
+		ImGui::Checkbox("Count steps", &raymarch.collectStepCounters);
+
+		if (raymarch.collectStepCounters && raymarchStepCounters.rayCount > 0)
+		{
+			ImGui::Text("Rays: %u, hits: %u", raymarchStepCounters.rayCount, raymarchStepCounters.hitCount);
+			ImGui::Text("Steps per ray: %.1f mean, %u max",
+				static_cast<double>(raymarchStepCounters.stepCount) / raymarchStepCounters.rayCount,
+				raymarchStepCounters.maxSteps);
+		}
+	}
+
+	if (deviceCapabilities.brickCache)
+	{
+		ImGui::Checkbox("Brick cache", &raymarch.brickCache);
+
+		if (raymarch.brickCache)
+		{
+			ImGui::Text("Bricks: %u / %u slots, %zu baked last frame", vkUtil::brick_map_used_slots(brickMap),
+				vkUtil::BRICK_ATLAS_CAPACITY, brickMap.bakeJobs.size());
+
+			if (brickMap.overflowed)
+			{
+				ImGui::Text("Atlas full, marching without the cache");
+			}
+		}
+	}
+
+	ImGui::End();
+
+	set_raymarch_settings(raymarch);
+}
+
+// Same as render(), minus the swapchain and imgui:
+// Offscreen frames are simply used round robin
+void Engine::render_headless()
+{
+	frameTimings = vkUtil::FrameTimings{};
+	vkUtil::CpuTimer timer;
+
+	vkUtil::FrameContext& frame = frameContexts[frameNum];
+
+	device.waitForFences(1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+	device.resetFences(1, &frame.inFlight);
+
+	frameTimings[vkUtil::FramePhase::FENCE_WAIT] = timer.lap();
+
+	collect_latencies();
+
+	gpuProfiler.begin_frame(frameNum);
+
+	uint32_t imageIndex = static_cast<uint32_t>(frameNum);
+
+	VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	prepare_frame(frame, scene);
+
+	frameTimings[vkUtil::FramePhase::PREPARE_FRAME] = timer.lap();
+
+	record_draw_commands(commandBuffer, imageIndex, scene);
+
+	frameTimings[vkUtil::FramePhase::RECORD_DRAW_COMMANDS] = timer.lap();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlight);
+
+	if (result != VK_SUCCESS)
+	{
+		if (debugMode)
+		{
+			std::cout << "Failed to submit draw command buffer :/" << std::endl;
+		}
+	}
+
+	submittedFrameCount++;
+
+	frame.inputTime = inputTime;
+	frame.latencyPending = inputPending;
+	inputPending = false;
+
+	frameTimings[vkUtil::FramePhase::SUBMIT] = timer.lap();
+
+	limit_frame_rate();
+
+	frameTimings[vkUtil::FramePhase::FRAME_LIMIT] = timer.lap();
+	frameTimings.totalMs = timer.total();
+	jobStats = jobs.collect_stats();
 
 	frameNum = (frameNum + 1) % maxFramesInFlight;
 }
 
+// A frame's latency is measured from mark_input_sampled() to the first time its fence is seen signaled.
+// That's exact while the CPU is waiting on the GPU, and an upper bound (by at most a frame) otherwise
+void Engine::collect_latencies()
+{
+	completedLatencies.clear();
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	for (vkUtil::FrameContext& context : frameContexts)
+	{
+		if (context.latencyPending && device.getFenceStatus(context.inFlight) == vk::Result::eSuccess)
+		{
+			completedLatencies.push_back(
+				std::chrono::duration<double, std::milli>(now - context.inputTime).count());
+			context.latencyPending = false;
+		}
+	}
+}
+
+// Sleeps at the end of a frame rather than the start, so input for the next frame is sampled
+// as late as possible
+void Engine::limit_frame_rate()
+{
+	if (settings.frameRateLimit <= 0.0)
+	{
+		return;
+	}
+
+	std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / settings.frameRateLimit));
+
+	nextFrameTime += period;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	// Running behind (or the limit was just turned on), don't try to catch up
+	if (nextFrameTime <= now)
+	{
+		nextFrameTime = now;
+		return;
+	}
+
+	std::this_thread::sleep_until(nextFrameTime);
+}
+
 // TODO: Should this go in descriptors.h?
 void Engine::create_imgui_descriptor_pool()
 {
@@ -726,12 +2156,14 @@ void Engine::init_imgui()
 	init_info.Device = device;
 	init_info.QueueFamily = graphicsQueueFamilyIdx;
 	init_info.Queue = graphicsQueue;
-	init_info.PipelineCache = VK_NULL_HANDLE;
+	init_info.PipelineCache = pipelineCache;
 	init_info.DescriptorPool = imguiDescriptorPool;
 	init_info.RenderPass = imguiRenderPass;
 	init_info.Subpass = 0;
 	init_info.MinImageCount = std::max(minImageCount, static_cast<uint32_t>(2));
-	init_info.ImageCount = imageCount;
+	// imgui keeps a vertex/index buffer per "image" and cycles through them every frame,
+	// so there must be at least one per frame in flight
+	init_info.ImageCount = std::max(imageCount, static_cast<uint32_t>(maxFramesInFlight));
 	init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 	init_info.Allocator = nullptr;
 
@@ -754,34 +2186,66 @@ void Engine::cleanup_imgui()
 
 void Engine::cleanup_swapchain()
 {
-	for (const auto& frame : swapchainFrames)
+	for (auto& frame : swapchainFrames)
 	{
 		device.destroyImageView(frame.imageView);
+
+		// offscreen images are ours to destroy
+		if (frame.imageAllocation.block)
+		{
+			device.destroyImage(frame.image);
+			allocator.free(frame.imageAllocation);
+		}
 		device.destroyFramebuffer(frame.frameBuffer);
 
 		// imgui
 		device.destroyFramebuffer(frame.imguiFrameBuffer);
 
-		//device.freeCommandBuffers(commandPool, 1, &frame.commandBuffer);
+		device.destroySemaphore(frame.renderFinished);
+	}
+
+	if (!headless)
+	{
+		device.destroySwapchainKHR(swapchain);
+	}
+
+	destroy_retired_swapchains(true);
+}
+
+void Engine::cleanup_frame_resources()
+{
+	for (auto& frame : frameContexts)
+	{
+		device.freeCommandBuffers(commandPool, 1, &frame.commandBuffer);
+
+		if (frame.imguiCommandBuffer)
+		{
+			device.freeCommandBuffers(imguiMainCommandPool, 1, &frame.imguiCommandBuffer);
+		}
+
+		// frees their secondary command buffers too
+		for (vk::CommandPool recordCommandPool : frame.recordCommandPools)
+		{
+			device.destroyCommandPool(recordCommandPool);
+		}
 
 		device.destroySemaphore(frame.imageAvailable);
-		device.destroySemaphore(frame.renderFinished);
 		device.destroyFence(frame.inFlight);
 
-		device.unmapMemory(frame.camDataBuffer.bufferMemory);
-		device.freeMemory(frame.camDataBuffer.bufferMemory);
-		device.destroyBuffer(frame.camDataBuffer.buffer);
+		frame.destroy_descriptor_resources(device, allocator);
 
-		device.unmapMemory(frame.modelBuffer.bufferMemory);
-		device.freeMemory(frame.modelBuffer.bufferMemory);
-		device.destroyBuffer(frame.modelBuffer.buffer);
+		vkInit::destroy_cone_depth_image(device, allocator, frame.coneDepth);
 	}
 
-	device.destroySwapchainKHR(swapchain);
-
 	device.destroyDescriptorPool(descriptorPool);
 
-	cleanup_imgui();
+	device.destroyDescriptorPool(cullDescriptorPool);
+
+	device.destroyDescriptorPool(raymarchDescriptorPool);
+
+	device.destroyDescriptorPool(brickBakeDescriptorPool);
+
+	vkInit::destroy_brick_atlas(device, allocator, brickAtlas);
 }
 
 void Engine::cleanup_pipeline()
@@ -790,6 +2254,23 @@ void Engine::cleanup_pipeline()
 	device.destroyPipelineLayout(layout);
 	device.destroyRenderPass(renderPass);
 
+	// null when GPU culling is off, which destroy accepts
+	device.destroyPipeline(cullPipeline);
+	device.destroyPipelineLayout(cullLayout);
+
+	device.destroyPipeline(raymarchPipeline);
+	device.destroyPipelineLayout(raymarchLayout);
+
+	// null without fragmentStoresAndAtomics
+	device.destroyPipeline(raymarchCounterPipeline);
+	device.destroyPipelineLayout(raymarchCounterLayout);
+
+	device.destroyPipeline(brickBakePipeline);
+	device.destroyPipelineLayout(brickBakeLayout);
+
+	device.destroyPipeline(conePrepassPipeline);
+	device.destroyPipelineLayout(conePrepassLayout);
+
 	device.destroyRenderPass(imguiRenderPass);
 }
 
@@ -797,6 +2278,8 @@ Engine::~Engine()
 {
 	device.waitIdle(); // wait until device is idle
 
+	jobs.destroy();
+
 	if (debugMode)
 	{
 		std::cout << "Bye!\n";
@@ -806,15 +2289,43 @@ Engine::~Engine()
 
 	cleanup_swapchain();
 
+	cleanup_frame_resources();
+
+	if (!headless)
+	{
+		cleanup_imgui();
+	}
+
 	device.destroyCommandPool(commandPool);
 
+	gpuProfiler.destroy();
+
+	if (!settings.pipelineCacheFile.empty())
+	{
+		vkInit::save_pipeline_cache(device, pipelineCache, settings.pipelineCacheFile, debugMode);
+	}
+
+	device.destroyPipelineCache(pipelineCache);
+
 	device.destroyDescriptorSetLayout(descriptorSetLayout);
 
-	scene->cleanup(device);
+	device.destroyDescriptorSetLayout(cullDescriptorSetLayout);
+	device.destroyDescriptorSetLayout(raymarchDescriptorSetLayout);
+	device.destroyDescriptorSetLayout(brickBakeDescriptorSetLayout);
+
+	uploadQueue.destroy();
+
+	scene->cleanup(device, allocator);
+
+	allocator.destroy();
 
 	device.destroy();
 
-	instance.destroySurfaceKHR(surface);
+	if (!headless)
+	{
+		instance.destroySurfaceKHR(surface);
+	}
+
 	if (debugMode)
 	{
 		instance.destroyDebugUtilsMessengerEXT(debugMessenger, nullptr, dldi);
@@ -822,5 +2333,5 @@ Engine::~Engine()
 
 	instance.destroy();
 
-	glfwTerminate();
+	// glfw belongs to whoever initialized it (and made the window), the engine only borrows the window
 }
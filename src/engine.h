@@ -3,23 +3,76 @@
 #include "config.h"
 
 #include "frame.h"
+#include "render_structs.h"
 
 #include "scene.h"
+#include "draw_list.h"
+#include "sdf_scene.h"
+#include "brick_map.h"
+#include "job_system.h"
+#include "settings.h"
+
+#include "timing.h"
+#include "gpu_profiler.h"
 
 
 class Engine
 {
 public:
-	Engine(int width, int height, GLFWwindow* window, const char* appName, bool debugMode);
+	Engine(int width, int height, GLFWwindow* window, const char* appName, bool debugMode,
+		const EngineSettings& settings = EngineSettings());
+
+	// Headless engine: renders into offscreen images, no glfw window or swapchain needed
+	Engine(int width, int height, const char* appName, bool debugMode,
+		const EngineSettings& settings = EngineSettings());
 
 	~Engine();
 
 	void render();
 
+	// CPU time of the last rendered frame, split by phase
+	const vkUtil::FrameTimings& get_frame_timings() const;
+
+	// Job system counters over the last rendered frame
+	const vkUtil::JobStats& get_job_stats() const;
+
+	// GPU time per scope, from the most recent frame whose results were read back
+	const std::vector<vkUtil::GpuScopeTiming>& get_gpu_timings() const;
+
+	const vkUtil::StartupTimings& get_startup_timings() const;
+
+	// Presentation options, applied from the next frame on
+	void set_present_policy(PresentPolicy policy);
+	void set_swapchain_image_count(uint32_t count);
+	void set_frame_rate_limit(double framesPerSecond);
+	const EngineSettings& get_settings() const;
+
+	// Raymarch options, applied from the next frame on
+	void set_raymarch_settings(const RaymarchSettings& raymarchSettings);
+
+	// Raymarch step counts of the most recent frame whose counters were read back
+	// (all zero unless RaymarchSettings::collectStepCounters is on and the device supports it)
+	const vkUtil::RaymarchStepCounters& get_raymarch_step_counters() const;
+
+	// Call right after polling input, the next rendered frame then reports
+	// the time from this call until its GPU work completed
+	void mark_input_sampled();
+
+	// Input latencies (ms) of the frames found complete during the last render()
+	const std::vector<double>& get_completed_latencies() const;
+
+	Scene* get_scene();
+
+	vkUtil::AllocatorStats get_memory_stats() const;
+
 private:
 	// TODO: Update variable/function naming conventions to be more organized and consistent
 
 	bool debugMode;
+	EngineSettings settings;
+
+	// headless engines render offscreen, without a window, surface or swapchain
+	bool headless;
 
 	// glfw window params
 	int width;
@@ -45,10 +98,19 @@ private:
 	// Device related variables
 	vk::PhysicalDevice physicalDevice{ nullptr };
 	vk::Device device{ nullptr };
+	vkUtil::DeviceCapabilities deviceCapabilities;
 	vk::Queue graphicsQueue{ nullptr };
 	vk::Queue presentQueue{ nullptr };
 	uint32_t graphicsQueueFamilyIdx;
 
+	// Async uploads, on a dedicated transfer queue when there is one
+	vk::Queue transferQueue{ nullptr };
+	uint32_t transferQueueFamilyIdx;
+	vkUtil::UploadQueue uploadQueue;
+
+	// GPU memory
+	vkUtil::MemoryAllocator allocator;
+
 	// Swapchain
 	vk::SwapchainKHR swapchain;
 	std::vector<vkUtil::SwapchainFrame> swapchainFrames;
@@ -56,22 +118,62 @@ private:
 	vk::Extent2D swapchainExtent;
 	uint32_t minImageCount;
 	uint32_t imageCount;
+	vk::PresentModeKHR presentMode;
+	std::vector<vk::PresentModeKHR> supportedPresentModes;
+
+	// set when a presentation option changes, the swapchain is rebuilt before the next frame
+	bool swapchainSettingsChanged;
+
+	// Replaced swapchains, destroyed once no submitted frame can reference them
+	std::vector<vkUtil::RetiredSwapchain> retiredSwapchains;
 
 
 	// general
 	const char *appName;
 
 	// pipeline-related variables
+	vk::PipelineCache pipelineCache;
 	vk::PipelineLayout layout;
 	vk::RenderPass renderPass;
 	vk::Pipeline pipeline;
 
+	// GPU culling (only made when settings.gpuCulling is set)
+	vk::DescriptorSetLayout cullDescriptorSetLayout;
+	vk::DescriptorPool cullDescriptorPool;
+	vk::PipelineLayout cullLayout;
+	vk::Pipeline cullPipeline;
+
+	// Raymarched SDF shapes, drawn over the meshes
+	vk::DescriptorSetLayout raymarchDescriptorSetLayout;
+	vk::DescriptorPool raymarchDescriptorPool;
+	vk::PipelineLayout raymarchLayout;
+	vk::Pipeline raymarchPipeline;
+
+	// Same pass, built from the shader variant that adds up step counters
+	// (only made when the device has fragmentStoresAndAtomics, the default variant never writes the buffer)
+	vk::PipelineLayout raymarchCounterLayout;
+	vk::Pipeline raymarchCounterPipeline;
+
+	// Bakes the brick map's distance samples (only made when the device can write the atlas)
+	vk::DescriptorSetLayout brickBakeDescriptorSetLayout;
+	vk::DescriptorPool brickBakeDescriptorPool;
+	vk::PipelineLayout brickBakeLayout;
+	vk::Pipeline brickBakePipeline;
+
+	// Cone marches screen tiles ahead of the raymarch pass, with the raymarch set
+	vk::PipelineLayout conePrepassLayout;
+	vk::Pipeline conePrepassPipeline;
+
 	// command-related variables
 	vk::CommandPool commandPool;
 	vk::CommandBuffer mainCommandBuffer;
 
+	// frame contexts, cycled through by frameNum
+	std::vector<vkUtil::FrameContext> frameContexts;
+
 	// sync-related variables
 	int maxFramesInFlight, frameNum;
+	uint64_t submittedFrameCount;
 
 	// Descriptor-related variables
 	vk::DescriptorSetLayout descriptorSetLayout;
@@ -89,38 +191,108 @@ private:
 
 	Scene* scene;
 
+	// profiling
+	vkUtil::FrameTimings frameTimings;
+	vkUtil::StartupTimings startupTimings;
+
+	// dirty model matrix runs gathered by prepare_frame, one list per job, kept around to reuse their storage
+	std::vector<std::vector<vkUtil::ModelRange>> modelRanges;
+
+	// instanced draws of the frame being prepared, built by prepare_frame
+	// model slots follow its instance order
+	vkUtil::DrawList drawList;
+
+	// the scene's shapes packed for the raymarch pass, and scratch for packing them
+	vkUtil::ShapeTable shapeTable;
+	std::vector<uint32_t> shapeTransformIndices;
+
+	// BVH over shapeTable, the raymarch pass walks it instead of testing every shape
+	vkUtil::ShapeBvh shapeBvh;
+
+	// Distance field cache over the shapes (RaymarchSettings::brickCache),
+	// baked into the atlas, which is moved to the general layout by the first recorded frame
+	vkUtil::BrickMap brickMap;
+	vkUtil::BrickAtlas brickAtlas;
+	bool brickAtlasReady;
+
+	vkUtil::RaymarchStepCounters raymarchStepCounters{};
+
+	// Frame work (transforms, draw list, culling prep, draw recording) runs as jobs
+	vkUtil::JobSystem jobs;
+	vkUtil::JobStats jobStats;
+
+	// frame limiter
+	std::chrono::steady_clock::time_point nextFrameTime;
+
+	// input latency
+	std::chrono::steady_clock::time_point inputTime;
+	bool inputPending;
+	std::vector<double> completedLatencies;
+	vkUtil::GpuProfiler gpuProfiler;
+
 	// instance setup
 	void make_instance();
 
 	// device setup
 	void make_swapchain();
 	void recreate_swapchain();
+	void retire_swapchain();
+	void destroy_retired_swapchains(bool force);
 	void make_device();
 
 	// pipeline setup
+	void make_pipeline_cache();
 	void make_descriptor_set_layout();
 	void make_pipeline();
+	void make_cull_descriptor_set_layout();
+	void make_cull_pipeline();
+	void make_raymarch_descriptor_set_layout();
+	void make_raymarch_pipeline();
+	void make_brick_bake_descriptor_set_layout();
+	void make_brick_bake_pipeline();
+	void make_cone_prepass_pipeline();
 
 	void make_framebuffers();
+	void make_swapchain_sync();
 	void make_frame_resources();
 	void finalize_setup();
 
 	void make_assets();
 	void prepare_scene(const vk::CommandBuffer& commandBuffer);
-	void prepare_frame(const uint32_t imageIndex, const Scene* scene);
+	void bind_scene_state(vk::CommandBuffer commandBuffer);
+	void set_dynamic_state(vk::CommandBuffer commandBuffer);
+	void prepare_frame(vkUtil::FrameContext& frame, Scene* scene);
+	void prepare_culling(vkUtil::FrameContext& frame, Scene* scene);
+	void prepare_shapes(vkUtil::FrameContext& frame, Scene* scene);
 
+	void record_cull_commands(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame);
 	void record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, Scene* scene);
+	void record_batches(vk::CommandBuffer commandBuffer, Scene* scene, size_t firstBatch, size_t lastBatch);
+	uint32_t record_secondary_draws(vkUtil::FrameContext& frame, uint32_t imageIndex, Scene* scene);
+	void record_brick_bake(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame);
+	void record_cone_prepass(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame);
+	void record_raymarch(vk::CommandBuffer commandBuffer, vkUtil::FrameContext& frame, Scene* scene);
+	void begin_secondary(vk::CommandBuffer commandBuffer, uint32_t imageIndex);
+
+	void render_headless();
+
+	void collect_latencies();
+	void limit_frame_rate();
 
 
 	// ImGui Helpers
 	void init_imgui();
 	void create_imgui_descriptor_pool();
 	void create_imgui_renderpass();
+	void draw_memory_panel();
+	void draw_presentation_panel();
+	void draw_raymarch_panel();
 	vk::CommandPool createImguiCommandPool(vk::CommandPoolCreateFlags flags);
 	std::vector<vk::CommandBuffer> createCommandBuffers(uint32_t commandBufferCount, vk::CommandPool& commandPool);
 
 	// cleanup
 	void cleanup_imgui();
 	void cleanup_swapchain();
+	void cleanup_frame_resources();
 	void cleanup_pipeline();
 };
\ No newline at end of file
@@ -2,9 +2,77 @@
 
 #include "config.h"
 #include "buffers.h"
+#include "sdf_scene.h"
+#include "brick_map.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
 
 namespace vkUtil
 {
+	// Descriptor set bindings, as laid out by Engine::make_descriptor_set_layout
+	constexpr uint32_t CAMERA_BINDING = 0;
+	constexpr uint32_t MODEL_BINDING = 1;
+	constexpr uint32_t VISIBLE_BINDING = 2;
+
+	// Culling descriptor set bindings, as laid out by Engine::make_cull_descriptor_set_layout
+	constexpr uint32_t CULL_MODEL_BINDING = 0;
+	constexpr uint32_t CULL_BATCH_BINDING = 1;
+	constexpr uint32_t CULL_DRAW_BINDING = 2;
+	constexpr uint32_t CULL_VISIBLE_BINDING = 3;
+
+	// Raymarch descriptor set bindings, as laid out by Engine::make_raymarch_descriptor_set_layout
+	constexpr uint32_t RAYMARCH_SHAPE_BINDING = 0;
+	constexpr uint32_t RAYMARCH_BVH_BINDING = 1;
+	constexpr uint32_t RAYMARCH_STEP_COUNTER_BINDING = 2;
+	constexpr uint32_t RAYMARCH_BRICK_ATLAS_BINDING = 3;
+	constexpr uint32_t RAYMARCH_BRICK_INDIRECTION_BINDING = 4;
+	constexpr uint32_t RAYMARCH_CONE_DEPTH_BINDING = 5;
+
+	// Screen tiles of the cone marching pre-pass are this many pixels on a side (local_size of cone_prepass.comp too)
+	constexpr uint32_t CONE_TILE_SIZE = 8;
+
+	// Brick baking descriptor set bindings, as laid out by Engine::make_brick_bake_descriptor_set_layout
+	// (shapes and BVH match the raymarch set, so both passes share their declarations)
+	constexpr uint32_t BRICK_BAKE_SHAPE_BINDING = 0;
+	constexpr uint32_t BRICK_BAKE_BVH_BINDING = 1;
+	constexpr uint32_t BRICK_BAKE_ATLAS_BINDING = 2;
+	constexpr uint32_t BRICK_BAKE_JOB_BINDING = 3;
+
+	// RaymarchPushConstants::flags
+	constexpr uint32_t RAYMARCH_SHOW_STEPS = 1u << 0;
+	constexpr uint32_t RAYMARCH_COLLECT_STEP_COUNTERS = 1u << 1;
+	constexpr uint32_t RAYMARCH_USE_BRICK_CACHE = 1u << 2;
+	constexpr uint32_t RAYMARCH_CONE_PREPASS = 1u << 3;
+
+	// Model matrices each frame's storage buffer starts out with room for
+	constexpr size_t INITIAL_MODEL_CAPACITY = 1024;
+
+	// Draw batches each frame's batch and indirect command buffers start out with room for
+	constexpr size_t INITIAL_BATCH_CAPACITY = 16;
+
+	// SDF shapes each frame's shape buffer starts out with room for
+	constexpr size_t INITIAL_SHAPE_CAPACITY = 64;
+
+	// Instances culled per compute workgroup (local_size_x in cull.comp)
+	constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+
+	// Fewest draw batches worth handing to a recording thread of their own,
+	// below that the secondary command buffer costs more than it saves
+	constexpr uint32_t MIN_BATCHES_PER_RECORD_TASK = 256;
+
+	// Model slots each of prepare_frame's upload jobs checks and copies
+	constexpr size_t MODEL_SLOTS_PER_JOB = 16384;
+
+	// A run of model matrices to write: slots [first, first + count) of the model buffer,
+	// from [source, source + count) of the scene's packed world matrices
+	struct ModelRange
+	{
+		uint32_t first;
+		uint32_t source;
+		uint32_t count;
+	};
+
 	struct UBOData
 	{
 		glm::mat4 view;
@@ -12,6 +80,98 @@ namespace vkUtil
 		glm::mat4 viewProjection;
 	};
 
+	// One draw batch, as read by cull.comp (std430)
+	struct CullBatch
+	{
+		// Mesh bounds: xyz = center, w = radius (negative = never culled)
+		glm::vec4 boundingSphere;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	// Start of the indirect command buffer: the draw count read by drawIndirectCount,
+	// padded so the VkDrawIndirectCommands after it stay 16 byte aligned
+	struct DrawCommandHeader
+	{
+		uint32_t drawCount;
+		uint32_t padding[3];
+	};
+
+	// Push constants of cull.comp
+	struct CullPushConstants
+	{
+		// World space frustum planes (xyz = normal pointing inwards, w = distance)
+		std::array<glm::vec4, 6> frustumPlanes;
+		uint32_t instanceCount;
+		uint32_t batchCount;
+	};
+
+	// Push constants of the raymarch shaders, filled from RaymarchSettings
+	struct RaymarchPushConstants
+	{
+		// framebuffer size in pixels
+		glm::vec2 resolution;
+		uint32_t shapeCount;
+
+		uint32_t maxSteps;
+
+		// brick map volume: xyz its lowest corner, w the width of a brick
+		glm::vec4 brickVolume;
+
+		float maxDistance;
+		float hitEpsilon;
+		float relaxation;
+
+		// 0 when sphere tracing
+		float fixedStep;
+
+		uint32_t flags;
+	};
+
+	// Push constants of brick_bake.comp
+	struct BrickBakePushConstants
+	{
+		// same as RaymarchPushConstants::brickVolume
+		glm::vec4 brickVolume;
+		uint32_t shapeCount;
+	};
+
+	// The baked distance bricks, one 3D image shared by every frame context.
+	// It stays in the general layout, sampled by the raymarch pass and written by the bake pass
+	struct BrickAtlas
+	{
+		vk::Image image;
+		Allocation allocation;
+		vk::ImageView view;
+		vk::Sampler sampler;
+	};
+
+	// Distance from the eye each screen tile's rays can safely skip, one texel per CONE_TILE_SIZE^2 pixels.
+	// Rewritten by every frame's pre-pass, so each frame context has its own, sized to the swapchain
+	struct ConeDepthImage
+	{
+		vk::Image image;
+		Allocation allocation;
+		vk::ImageView view;
+
+		// in tiles, 0 until made
+		vk::Extent2D extent{ 0, 0 };
+	};
+
+	// Step counts over every raymarched pixel of a frame (std430), added up by the raymarch shader
+	struct RaymarchStepCounters
+	{
+		uint32_t rayCount;
+		uint32_t hitCount;
+		uint32_t stepCount;
+
+		// most steps any ray took
+		uint32_t maxSteps;
+	};
+
+	// One swapchain (or offscreen) image and what's built on top of it
 	struct SwapchainFrame
 	{
 		// swapchain
@@ -19,38 +179,146 @@ namespace vkUtil
 		vk::ImageView imageView;
 		vk::Framebuffer frameBuffer;
 
-		vk::CommandBuffer commandBuffer;
+		// offscreen (headless) images own their memory, swapchain images don't
+		Allocation imageAllocation;
 
 		// imgui
 		vk::Framebuffer imguiFrameBuffer;
+
+		// Signaled when rendering to this image is done, waited on by present.
+		// Per image rather than per frame, since it's only safe to reuse once the image is re-acquired
+		vk::Semaphore renderFinished;
+
+		// Fence of the frame context that last rendered to this image (not owned)
+		vk::Fence inFlight;
+	};
+
+	// Everything the CPU needs to record and submit one frame.
+	// The engine cycles through a fixed ring of these, independently of the swapchain image count
+	struct FrameContext
+	{
+		vk::CommandBuffer commandBuffer;
+
+		// imgui
 		vk::CommandBuffer imguiCommandBuffer;
 
+		// multithreaded recording: a pool and a secondary command buffer per recording task,
+		// each pool is reset whole once the frame's fence has been waited on
+		std::vector<vk::CommandPool> recordCommandPools;
+		std::vector<vk::CommandBuffer> recordCommandBuffers;
+
+		// passes that follow the draws (e.g. raymarching), recorded on the calling thread
+		// once the draws are, from the first recording pool
+		vk::CommandBuffer overlayCommandBuffer;
+
 		// sync-related variables
-		vk::Semaphore imageAvailable, renderFinished;
+		vk::Semaphore imageAvailable;
 		vk::Fence inFlight;
 
+		// latency tracking: when the input this frame was built from was sampled
+		std::chrono::steady_clock::time_point inputTime;
+		bool latencyPending = false;
+
 		// resources
 		UBOData camData;
 		BufferData camDataBuffer;
 		void* camDataWriteLocation;
 
-		// TODO: Can we make this an array?
-		std::vector<glm::mat4> modelTransforms;
+		// model matrices are written straight into the (mapped) storage buffer
 		BufferData modelBuffer;
 		void* modelBufferWriteLocation;
+		size_t modelCapacity = 0;
+
+		// Transform version last written to each model slot (0 = never written)
+		std::vector<uint64_t> modelVersions;
+
+		// GPU culling
+		CullPushConstants cullParameters;
+
+		// visible instances: model slots that survived culling, compacted per batch
+		// (written by cull.comp, read by the vertex shader)
+		BufferData visibleBuffer;
+
+		// batch table and indirect draws, rewritten by the CPU every frame
+		// (cull.comp only bumps instance counts)
+		BufferData cullBatchBuffer;
+		void* cullBatchWriteLocation;
+		BufferData drawCommandBuffer;
+		void* drawCommandWriteLocation;
+		size_t batchCapacity = 0;
+
+		// Raymarching
+		RaymarchPushConstants raymarchParameters;
+
+		// SDF shapes, written straight into the (mapped) buffer from the engine's ShapeTable
+		BufferData shapeBuffer;
+		void* shapeWriteLocation;
+		size_t shapeCapacity = 0;
+
+		// ShapeTable revision last written to each record (0 = never written)
+		std::vector<uint64_t> shapeRevisions;
+
+		// BVH over the shapes, written the same way from the engine's ShapeBvh
+		BufferData bvhBuffer;
+		void* bvhWriteLocation;
+		size_t bvhCapacity = 0;
+		std::vector<uint64_t> bvhRevisions;
+
+		// Step counters, read back once the frame's fence signals
+		BufferData stepCounterBuffer;
+		void* stepCounterLocation;
+
+		// set when the frame's commands add to the counters
+		bool stepCountersRecorded = false;
+
+		// Brick map: the frame's copy of its indirection table (BrickMap::slots), rewritten when the map's revision moves on,
+		// and the bricks it bakes (at most one per atlas slot)
+		BufferData brickIndirectionBuffer;
+		void* brickIndirectionLocation;
+		uint64_t brickMapRevision = 0;
+		BufferData brickJobBuffer;
+		void* brickJobLocation;
+		uint32_t brickJobCount = 0;
+		BrickBakePushConstants brickBakeParameters;
+
+		// written by the cone marching pre-pass, where the raymarch pass starts its rays
+		ConeDepthImage coneDepth;
 
 		// resource descriptors
 		vk::DescriptorBufferInfo uniformBufferDescriptor;
 		vk::DescriptorBufferInfo modelBufferDescriptor;
+		vk::DescriptorBufferInfo visibleBufferDescriptor;
+		vk::DescriptorBufferInfo cullBatchBufferDescriptor;
+		vk::DescriptorBufferInfo drawCommandBufferDescriptor;
+		vk::DescriptorBufferInfo shapeBufferDescriptor;
+		vk::DescriptorBufferInfo bvhBufferDescriptor;
+		vk::DescriptorBufferInfo stepCounterBufferDescriptor;
+		vk::DescriptorBufferInfo brickIndirectionBufferDescriptor;
+		vk::DescriptorBufferInfo brickJobBufferDescriptor;
+
+		// the engine's brick atlas, sampled and as a storage image
+		vk::DescriptorImageInfo brickAtlasDescriptor;
+		vk::DescriptorImageInfo brickAtlasStorageDescriptor;
+		vk::DescriptorImageInfo coneDepthDescriptor;
 
 		vk::DescriptorSet descriptorSet;
+		vk::DescriptorSet cullDescriptorSet;
+		vk::DescriptorSet raymarchDescriptorSet;
+		vk::DescriptorSet brickBakeDescriptorSet;
+
+		// One bit per binding whose buffer changed since the set was last written
+		uint32_t dirtyBindings = 0;
+		uint32_t cullDirtyBindings = 0;
+		uint32_t raymarchDirtyBindings = 0;
+		uint32_t brickBakeDirtyBindings = 0;
 
 		void make_descriptor_resources(const vk::Device& logicalDevice,
-			vk::PhysicalDevice& physicalDevice)
+			vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator)
 		{
 			vkUtil::BufferInput input;
 			input.logicalDevice = logicalDevice;
 			input.physicalDevice = physicalDevice;
+			input.allocator = &allocator;
 			input.size = sizeof(UBOData);
 			input.usage = vk::BufferUsageFlagBits::eUniformBuffer;
 			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent
@@ -58,59 +326,477 @@ namespace vkUtil
 
 			camDataBuffer = create_buffer(input);
 
-			camDataWriteLocation = logicalDevice.mapMemory(camDataBuffer.bufferMemory,
-									0, input.size);
+			// host visible allocations are persistently mapped
+			camDataWriteLocation = camDataBuffer.allocation.mappedData;
+
+			uniformBufferDescriptor.buffer = camDataBuffer.buffer;
+			uniformBufferDescriptor.offset = 0;
+			uniformBufferDescriptor.range = sizeof(UBOData);
 
-			// Storage buffer
-			// TODO: Should we avoid hard coding the "1024"
-			size_t maxBufferSize = 1024;
+			mark_binding_dirty(CAMERA_BINDING);
 
-			input.size = maxBufferSize * sizeof(glm::mat4);
+			input.size = sizeof(RaymarchStepCounters);
 			input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
-			modelBuffer = create_buffer(input);
 
-			modelBufferWriteLocation = logicalDevice.mapMemory(modelBuffer.bufferMemory,
-				0, input.size);
+			stepCounterBuffer = create_buffer(input);
+			stepCounterLocation = stepCounterBuffer.allocation.mappedData;
+			memset(stepCounterLocation, 0, sizeof(RaymarchStepCounters));
 
-			// Initialize <maxBufferSize> identity matrices
-			modelTransforms.resize(maxBufferSize);
+			stepCounterBufferDescriptor.buffer = stepCounterBuffer.buffer;
+			stepCounterBufferDescriptor.offset = 0;
+			stepCounterBufferDescriptor.range = sizeof(RaymarchStepCounters);
 
-			uniformBufferDescriptor.buffer = camDataBuffer.buffer;
-			uniformBufferDescriptor.offset = 0;
-			uniformBufferDescriptor.range = sizeof(UBOData);
+			mark_raymarch_binding_dirty(RAYMARCH_STEP_COUNTER_BINDING);
+
+			input.size = BRICK_GRID_SIZE * BRICK_GRID_SIZE * BRICK_GRID_SIZE * sizeof(uint32_t);
+
+			brickIndirectionBuffer = create_buffer(input);
+			brickIndirectionLocation = brickIndirectionBuffer.allocation.mappedData;
+
+			brickIndirectionBufferDescriptor.buffer = brickIndirectionBuffer.buffer;
+			brickIndirectionBufferDescriptor.offset = 0;
+			brickIndirectionBufferDescriptor.range = input.size;
+
+			mark_raymarch_binding_dirty(RAYMARCH_BRICK_INDIRECTION_BINDING);
+
+			input.size = BRICK_ATLAS_CAPACITY * sizeof(BrickBakeJob);
+
+			brickJobBuffer = create_buffer(input);
+			brickJobLocation = brickJobBuffer.allocation.mappedData;
+
+			brickJobBufferDescriptor.buffer = brickJobBuffer.buffer;
+			brickJobBufferDescriptor.offset = 0;
+			brickJobBufferDescriptor.range = input.size;
+
+			mark_brick_bake_binding_dirty(BRICK_BAKE_JOB_BINDING);
+
+			// Storage buffers
+			reserve_models(INITIAL_MODEL_CAPACITY, logicalDevice, physicalDevice, allocator);
+			reserve_batches(INITIAL_BATCH_CAPACITY, logicalDevice, physicalDevice, allocator);
+			reserve_shapes(INITIAL_SHAPE_CAPACITY, logicalDevice, physicalDevice, allocator);
+		}
+
+		// Grows the model storage buffer (geometrically) to hold at least <count> matrices.
+		// The frame's fence must have signaled: the old buffer is destroyed right away,
+		// which is safe since only this frame's command buffers ever read it
+		// Returns true when the buffer was reallocated (and its contents lost)
+		bool reserve_models(size_t count, const vk::Device& logicalDevice,
+			vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator)
+		{
+			if (count <= modelCapacity)
+			{
+				return false;
+			}
+
+			size_t newCapacity = std::max(count, modelCapacity * 2);
+
+			if (modelBuffer.buffer)
+			{
+				destroy_buffer(logicalDevice, allocator, modelBuffer);
+			}
+
+			vkUtil::BufferInput input;
+			input.logicalDevice = logicalDevice;
+			input.physicalDevice = physicalDevice;
+			input.allocator = &allocator;
+			input.size = newCapacity * sizeof(glm::mat4);
+			input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent
+				| vk::MemoryPropertyFlagBits::eHostVisible;
+
+			modelBuffer = create_buffer(input);
+			modelBufferWriteLocation = modelBuffer.allocation.mappedData;
+			modelCapacity = newCapacity;
+
+			// nothing in the new buffer is current
+			std::fill(modelVersions.begin(), modelVersions.end(), 0);
 
 			modelBufferDescriptor.buffer = modelBuffer.buffer;
 			modelBufferDescriptor.offset = 0;
-			modelBufferDescriptor.range = maxBufferSize * sizeof(glm::mat4);
+			modelBufferDescriptor.range = newCapacity * sizeof(glm::mat4);
+
+			// one visible instance per model slot at most
+			if (visibleBuffer.buffer)
+			{
+				destroy_buffer(logicalDevice, allocator, visibleBuffer);
+			}
+
+			input.size = newCapacity * sizeof(uint32_t);
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+			visibleBuffer = create_buffer(input);
+
+			visibleBufferDescriptor.buffer = visibleBuffer.buffer;
+			visibleBufferDescriptor.offset = 0;
+			visibleBufferDescriptor.range = newCapacity * sizeof(uint32_t);
+
+			mark_binding_dirty(MODEL_BINDING);
+			mark_binding_dirty(VISIBLE_BINDING);
+			mark_cull_binding_dirty(CULL_MODEL_BINDING);
+			mark_cull_binding_dirty(CULL_VISIBLE_BINDING);
+
+			return true;
 		}
 
-		void fill_descriptor_set(const vk::Device& logicalDevice)
+		// Grows the batch table and indirect command buffers (geometrically) to hold at least <count> batches.
+		// Same rules as reserve_models
+		bool reserve_batches(size_t count, const vk::Device& logicalDevice,
+			vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator)
 		{
+			if (count <= batchCapacity)
 			{
-				vk::WriteDescriptorSet writeInfo;
-				writeInfo.descriptorCount = 1;
-				writeInfo.descriptorType = vk::DescriptorType::eUniformBuffer;
-				writeInfo.dstSet = descriptorSet;
-				writeInfo.dstBinding = 0;
-				writeInfo.dstArrayElement = 0;
-				writeInfo.pBufferInfo = &uniformBufferDescriptor;
+				return false;
+			}
+
+			size_t newCapacity = std::max(count, batchCapacity * 2);
+
+			if (cullBatchBuffer.buffer)
+			{
+				destroy_buffer(logicalDevice, allocator, cullBatchBuffer);
+				destroy_buffer(logicalDevice, allocator, drawCommandBuffer);
+			}
+
+			vkUtil::BufferInput input;
+			input.logicalDevice = logicalDevice;
+			input.physicalDevice = physicalDevice;
+			input.allocator = &allocator;
+			input.size = newCapacity * sizeof(CullBatch);
+			input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent
+				| vk::MemoryPropertyFlagBits::eHostVisible;
+
+			cullBatchBuffer = create_buffer(input);
+			cullBatchWriteLocation = cullBatchBuffer.allocation.mappedData;
+
+			input.size = sizeof(DrawCommandHeader) + newCapacity * sizeof(vk::DrawIndirectCommand);
+			input.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer;
+
+			drawCommandBuffer = create_buffer(input);
+			drawCommandWriteLocation = drawCommandBuffer.allocation.mappedData;
+
+			batchCapacity = newCapacity;
+
+			cullBatchBufferDescriptor.buffer = cullBatchBuffer.buffer;
+			cullBatchBufferDescriptor.offset = 0;
+			cullBatchBufferDescriptor.range = newCapacity * sizeof(CullBatch);
 
-				logicalDevice.updateDescriptorSets(writeInfo, nullptr);
+			drawCommandBufferDescriptor.buffer = drawCommandBuffer.buffer;
+			drawCommandBufferDescriptor.offset = 0;
+			drawCommandBufferDescriptor.range = input.size;
+
+			mark_cull_binding_dirty(CULL_BATCH_BINDING);
+			mark_cull_binding_dirty(CULL_DRAW_BINDING);
+
+			return true;
+		}
+
+		// Grows the SDF shape buffer (geometrically) to hold at least <count> shapes.
+		// Same rules as reserve_models
+		bool reserve_shapes(size_t count, const vk::Device& logicalDevice,
+			vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator)
+		{
+			if (count <= shapeCapacity)
+			{
+				return false;
 			}
-			
+
+			size_t newCapacity = std::max(count, shapeCapacity * 2);
+
+			if (shapeBuffer.buffer)
 			{
-				vk::WriteDescriptorSet writeInfo;
+				destroy_buffer(logicalDevice, allocator, shapeBuffer);
+			}
+
+			vkUtil::BufferInput input;
+			input.logicalDevice = logicalDevice;
+			input.physicalDevice = physicalDevice;
+			input.allocator = &allocator;
+			input.size = newCapacity * sizeof(SdfShape);
+			input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent
+				| vk::MemoryPropertyFlagBits::eHostVisible;
+
+			shapeBuffer = create_buffer(input);
+			shapeWriteLocation = shapeBuffer.allocation.mappedData;
+			shapeCapacity = newCapacity;
+
+			// nothing in the new buffer is current
+			std::fill(shapeRevisions.begin(), shapeRevisions.end(), 0);
+
+			shapeBufferDescriptor.buffer = shapeBuffer.buffer;
+			shapeBufferDescriptor.offset = 0;
+			shapeBufferDescriptor.range = input.size;
+
+			mark_raymarch_binding_dirty(RAYMARCH_SHAPE_BINDING);
+			mark_brick_bake_binding_dirty(BRICK_BAKE_SHAPE_BINDING);
+
+			// a BVH over n shapes has n leaves and n - 1 inner nodes
+			reserve_bvh_nodes(2 * newCapacity - 1, logicalDevice, physicalDevice, allocator);
+
+			return true;
+		}
+
+		// Grows the shape BVH buffer (geometrically) to hold at least <count> nodes.
+		// Same rules as reserve_models, reserve_shapes calls it
+		bool reserve_bvh_nodes(size_t count, const vk::Device& logicalDevice,
+			vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator)
+		{
+			if (count <= bvhCapacity)
+			{
+				return false;
+			}
+
+			size_t newCapacity = std::max(count, bvhCapacity * 2);
+
+			if (bvhBuffer.buffer)
+			{
+				destroy_buffer(logicalDevice, allocator, bvhBuffer);
+			}
+
+			vkUtil::BufferInput input;
+			input.logicalDevice = logicalDevice;
+			input.physicalDevice = physicalDevice;
+			input.allocator = &allocator;
+			input.size = newCapacity * sizeof(SdfBvhNode);
+			input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent
+				| vk::MemoryPropertyFlagBits::eHostVisible;
+
+			bvhBuffer = create_buffer(input);
+			bvhWriteLocation = bvhBuffer.allocation.mappedData;
+			bvhCapacity = newCapacity;
+
+			std::fill(bvhRevisions.begin(), bvhRevisions.end(), 0);
+
+			bvhBufferDescriptor.buffer = bvhBuffer.buffer;
+			bvhBufferDescriptor.offset = 0;
+			bvhBufferDescriptor.range = input.size;
+
+			mark_raymarch_binding_dirty(RAYMARCH_BVH_BINDING);
+			mark_brick_bake_binding_dirty(BRICK_BAKE_BVH_BINDING);
+
+			return true;
+		}
+
+		void mark_binding_dirty(uint32_t binding)
+		{
+			dirtyBindings |= 1u << binding;
+		}
+
+		void mark_cull_binding_dirty(uint32_t binding)
+		{
+			cullDirtyBindings |= 1u << binding;
+		}
+
+		void mark_raymarch_binding_dirty(uint32_t binding)
+		{
+			raymarchDirtyBindings |= 1u << binding;
+		}
+
+		void mark_brick_bake_binding_dirty(uint32_t binding)
+		{
+			brickBakeDirtyBindings |= 1u << binding;
+		}
+
+		// Points the raymarch set at the frame's (re)made cone depth image
+		void set_cone_depth(const ConeDepthImage& image)
+		{
+			coneDepth = image;
+
+			coneDepthDescriptor.imageView = image.view;
+			coneDepthDescriptor.imageLayout = vk::ImageLayout::eGeneral;
+
+			mark_raymarch_binding_dirty(RAYMARCH_CONE_DEPTH_BINDING);
+		}
+
+		// Points the sets at the engine's brick atlas
+		void set_brick_atlas(const BrickAtlas& atlas)
+		{
+			brickAtlasDescriptor.sampler = atlas.sampler;
+			brickAtlasDescriptor.imageView = atlas.view;
+			brickAtlasDescriptor.imageLayout = vk::ImageLayout::eGeneral;
+
+			brickAtlasStorageDescriptor.imageView = atlas.view;
+			brickAtlasStorageDescriptor.imageLayout = vk::ImageLayout::eGeneral;
+
+			mark_raymarch_binding_dirty(RAYMARCH_BRICK_ATLAS_BINDING);
+			mark_brick_bake_binding_dirty(BRICK_BAKE_ATLAS_BINDING);
+		}
+
+		void destroy_descriptor_resources(const vk::Device& logicalDevice, MemoryAllocator& allocator)
+		{
+			destroy_buffer(logicalDevice, allocator, camDataBuffer);
+			destroy_buffer(logicalDevice, allocator, modelBuffer);
+			destroy_buffer(logicalDevice, allocator, visibleBuffer);
+			destroy_buffer(logicalDevice, allocator, cullBatchBuffer);
+			destroy_buffer(logicalDevice, allocator, drawCommandBuffer);
+			destroy_buffer(logicalDevice, allocator, shapeBuffer);
+			destroy_buffer(logicalDevice, allocator, bvhBuffer);
+			destroy_buffer(logicalDevice, allocator, stepCounterBuffer);
+			destroy_buffer(logicalDevice, allocator, brickIndirectionBuffer);
+			destroy_buffer(logicalDevice, allocator, brickJobBuffer);
+
+			camDataWriteLocation = nullptr;
+			modelBufferWriteLocation = nullptr;
+			cullBatchWriteLocation = nullptr;
+			drawCommandWriteLocation = nullptr;
+			shapeWriteLocation = nullptr;
+			bvhWriteLocation = nullptr;
+			stepCounterLocation = nullptr;
+			brickIndirectionLocation = nullptr;
+			brickJobLocation = nullptr;
+			modelCapacity = 0;
+			batchCapacity = 0;
+			shapeCapacity = 0;
+			bvhCapacity = 0;
+			modelVersions.clear();
+			shapeRevisions.clear();
+			bvhRevisions.clear();
+		}
+
+		// Writes the bindings that changed (of every set), in a single update
+		// Only call this once the frame's fence has signaled, the sets must not be in use
+		void update_descriptor_set(const vk::Device& logicalDevice)
+		{
+			if (dirtyBindings == 0 && cullDirtyBindings == 0 && raymarchDirtyBindings == 0 && brickBakeDirtyBindings == 0)
+			{
+				return;
+			}
+
+			std::array<vk::WriteDescriptorSet, 16> writes;
+			uint32_t writeCount = 0;
+
+			auto write = [&](vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type,
+				const vk::DescriptorBufferInfo* bufferInfo, const vk::DescriptorImageInfo* imageInfo = nullptr)
+			{
+				vk::WriteDescriptorSet& writeInfo = writes[writeCount++];
 				writeInfo.descriptorCount = 1;
-				writeInfo.descriptorType = vk::DescriptorType::eStorageBuffer;
-				writeInfo.dstSet = descriptorSet;
-				writeInfo.dstBinding = 1;
+				writeInfo.descriptorType = type;
+				writeInfo.dstSet = set;
+				writeInfo.dstBinding = binding;
 
 				// byte offset within binding for inline uniform blocks
 				writeInfo.dstArrayElement = 0;
-				writeInfo.pBufferInfo = &modelBufferDescriptor;
+				writeInfo.pBufferInfo = bufferInfo;
+				writeInfo.pImageInfo = imageInfo;
+			};
+
+			if (dirtyBindings & (1u << CAMERA_BINDING))
+			{
+				write(descriptorSet, CAMERA_BINDING, vk::DescriptorType::eUniformBuffer, &uniformBufferDescriptor);
+			}
+
+			if (dirtyBindings & (1u << MODEL_BINDING))
+			{
+				write(descriptorSet, MODEL_BINDING, vk::DescriptorType::eStorageBuffer, &modelBufferDescriptor);
+			}
+
+			if (dirtyBindings & (1u << VISIBLE_BINDING))
+			{
+				write(descriptorSet, VISIBLE_BINDING, vk::DescriptorType::eStorageBuffer, &visibleBufferDescriptor);
+			}
+
+			// the culling set only exists when GPU culling is on
+			if (cullDescriptorSet)
+			{
+				if (cullDirtyBindings & (1u << CULL_MODEL_BINDING))
+				{
+					write(cullDescriptorSet, CULL_MODEL_BINDING, vk::DescriptorType::eStorageBuffer, &modelBufferDescriptor);
+				}
 
-				logicalDevice.updateDescriptorSets(writeInfo, nullptr);
+				if (cullDirtyBindings & (1u << CULL_BATCH_BINDING))
+				{
+					write(cullDescriptorSet, CULL_BATCH_BINDING, vk::DescriptorType::eStorageBuffer, &cullBatchBufferDescriptor);
+				}
+
+				if (cullDirtyBindings & (1u << CULL_DRAW_BINDING))
+				{
+					write(cullDescriptorSet, CULL_DRAW_BINDING, vk::DescriptorType::eStorageBuffer, &drawCommandBufferDescriptor);
+				}
+
+				if (cullDirtyBindings & (1u << CULL_VISIBLE_BINDING))
+				{
+					write(cullDescriptorSet, CULL_VISIBLE_BINDING, vk::DescriptorType::eStorageBuffer, &visibleBufferDescriptor);
+				}
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_SHAPE_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_SHAPE_BINDING, vk::DescriptorType::eStorageBuffer, &shapeBufferDescriptor);
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_BVH_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_BVH_BINDING, vk::DescriptorType::eStorageBuffer, &bvhBufferDescriptor);
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_STEP_COUNTER_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_STEP_COUNTER_BINDING, vk::DescriptorType::eStorageBuffer, &stepCounterBufferDescriptor);
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_BRICK_ATLAS_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_BRICK_ATLAS_BINDING, vk::DescriptorType::eCombinedImageSampler,
+					nullptr, &brickAtlasDescriptor);
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_BRICK_INDIRECTION_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_BRICK_INDIRECTION_BINDING, vk::DescriptorType::eStorageBuffer,
+					&brickIndirectionBufferDescriptor);
+			}
+
+			if (raymarchDirtyBindings & (1u << RAYMARCH_CONE_DEPTH_BINDING))
+			{
+				write(raymarchDescriptorSet, RAYMARCH_CONE_DEPTH_BINDING, vk::DescriptorType::eStorageImage,
+					nullptr, &coneDepthDescriptor);
+			}
+
+			// the bake set only exists when the device can write the atlas
+			if (brickBakeDescriptorSet)
+			{
+				if (brickBakeDirtyBindings & (1u << BRICK_BAKE_SHAPE_BINDING))
+				{
+					write(brickBakeDescriptorSet, BRICK_BAKE_SHAPE_BINDING, vk::DescriptorType::eStorageBuffer, &shapeBufferDescriptor);
+				}
+
+				if (brickBakeDirtyBindings & (1u << BRICK_BAKE_BVH_BINDING))
+				{
+					write(brickBakeDescriptorSet, BRICK_BAKE_BVH_BINDING, vk::DescriptorType::eStorageBuffer, &bvhBufferDescriptor);
+				}
+
+				if (brickBakeDirtyBindings & (1u << BRICK_BAKE_ATLAS_BINDING))
+				{
+					write(brickBakeDescriptorSet, BRICK_BAKE_ATLAS_BINDING, vk::DescriptorType::eStorageImage,
+						nullptr, &brickAtlasStorageDescriptor);
+				}
+
+				if (brickBakeDirtyBindings & (1u << BRICK_BAKE_JOB_BINDING))
+				{
+					write(brickBakeDescriptorSet, BRICK_BAKE_JOB_BINDING, vk::DescriptorType::eStorageBuffer, &brickJobBufferDescriptor);
+				}
 			}
+
+			logicalDevice.updateDescriptorSets(writeCount, writes.data(), 0, nullptr);
+
+			dirtyBindings = 0;
+			cullDirtyBindings = 0;
+			raymarchDirtyBindings = 0;
+			brickBakeDirtyBindings = 0;
 		}
 	};
+
+	// Objects made obsolete by a swapchain recreation
+	// Frames recorded before the recreation may still be using them
+	struct RetiredSwapchain
+	{
+		vk::SwapchainKHR swapchain;
+		std::vector<vk::ImageView> imageViews;
+		std::vector<vk::Framebuffer> framebuffers;
+		std::vector<vk::Semaphore> semaphores;
+
+		// Number of frames submitted when this was retired
+		uint64_t retiredAt;
+	};
 }
\ No newline at end of file
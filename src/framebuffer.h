@@ -51,6 +51,8 @@ namespace vkInit
 
 
 			// imgui framebuffer
+			// (headless engines have no imgui renderpass)
+			if (inputChunk.imguiRenderpass)
 			{
 				vk::ImageView attachment[1];
 
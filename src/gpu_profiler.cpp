@@ -0,0 +1,236 @@
+#include "gpu_profiler.h"
+
+#include "imgui/imgui.h"
+
+namespace vkUtil
+{
+	void GpuProfiler::init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice,
+		uint32_t queueFamilyIdx, uint32_t frameCount, bool debug)
+	{
+		this->device = device;
+		this->debug = debug;
+
+		vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+		std::vector<vk::QueueFamilyProperties> queueFamilies = physicalDevice.getQueueFamilyProperties();
+
+		uint32_t validBits = queueFamilies[queueFamilyIdx].timestampValidBits;
+		supported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+
+		if (!supported)
+		{
+			if (debug)
+			{
+				std::cout << "GPU timestamps are not supported on this queue, GPU profiling is disabled\n";
+			}
+
+			return;
+		}
+
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+
+		make_query_pool(frameCount);
+	}
+
+	void GpuProfiler::make_query_pool(uint32_t frameCount)
+	{
+		frames.clear();
+		frames.resize(frameCount);
+
+		vk::QueryPoolCreateInfo poolInfo = {};
+		poolInfo.queryType = vk::QueryType::eTimestamp;
+		poolInfo.queryCount = MAX_QUERIES_PER_FRAME * frameCount;
+
+		try
+		{
+			queryPool = device.createQueryPool(poolInfo);
+		}
+		catch (vk::SystemError err)
+		{
+			if (debug)
+			{
+				std::cout << "Failed to create timestamp query pool, GPU profiling is disabled\n";
+			}
+
+			supported = false;
+			queryPool = nullptr;
+		}
+	}
+
+	void GpuProfiler::destroy()
+	{
+		if (queryPool)
+		{
+			device.destroyQueryPool(queryPool);
+			queryPool = nullptr;
+		}
+	}
+
+	bool GpuProfiler::is_supported() const
+	{
+		return supported;
+	}
+
+	void GpuProfiler::begin_frame(uint32_t frameIndex)
+	{
+		latestTimings.clear();
+
+		if (!supported)
+		{
+			return;
+		}
+
+		FrameQueries& frame = frames[frameIndex];
+
+		if (frame.queryCount > 0)
+		{
+			// value + availability per query
+			std::vector<uint64_t> results(2 * frame.queryCount);
+			uint32_t firstQuery = frameIndex * MAX_QUERIES_PER_FRAME;
+
+			// No wait flag: the frame's fence has already signaled, and if a result
+			// somehow isn't available we'd rather drop it than stall
+			VkResult result = vkGetQueryPoolResults(device, queryPool, firstQuery, frame.queryCount,
+				results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+			if (result == VK_SUCCESS || result == VK_NOT_READY)
+			{
+				for (const Scope& scope : frame.scopes)
+				{
+					uint32_t start = scope.startQuery - firstQuery;
+					uint32_t end = scope.endQuery - firstQuery;
+
+					bool available = results[2 * start + 1] != 0 && results[2 * end + 1] != 0;
+
+					if (!available)
+					{
+						continue;
+					}
+
+					uint64_t ticks = ((results[2 * end] & timestampMask) - (results[2 * start] & timestampMask)) & timestampMask;
+					double ms = static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+
+					latestTimings.push_back(GpuScopeTiming{ scope.name, ms });
+					record_history(scope.name, static_cast<float>(ms));
+				}
+			}
+		}
+
+		frame.scopes.clear();
+		frame.openScopes.clear();
+		frame.queryCount = 0;
+	}
+
+	void GpuProfiler::reset_queries(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex)
+	{
+		if (!supported)
+		{
+			return;
+		}
+
+		commandBuffer.resetQueryPool(queryPool, frameIndex * MAX_QUERIES_PER_FRAME, MAX_QUERIES_PER_FRAME);
+	}
+
+	void GpuProfiler::begin_scope(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, const std::string& name)
+	{
+		if (!supported)
+		{
+			return;
+		}
+
+		FrameQueries& frame = frames[frameIndex];
+
+		// Out of queries: the scope (and its end) is dropped
+		if (frame.queryCount + 2 > MAX_QUERIES_PER_FRAME)
+		{
+			frame.openScopes.push_back(UINT32_MAX);
+			return;
+		}
+
+		uint32_t query = frameIndex * MAX_QUERIES_PER_FRAME + frame.queryCount;
+
+		// end query is reserved now, so the pair stays contiguous
+		frame.scopes.push_back(Scope{ name, query, query + 1 });
+		frame.openScopes.push_back(static_cast<uint32_t>(frame.scopes.size() - 1));
+		frame.queryCount += 2;
+
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, query);
+	}
+
+	void GpuProfiler::end_scope(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex)
+	{
+		if (!supported)
+		{
+			return;
+		}
+
+		FrameQueries& frame = frames[frameIndex];
+
+		if (frame.openScopes.empty())
+		{
+			return;
+		}
+
+		uint32_t scopeIdx = frame.openScopes.back();
+		frame.openScopes.pop_back();
+
+		if (scopeIdx == UINT32_MAX)
+		{
+			return;
+		}
+
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, frame.scopes[scopeIdx].endQuery);
+	}
+
+	const std::vector<GpuScopeTiming>& GpuProfiler::get_latest_timings() const
+	{
+		return latestTimings;
+	}
+
+	void GpuProfiler::record_history(const std::string& name, float ms)
+	{
+		History* history = nullptr;
+
+		for (History& h : histories)
+		{
+			if (h.name == name)
+			{
+				history = &h;
+				break;
+			}
+		}
+
+		if (!history)
+		{
+			histories.push_back(History{ name, std::vector<float>(HISTORY_LENGTH, 0.0f), 0, 0.0f });
+			history = &histories.back();
+		}
+
+		history->samples[history->offset] = ms;
+		history->offset = (history->offset + 1) % HISTORY_LENGTH;
+		history->latest = ms;
+	}
+
+	void GpuProfiler::draw_imgui_panel() const
+	{
+		ImGui::Begin("GPU Profiler");
+
+		if (!supported)
+		{
+			ImGui::Text("GPU timestamps are not supported on this device");
+		}
+
+		for (const History& history : histories)
+		{
+			std::string overlay = std::to_string(history.latest) + " ms";
+
+			ImGui::Text("%s", history.name.c_str());
+			ImGui::PlotLines(("##" + history.name).c_str(), history.samples.data(),
+				static_cast<int>(history.samples.size()), static_cast<int>(history.offset),
+				overlay.c_str(), 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+		}
+
+		ImGui::End();
+	}
+}
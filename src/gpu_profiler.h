@@ -0,0 +1,92 @@
+#pragma once
+
+#include "config.h"
+
+namespace vkUtil
+{
+	// GPU time of one named scope, in ms
+	struct GpuScopeTiming
+	{
+		std::string name;
+		double ms;
+	};
+
+	// Timestamp-query profiler
+	// Each frame slot owns a range of queries in one pool. A slot's results are
+	// read back the next time the slot comes around, right after its fence wait,
+	// so reading them never stalls.
+	class GpuProfiler
+	{
+	public:
+		// queries per frame slot (2 per scope)
+		static constexpr uint32_t MAX_QUERIES_PER_FRAME = 64;
+
+		// samples kept per scope for the imgui graphs
+		static constexpr uint32_t HISTORY_LENGTH = 120;
+
+		void init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice,
+			uint32_t queueFamilyIdx, uint32_t frameCount, bool debug);
+
+		void destroy();
+
+		bool is_supported() const;
+
+		// Call right after waiting on the frame's fence, before recording anything for it:
+		// harvests the slot's previous results and starts a fresh list of scopes
+		void begin_frame(uint32_t frameIndex);
+
+		// Must be recorded into the first command buffer submitted for the frame
+		void reset_queries(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex);
+
+		// Scopes may nest, and may be recorded into any command buffer of the frame,
+		// but only from the thread that drives render(): the scope lists and query indices aren't synchronized,
+		// so command buffers recorded by jobs (e.g. secondary draw batches) must not open scopes
+		void begin_scope(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, const std::string& name);
+		void end_scope(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex);
+
+		// Results harvested by the latest begin_frame() (empty if none were ready)
+		const std::vector<GpuScopeTiming>& get_latest_timings() const;
+
+		// Per-scope rolling history graphs
+		void draw_imgui_panel() const;
+
+	private:
+		struct Scope
+		{
+			std::string name;
+			uint32_t startQuery;
+			uint32_t endQuery;
+		};
+
+		struct FrameQueries
+		{
+			std::vector<Scope> scopes;
+			std::vector<uint32_t> openScopes;
+			uint32_t queryCount = 0;
+		};
+
+		struct History
+		{
+			std::string name;
+			std::vector<float> samples;
+			uint32_t offset = 0;
+			float latest = 0.0f;
+		};
+
+		vk::Device device;
+		vk::QueryPool queryPool;
+		std::vector<FrameQueries> frames;
+		bool supported = false;
+		bool debug = false;
+
+		// ns per timestamp tick
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ULL;
+
+		std::vector<GpuScopeTiming> latestTimings;
+		std::vector<History> histories;
+
+		void make_query_pool(uint32_t frameCount);
+		void record_history(const std::string& name, float ms);
+	};
+}
@@ -100,7 +100,7 @@ namespace vkInit
 
 
 	// Function to create Vulkan Instance
-	vk::Instance make_instance(bool debug, const char* appName)
+	vk::Instance make_instance(bool debug, bool headless, const char* appName)
 	{
 		if (debug)
 		{
@@ -143,11 +143,17 @@ namespace vkInit
 		// GLFW Extensions
 		// In Vulkan, we need to request everything explicitly
 		// We need to query which extensions glfw needs to interface with Vulkan
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		// Headless instances never create a surface, so glfw isn't involved at all
+		std::vector<const char*> extensions;
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		if (!headless)
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (debug)
 		{
@@ -0,0 +1,328 @@
+#include "job_system.h"
+
+#include <algorithm>
+
+namespace vkUtil
+{
+	// Queue of the calling thread, for threads the pool started
+	static thread_local const JobSystem* currentSystem = nullptr;
+	static thread_local uint32_t currentQueue = 0;
+
+	void JobSystem::init(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		stopping = false;
+		statsStart = std::chrono::steady_clock::now();
+
+		for (uint32_t ii = 0; ii < threadCount; ii++)
+		{
+			queues.push_back(std::make_unique<WorkerQueue>());
+		}
+
+		// the thread driving the pool is the first one
+		for (uint32_t ii = 1; ii < threadCount; ii++)
+		{
+			workers.emplace_back(&JobSystem::worker_loop, this, ii);
+		}
+	}
+
+	void JobSystem::destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+
+		sleepCondition.notify_all();
+
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+
+		workers.clear();
+
+		// Without workers, nobody else is left to run them
+		while (run_one(0));
+
+		queues.clear();
+	}
+
+	uint32_t JobSystem::get_thread_count() const
+	{
+		return static_cast<uint32_t>(queues.size());
+	}
+
+	void JobSystem::submit(JobCounter& counter, std::function<void()> job)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+		push(Job{ std::move(job), &counter });
+	}
+
+	void JobSystem::submit_after(JobCounter& dependency, JobCounter& counter, std::function<void()> job)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			// the dependency's last job finishes under this lock, so it can't slip past the check
+			std::lock_guard<std::mutex> lock(dependency.mutex);
+
+			if (dependency.pending.load(std::memory_order_acquire) > 0)
+			{
+				dependency.continuations.push_back(std::move(job));
+				dependency.continuationCounters.push_back(&counter);
+				return;
+			}
+		}
+
+		push(Job{ std::move(job), &counter });
+	}
+
+	void JobSystem::wait(JobCounter& counter)
+	{
+		uint32_t queue = current_queue();
+
+		while (counter.pending.load(std::memory_order_acquire) > 0)
+		{
+			// Nothing queued: the rest of the group is running on other threads
+			if (!run_one(queue))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		std::exception_ptr exception;
+
+		// Also waits for the thread that finished the last job to let go of the counter
+		{
+			std::lock_guard<std::mutex> lock(counter.mutex);
+			std::swap(exception, counter.exception);
+		}
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+	void JobSystem::parallel_for(uint32_t count, const std::function<void(uint32_t)>& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		JobCounter counter;
+
+		// The calling thread takes the first call itself, the rest are up for stealing
+		for (uint32_t ii = 1; ii < count; ii++)
+		{
+			submit(counter, [&function, ii]() { function(ii); });
+		}
+
+		try
+		{
+			function(0);
+		}
+		catch (...)
+		{
+			// the other calls still reference function, so they have to finish first
+			wait(counter);
+			throw;
+		}
+
+		wait(counter);
+	}
+
+	JobStats JobSystem::collect_stats()
+	{
+		JobStats stats;
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsedNs = std::chrono::duration<double, std::nano>(now - statsStart).count();
+		statsStart = now;
+
+		double busyNs = 0.0;
+
+		for (size_t ii = 0; ii < queues.size(); ii++)
+		{
+			WorkerQueue& queue = *queues[ii];
+
+			stats.jobsRun += queue.jobsRun.exchange(0, std::memory_order_relaxed);
+			stats.steals += queue.steals.exchange(0, std::memory_order_relaxed);
+
+			uint64_t queueBusyNs = queue.busyNs.exchange(0, std::memory_order_relaxed);
+
+			// The driving thread is never idle as far as the pool knows, only workers are counted
+			if (ii > 0)
+			{
+				busyNs += static_cast<double>(queueBusyNs);
+			}
+		}
+
+		double workerNs = elapsedNs * static_cast<double>(workers.size());
+		stats.idleMs = std::max(workerNs - busyNs, 0.0) / 1.0e6;
+
+		stats.peakQueueDepth = peakQueuedJobs.exchange(
+			queuedJobs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		return stats;
+	}
+
+	uint32_t JobSystem::current_queue() const
+	{
+		return currentSystem == this ? currentQueue : 0;
+	}
+
+	void JobSystem::push(Job job)
+	{
+		WorkerQueue& queue = *queues[current_queue()];
+
+		uint32_t depth;
+
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+			depth = queuedJobs.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+		uint32_t peak = peakQueuedJobs.load(std::memory_order_relaxed);
+
+		while (depth > peak && !peakQueuedJobs.compare_exchange_weak(peak, depth, std::memory_order_relaxed));
+
+		// Taking the lock orders this against a worker checking queuedJobs before it sleeps
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+
+		sleepCondition.notify_one();
+	}
+
+	bool JobSystem::pop(uint32_t queueIdx, Job& job)
+	{
+		// Own jobs newest first
+		{
+			WorkerQueue& queue = *queues[queueIdx];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (!queue.jobs.empty())
+			{
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+				queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+				return true;
+			}
+		}
+
+		// Then other threads' oldest jobs, starting from the next thread over so thieves spread out
+		for (size_t ii = 1; ii < queues.size(); ii++)
+		{
+			WorkerQueue& victim = *queues[(queueIdx + ii) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (!victim.jobs.empty())
+			{
+				job = std::move(victim.jobs.front());
+				victim.jobs.pop_front();
+				queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+				queues[queueIdx]->steals.fetch_add(1, std::memory_order_relaxed);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool JobSystem::run_one(uint32_t queueIdx)
+	{
+		Job job;
+
+		if (!pop(queueIdx, job))
+		{
+			return false;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		try
+		{
+			job.function();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(job.counter->mutex);
+
+			if (!job.counter->exception)
+			{
+				job.counter->exception = std::current_exception();
+			}
+		}
+
+		WorkerQueue& queue = *queues[queueIdx];
+		queue.jobsRun.fetch_add(1, std::memory_order_relaxed);
+		queue.busyNs.fetch_add(static_cast<uint64_t>(
+			std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()),
+			std::memory_order_relaxed);
+
+		finish(*job.counter);
+
+		return true;
+	}
+
+	void JobSystem::finish(JobCounter& counter)
+	{
+		std::vector<std::function<void()>> continuations;
+		std::vector<JobCounter*> continuationCounters;
+
+		{
+			std::lock_guard<std::mutex> lock(counter.mutex);
+
+			if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				continuations.swap(counter.continuations);
+				continuationCounters.swap(counter.continuationCounters);
+			}
+		}
+
+		// The counter may be gone by now, a waiter was free to return once the lock was let go
+		for (size_t ii = 0; ii < continuations.size(); ii++)
+		{
+			push(Job{ std::move(continuations[ii]), continuationCounters[ii] });
+		}
+	}
+
+	void JobSystem::worker_loop(uint32_t queueIdx)
+	{
+		currentSystem = this;
+		currentQueue = queueIdx;
+
+		while (true)
+		{
+			if (run_one(queueIdx))
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+
+			sleepCondition.wait(lock, [this]()
+				{
+					return stopping || queuedJobs.load(std::memory_order_relaxed) > 0;
+				});
+
+			// queued jobs are still finished when stopping
+			if (stopping && queuedJobs.load(std::memory_order_relaxed) == 0)
+			{
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vkUtil
+{
+	// Unfinished jobs of one group, wait() on it to join them.
+	// Jobs submitted with submit_after() run once the group is done
+	struct JobCounter
+	{
+		std::atomic<uint32_t> pending{ 0 };
+
+		// Guards the fields below, and is held while the last job of the group finishes
+		std::mutex mutex;
+
+		// Jobs waiting for this group, queued once it's done
+		std::vector<std::function<void()>> continuations;
+		std::vector<JobCounter*> continuationCounters;
+
+		// First exception a job of the group threw, rethrown by wait()
+		std::exception_ptr exception;
+	};
+
+	// Per-interval scheduler counters, see JobSystem::collect_stats()
+	struct JobStats
+	{
+		uint64_t jobsRun = 0;
+
+		// jobs a thread took from another thread's queue
+		uint64_t steals = 0;
+
+		// ms the threads spent without a job to run, summed over threads
+		double idleMs = 0.0;
+
+		// most jobs queued at once
+		uint32_t peakQueueDepth = 0;
+	};
+
+	// Work-stealing job scheduler.
+	// Every thread owns a deque: it pushes and pops its own jobs at the back (newest first,
+	// while their data is still in cache) and steals other threads' oldest jobs from the front.
+	// Threads waiting on jobs run queued jobs themselves instead of sleeping,
+	// so jobs may submit and wait on more jobs.
+	class JobSystem
+	{
+	public:
+		// threadCount counts the calling thread too, 0 uses every hardware thread
+		void init(uint32_t threadCount);
+
+		// Finishes the queued jobs, then joins the workers
+		void destroy();
+
+		// Worker threads plus the thread that drives the pool
+		uint32_t get_thread_count() const;
+
+		void submit(JobCounter& counter, std::function<void()> job);
+
+		// Queues job once every job of dependency is done, without blocking the caller.
+		// The job counts towards counter right away
+		void submit_after(JobCounter& dependency, JobCounter& counter, std::function<void()> job);
+
+		// Runs queued jobs on the calling thread until the counter's jobs are done
+		// Rethrows the first exception one of them threw
+		void wait(JobCounter& counter);
+
+		// Calls function(ii) for every ii in [0, count), spread over all threads,
+		// returns once every call has returned
+		void parallel_for(uint32_t count, const std::function<void(uint32_t)>& function);
+
+		// Counters since the previous call (or init), then starts counting afresh
+		JobStats collect_stats();
+
+	private:
+		struct Job
+		{
+			std::function<void()> function;
+			JobCounter* counter;
+		};
+
+		// One per thread, index 0 is shared by every thread outside the pool
+		struct alignas(64) WorkerQueue
+		{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+
+			std::atomic<uint64_t> jobsRun{ 0 };
+			std::atomic<uint64_t> steals{ 0 };
+			std::atomic<uint64_t> busyNs{ 0 };
+		};
+
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::vector<std::thread> workers;
+
+		// jobs in all queues, workers sleep while it's 0
+		std::atomic<uint32_t> queuedJobs{ 0 };
+		std::atomic<uint32_t> peakQueuedJobs{ 0 };
+
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+		bool stopping = false;
+
+		std::chrono::steady_clock::time_point statsStart;
+
+		uint32_t current_queue() const;
+		void push(Job job);
+		bool pop(uint32_t queue, Job& job);
+		bool run_one(uint32_t queue);
+		void finish(JobCounter& counter);
+		void worker_loop(uint32_t queue);
+	};
+}
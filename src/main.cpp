@@ -2,7 +2,80 @@
 
 int main(int argc, char** argv)
 {
-	App* hridizaApp = new App(1800, 1000, true);
+	App* hridizaApp;
+
+	EngineSettings settings;
+	bool headless = false;
+	uint32_t frameCount = 1;
+
+	for (int ii = 1; ii < argc; ii++)
+	{
+		bool hasValue = ii + 1 < argc;
+
+		// --headless <frames>: render offscreen without a window (e.g. on machines with no display)
+		if (strcmp(argv[ii], "--headless") == 0)
+		{
+			headless = true;
+
+			if (hasValue)
+			{
+				frameCount = static_cast<uint32_t>(std::stoul(argv[++ii]));
+			}
+		}
+		// --frames-in-flight <N>: how many frames the CPU may record ahead of the GPU
+		else if (strcmp(argv[ii], "--frames-in-flight") == 0 && hasValue)
+		{
+			settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		// --present-policy <immediate|mailbox|fifo|fifo_relaxed>
+		else if (strcmp(argv[ii], "--present-policy") == 0 && hasValue)
+		{
+			if (!parse_present_policy(argv[++ii], settings.presentPolicy))
+			{
+				std::cerr << "Unknown present policy \"" << argv[ii] << "\"\n";
+				return 1;
+			}
+		}
+		// --image-count <N>: swapchain images to request (0 = 2 more than the minimum)
+		else if (strcmp(argv[ii], "--image-count") == 0 && hasValue)
+		{
+			settings.swapchainImageCount = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+		// --fps-limit <F>: cap the frame rate on the CPU (0 = off)
+		else if (strcmp(argv[ii], "--fps-limit") == 0 && hasValue)
+		{
+			settings.frameRateLimit = std::stod(argv[++ii]);
+		}
+		// --gpu-culling: cull on the GPU and draw indirectly instead of recording every draw on the CPU
+		else if (strcmp(argv[ii], "--gpu-culling") == 0)
+		{
+			settings.gpuCulling = true;
+		}
+		// --brick-cache: raymarch through the baked brick map where the device supports it
+		else if (strcmp(argv[ii], "--brick-cache") == 0)
+		{
+			settings.raymarch.brickCache = true;
+		}
+		// --no-cone-prepass: start every raymarched ray from the camera
+		else if (strcmp(argv[ii], "--no-cone-prepass") == 0)
+		{
+			settings.raymarch.conePrepass = false;
+		}
+		// --threads <N>: job system threads, this one included (0 = one per hardware thread)
+		else if (strcmp(argv[ii], "--threads") == 0 && hasValue)
+		{
+			settings.workerThreads = static_cast<uint32_t>(std::stoul(argv[++ii]));
+		}
+	}
+
+	if (headless)
+	{
+		hridizaApp = new App(1800, 1000, true, frameCount, settings);
+	}
+	else
+	{
+		hridizaApp = new App(1800, 1000, true, settings);
+	}
 
 	hridizaApp->run();
 	delete hridizaApp;
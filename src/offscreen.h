@@ -0,0 +1,97 @@
+#pragma once
+
+#include "config.h"
+#include "buffers.h"
+#include "frame.h"
+#include "swapchain.h"
+
+
+namespace vkInit
+{
+	// Headless engines render into these images instead of swapchain images
+	// B8G8R8A8 matches our preferred surface format, and is renderable on every driver we target (incl. lavapipe)
+	const vk::Format offscreenFormat = vk::Format::eB8G8R8A8Unorm;
+
+
+	SwapchainBundle create_offscreen_frames(vk::Device logicalDevice, vkUtil::MemoryAllocator& allocator,
+		int width, int height, uint32_t frameCount, bool debug)
+	{
+		if (debug)
+		{
+			std::cout << "Creating " << frameCount << " offscreen frames...\n";
+		}
+
+		SwapchainBundle bundle{};
+		bundle.swapchain = nullptr;
+		bundle.format = offscreenFormat;
+		bundle.extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+		bundle.minImageCount = frameCount;
+		bundle.imageCount = frameCount;
+
+		bundle.frames.resize(frameCount);
+
+		for (uint32_t ii = 0; ii < frameCount; ii++)
+		{
+			vkUtil::SwapchainFrame& frame = bundle.frames[ii];
+
+			// Image
+			vk::ImageCreateInfo imageInfo = {};
+			imageInfo.imageType = vk::ImageType::e2D;
+			imageInfo.format = offscreenFormat;
+			imageInfo.extent = vk::Extent3D{ bundle.extent.width, bundle.extent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = vk::SampleCountFlagBits::e1;
+			imageInfo.tiling = vk::ImageTiling::eOptimal;
+
+			// Transfer src so that frames can be read back for inspection
+			imageInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+			imageInfo.sharingMode = vk::SharingMode::eExclusive;
+			imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+			try
+			{
+				frame.image = logicalDevice.createImage(imageInfo);
+			}
+			catch (vk::SystemError err)
+			{
+				throw std::runtime_error("Failed to create offscreen image :/\n");
+			}
+
+			// Memory
+			vk::MemoryRequirements requirements = logicalDevice.getImageMemoryRequirements(frame.image);
+
+			frame.imageAllocation = allocator.allocate(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+				vkUtil::AllocationStrategy::FREE_LIST, vkUtil::ResourceKind::IMAGE);
+
+			logicalDevice.bindImageMemory(frame.image, frame.imageAllocation.memory, frame.imageAllocation.offset);
+
+			// Image view
+			vk::ImageViewCreateInfo viewInfo = {};
+			viewInfo.image = frame.image;
+			viewInfo.viewType = vk::ImageViewType::e2D;
+			viewInfo.format = offscreenFormat;
+
+			viewInfo.components.r = vk::ComponentSwizzle::eIdentity;
+			viewInfo.components.g = vk::ComponentSwizzle::eIdentity;
+			viewInfo.components.b = vk::ComponentSwizzle::eIdentity;
+			viewInfo.components.a = vk::ComponentSwizzle::eIdentity;
+
+			viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+			viewInfo.subresourceRange.baseMipLevel = 0;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			frame.imageView = logicalDevice.createImageView(viewInfo);
+
+			if (debug)
+			{
+				std::cout << "Created offscreen frame " << ii << " (" << bundle.extent.width
+					<< "x" << bundle.extent.height << ")\n";
+			}
+		}
+
+		return bundle;
+	}
+}
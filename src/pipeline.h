@@ -12,9 +12,16 @@ namespace vkInit
 		vk::Device device;
 		std::string vertexFilepath;
 		std::string fragmentFilepath;
-		vk::Extent2D swapchainExtent;
 		vk::Format swapchainImageFormat;
 		vk::DescriptorSetLayout descriptorSetLayout;
+		vk::PipelineCache pipelineCache;
+
+		// Instances are read through the culling pass's visible list,
+		// rather than gl_InstanceIndex being the model slot itself
+		bool culledInstances;
+
+		// Bytes of push constants, visible to both stages
+		uint32_t pushConstantSize = 0;
 	};
 
 	struct GraphicsPipelineOutBundle
@@ -26,7 +33,7 @@ namespace vkInit
 
 
 	vk::PipelineLayout make_pipeline_layout(const vk::Device& device,
-		const vk::DescriptorSetLayout& descriptorSetLayout, bool debug)
+		const vk::DescriptorSetLayout& descriptorSetLayout, uint32_t pushConstantSize, bool debug)
 	{
 		vk::PipelineLayoutCreateInfo layoutInfo;
 		layoutInfo.flags = vk::PipelineLayoutCreateFlags();
@@ -34,7 +41,13 @@ namespace vkInit
 		layoutInfo.pSetLayouts = &descriptorSetLayout;
 
 		// Push constants
-		layoutInfo.pushConstantRangeCount = 0;
+		vk::PushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = pushConstantSize;
+
+		layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+		layoutInfo.pPushConstantRanges = &pushConstantRange;
 
 		try
 		{
@@ -146,31 +159,36 @@ namespace vkInit
 		vertexShaderInfo.stage = vk::ShaderStageFlagBits::eVertex;
 		vertexShaderInfo.module = vertexShader;
 		vertexShaderInfo.pName = "main";
+
+		// constant_id 0 in shader.vert
+		vk::Bool32 culledInstances = specification.culledInstances;
+		vk::SpecializationMapEntry culledInstancesEntry(0, 0, sizeof(vk::Bool32));
+		vk::SpecializationInfo vertexSpecialization(1, &culledInstancesEntry, sizeof(vk::Bool32), &culledInstances);
+		vertexShaderInfo.pSpecializationInfo = &vertexSpecialization;
+
 		shaderStages.push_back(vertexShaderInfo);
 
 
 		// Viewport and Scissor
-		vk::Viewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(specification.swapchainExtent.width);
-		viewport.height = static_cast<float>(specification.swapchainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		vk::Rect2D scissor = {};
-		scissor.offset.x = 0;
-		scissor.offset.y = 0;
-		scissor.extent = specification.swapchainExtent;
-
+		// Both are dynamic and set while recording, so the pipeline
+		// doesn't depend on the swapchain extent and survives resizes
 		vk::PipelineViewportStateCreateInfo viewportState = {};
 		viewportState.flags = vk::PipelineViewportStateCreateFlags();
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
 		pipelineInfo.pViewportState = &viewportState;
 
+		std::array<vk::DynamicState, 2> dynamicStates = {
+			vk::DynamicState::eViewport,
+			vk::DynamicState::eScissor
+		};
+
+		vk::PipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.flags = vk::PipelineDynamicStateCreateFlags();
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+		pipelineInfo.pDynamicState = &dynamicState;
+
 
 		// Rasterizer
 		vk::PipelineRasterizationStateCreateInfo rasterizer = {};
@@ -230,7 +248,7 @@ namespace vkInit
 			std::cout << "Create Pipeline Layout" << std::endl;
 		}
 		vk::PipelineLayout layout = make_pipeline_layout(specification.device,
-										specification.descriptorSetLayout, debug);
+										specification.descriptorSetLayout, specification.pushConstantSize, debug);
 		pipelineInfo.layout = layout;
 
 
@@ -257,7 +275,7 @@ namespace vkInit
 		vk::Pipeline graphicsPipeline;
 		try
 		{
-			graphicsPipeline = (specification.device.createGraphicsPipeline(nullptr, pipelineInfo)).value;
+			graphicsPipeline = (specification.device.createGraphicsPipeline(specification.pipelineCache, pipelineInfo)).value;
 		}
 		catch (vk::SystemError err)
 		{
@@ -278,6 +296,89 @@ namespace vkInit
 		specification.device.destroyShaderModule(fragmentShader);
 
 
+		return output;
+	}
+
+
+	struct ComputePipelineInBundle
+	{
+		vk::Device device;
+		std::string computeFilepath;
+		vk::DescriptorSetLayout descriptorSetLayout;
+		uint32_t pushConstantSize;
+		vk::PipelineCache pipelineCache;
+	};
+
+	struct ComputePipelineOutBundle
+	{
+		vk::PipelineLayout layout;
+		vk::Pipeline pipeline;
+	};
+
+
+	ComputePipelineOutBundle make_compute_pipeline(
+		const ComputePipelineInBundle& specification,
+		bool debug)
+	{
+		ComputePipelineOutBundle output = {};
+
+		// Layout: one descriptor set, push constants visible to the compute stage
+		vk::PushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eCompute;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = specification.pushConstantSize;
+
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.flags = vk::PipelineLayoutCreateFlags();
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &specification.descriptorSetLayout;
+		layoutInfo.pushConstantRangeCount = specification.pushConstantSize > 0 ? 1 : 0;
+		layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		try
+		{
+			output.layout = specification.device.createPipelineLayout(layoutInfo);
+		}
+		catch (vk::SystemError err)
+		{
+			if (debug)
+			{
+				std::cout << "Failed to create compute pipeline layout :/" << std::endl;
+			}
+
+			return output;
+		}
+
+		vk::ShaderModule computeShader = vkUtil::createModule(specification.computeFilepath, specification.device, debug);
+
+		vk::ComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.flags = vk::PipelineCreateFlags();
+		pipelineInfo.stage.flags = vk::PipelineShaderStageCreateFlags();
+		pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+		pipelineInfo.stage.module = computeShader;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = output.layout;
+		pipelineInfo.basePipelineHandle = nullptr;
+
+		if (debug)
+		{
+			std::cout << "Creating Compute Pipeline..." << std::endl;
+		}
+
+		try
+		{
+			output.pipeline = (specification.device.createComputePipeline(specification.pipelineCache, pipelineInfo)).value;
+		}
+		catch (vk::SystemError err)
+		{
+			if (debug)
+			{
+				std::cout << "Failed to create Compute Pipeline :/" << std::endl;
+			}
+		}
+
+		specification.device.destroyShaderModule(computeShader);
+
 		return output;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "config.h"
+#include <filesystem>
+
+namespace vkInit
+{
+	// Vulkan's pipeline cache header (VkPipelineCacheHeaderVersionOne)
+	struct PipelineCacheHeader
+	{
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+
+	// A cache is only usable on the exact device + driver that wrote it
+	bool is_pipeline_cache_compatible(const std::vector<char>& data, const vk::PhysicalDevice& physicalDevice, bool debug)
+	{
+		if (data.size() < sizeof(PipelineCacheHeader))
+		{
+			return false;
+		}
+
+		PipelineCacheHeader header;
+		memcpy(&header, data.data(), sizeof(PipelineCacheHeader));
+
+		vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+
+		bool compatible = header.headerSize >= sizeof(PipelineCacheHeader)
+			&& header.headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+			&& header.vendorID == properties.vendorID
+			&& header.deviceID == properties.deviceID
+			&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+
+		if (debug && !compatible)
+		{
+			std::cout << "Pipeline cache on disk was written by a different device or driver, ignoring it\n";
+		}
+
+		return compatible;
+	}
+
+
+	// Seeds the cache from disk when there is a compatible one there
+	vk::PipelineCache make_pipeline_cache(const vk::Device& device, const vk::PhysicalDevice& physicalDevice,
+		const std::string& filename, bool& loadedFromDisk, bool debug)
+	{
+		std::vector<char> data;
+		loadedFromDisk = false;
+
+		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+		if (file.is_open())
+		{
+			data.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(data.data(), data.size());
+			file.close();
+
+			if (!is_pipeline_cache_compatible(data, physicalDevice, debug))
+			{
+				data.clear();
+			}
+		}
+		else if (debug)
+		{
+			std::cout << "No pipeline cache at \"" << filename << "\", starting cold\n";
+		}
+
+		vk::PipelineCacheCreateInfo cacheInfo = {};
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		try
+		{
+			vk::PipelineCache cache = device.createPipelineCache(cacheInfo);
+			loadedFromDisk = !data.empty();
+
+			if (debug && loadedFromDisk)
+			{
+				std::cout << "Loaded " << data.size() << " bytes of pipeline cache from \"" << filename << "\"\n";
+			}
+
+			return cache;
+		}
+		catch (vk::SystemError err)
+		{
+			// The driver didn't like the data after all, so start from an empty cache
+			if (debug)
+			{
+				std::cout << "Failed to create pipeline cache from disk data, starting cold\n";
+			}
+
+			return device.createPipelineCache(vk::PipelineCacheCreateInfo{});
+		}
+	}
+
+
+	void save_pipeline_cache(const vk::Device& device, const vk::PipelineCache& cache,
+		const std::string& filename, bool debug)
+	{
+		std::vector<uint8_t> data = device.getPipelineCacheData(cache);
+
+		// Write to a temp file first, so a crash mid-write never leaves a truncated cache behind
+		std::string tempFilename = filename + ".tmp";
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+		{
+			if (debug)
+			{
+				std::cout << "Failed to write pipeline cache to \"" << filename << "\"\n";
+			}
+
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		file.close();
+
+		std::error_code error;
+		std::filesystem::rename(tempFilename, filename, error);
+
+		if (debug)
+		{
+			if (error)
+			{
+				std::cout << "Failed to write pipeline cache to \"" << filename << "\"\n";
+			}
+			else
+			{
+				std::cout << "Saved " << data.size() << " bytes of pipeline cache to \"" << filename << "\"\n";
+			}
+		}
+	}
+}
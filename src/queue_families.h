@@ -9,9 +9,15 @@ namespace vkUtil
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
 
+		// Transfer-only family (no graphics) for async uploads, if the device has one
+		std::optional<uint32_t> transferFamily;
+
+		// Headless engines never present, so they don't need a present family
+		bool needsPresent = true;
+
 		bool isComplete()
 		{
-			return graphicsFamily.has_value() && presentFamily.has_value();
+			return graphicsFamily.has_value() && (presentFamily.has_value() || !needsPresent);
 		}
 	};
 
@@ -20,6 +26,9 @@ namespace vkUtil
 	{
 		QueueFamilyIndices indices;
 
+		// A null surface means we are rendering offscreen
+		indices.needsPresent = static_cast<bool>(surface);
+
 		// Get queue families for device
 		std::vector<vk::QueueFamilyProperties> queueFamilies = device.getQueueFamilyProperties();
 
@@ -33,8 +42,24 @@ namespace vkUtil
 		int idx = 0;
 		for (const vk::QueueFamilyProperties& queueFamily : queueFamilies)
 		{
+			// check if this is a dedicated transfer queue family
+			// (pure transfer families, usually backed by a DMA engine, are preferred over async compute ones)
+			bool transfer = (queueFamily.queueFlags & vk::QueueFlagBits::eTransfer)
+				&& !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics);
+
+			if (transfer && (!indices.transferFamily.has_value()
+				|| !(queueFamily.queueFlags & vk::QueueFlagBits::eCompute)))
+			{
+				indices.transferFamily = idx;
+
+				if (debug)
+				{
+					std::cout << "Queue Family " << idx << " is suitable for dedicated transfers.\n";
+				}
+			}
+
 			// check if this is a graphics queue family
-			if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
+			if (!indices.graphicsFamily.has_value() && (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics))
 			{
 				indices.graphicsFamily = idx;
 
@@ -44,7 +69,7 @@ namespace vkUtil
 				}
 			}
 
-			if (device.getSurfaceSupportKHR(idx, surface))
+			if (indices.needsPresent && !indices.presentFamily.has_value() && device.getSurfaceSupportKHR(idx, surface))
 			{
 				indices.presentFamily = idx;
 
@@ -55,13 +80,21 @@ namespace vkUtil
 			}
 
 
-			// if we found all needed queue family indices, break
-			if (indices.isComplete())
+			// Keep going after the required families are found: the transfer family may come later
+			idx++;
+		}
+
+		// A compute + transfer family can also be the one we present from. Its queue 0 is then the present queue,
+		// which the upload queue can't submit to unsynchronized, so uploads go through the graphics queue instead
+		if (indices.transferFamily.has_value() && indices.presentFamily.has_value()
+			&& indices.transferFamily.value() == indices.presentFamily.value())
+		{
+			indices.transferFamily.reset();
+
+			if (debug)
 			{
-				break;
+				std::cout << "Transfer family is the present family, uploads will share the graphics queue.\n";
 			}
-
-			idx++;
 		}
 
 
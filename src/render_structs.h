@@ -8,4 +8,23 @@ namespace vkUtil
 	{
 		glm::mat4 model;
 	};
+
+	// Optional device features, enabled at device creation when the physical device has them
+	struct DeviceCapabilities
+	{
+		// drawIndirect with more than one draw
+		bool multiDrawIndirect = false;
+
+		// indirect draws with a non-zero firstInstance (every culled batch after the first)
+		bool drawIndirectFirstInstance = false;
+
+		// VK_KHR_draw_indirect_count
+		bool drawIndirectCount = false;
+
+		// storage buffer writes and atomics in fragment shaders (raymarch step counters)
+		bool fragmentStoresAndAtomics = false;
+
+		// R16_SFLOAT storage images (shaderStorageImageExtendedFormats), for baking the SDF brick map
+		bool brickCache = false;
+	};
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <cfloat>
+
 Scene::Scene()
 {
 	offset = 0;
+	uploadTicket = 0;
 }
 
 
@@ -14,17 +18,66 @@ void Scene::InitEntities()
 
 	// TODO: Load from file here 
 
-	REntity entity;
+	AddEntity("ID: Fullscreen", TRIANGLE_FULLSCREEN);
+
+	// Was hard-coded into shader_raymarch.frag
+	Entity sphere = AddShape("ID: Sphere", Shape{ SHAPE_SPHERE, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f) });
+	GetTransform(sphere).SetPosition(0.0f, 0.0f, -1.0f);
+
+}
+
+Entity Scene::AddEntity(const std::string& name, const MeshType& meshType)
+{
+	Entity entity = registry.Create();
+
+	registry.Add<Name>(entity, Name{ name });
+	registry.Add<Transform>(entity, Transform(transforms, transforms.Create()));
+	registry.Add<MeshRenderer>(entity, MeshRenderer{ meshType });
 
-	std::shared_ptr<UInfo> info = std::make_shared<UInfo>();
-	info->name = "ID: Fullscreen";
-	info->transform = std::make_shared<Transform>();
+	return entity;
+}
+
+Entity Scene::AddShape(const std::string& name, const Shape& shape)
+{
+	Entity entity = registry.Create();
+
+	registry.Add<Name>(entity, Name{ name });
+	registry.Add<Transform>(entity, Transform(transforms, transforms.Create()));
+	registry.Add<Shape>(entity, shape);
 
-	entity.info = info;
-	entity.meshType = TRIANGLE_FULLSCREEN;
+	return entity;
+}
+
+void Scene::DestroyEntity(Entity entity)
+{
+	if (Transform* transform = registry.TryGet<Transform>(entity))
+	{
+		transforms.Destroy(transform->GetHandle());
+	}
+
+	registry.Destroy(entity);
+}
+
+void Scene::ClearEntities()
+{
+	for (Transform& transform : registry.Pool<Transform>().GetComponents())
+	{
+		transforms.Destroy(transform.GetHandle());
+	}
+
+	registry.Clear();
+}
+
+Transform& Scene::GetTransform(Entity entity)
+{
+	return registry.Get<Transform>(entity);
+}
 
-	entities.push_back(entity);
+bool Scene::SetParent(Entity child, Entity parent)
+{
+	Transform* parentTransform = registry.IsValid(parent) ? registry.TryGet<Transform>(parent) : nullptr;
 
+	return GetTransform(child).SetParent(parentTransform);
 }
 
 
@@ -33,7 +86,7 @@ void Scene::InitEntities()
 
 
 
-void Scene::consume(const MeshType& meshType, const std::vector<float>& vertexData)
+void Scene::consume(const MeshType& meshType, const std::vector<float>& vertexData, bool cullable)
 {
 	lump.reserve(lump.size() + vertexData.size());
 
@@ -52,6 +105,29 @@ void Scene::consume(const MeshType& meshType, const std::vector<float>& vertexDa
 	);
 
 	offset += vertexCount;
+
+	// Bounding sphere around the box of the positions (attributes 4-6)
+	glm::vec3 low(FLT_MAX);
+	glm::vec3 high(-FLT_MAX);
+
+	for (size_t ii = 0; ii < vertexCount; ii++)
+	{
+		const float* position = &vertexData[ii * ATTRIBUTE_COUNT + 4];
+
+		low = glm::min(low, glm::vec3(position[0], position[1], position[2]));
+		high = glm::max(high, glm::vec3(position[0], position[1], position[2]));
+	}
+
+	glm::vec3 center = 0.5f * (low + high);
+	float radius = 0.0f;
+
+	for (size_t ii = 0; ii < vertexCount; ii++)
+	{
+		const float* position = &vertexData[ii * ATTRIBUTE_COUNT + 4];
+		radius = std::max(radius, glm::length(glm::vec3(position[0], position[1], position[2]) - center));
+	}
+
+	bounds[meshType] = cullable ? glm::vec4(center, radius) : glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
 }
 
 vk::Buffer Scene::getVertexBuffer() const
@@ -72,50 +148,54 @@ std::pair<size_t, size_t> Scene::lookupOffsetSize(const MeshType& meshType)
 }
 
 
+glm::vec4 Scene::lookupBounds(const MeshType& meshType)
+{
+	auto it = bounds.find(meshType);
+
+	if (it != bounds.end())
+	{
+		return it->second;
+	}
+
+	return glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+}
+
+
 void Scene::finalize(const FinalizationChunk& finalizationChunk)
 {
 	vkUtil::BufferInput inputChunk{};
 	inputChunk.logicalDevice = finalizationChunk.logicalDevice;
 	inputChunk.physicalDevice = finalizationChunk.physicalDevice;
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
+	inputChunk.allocator = &finalizationChunk.allocator;
 	inputChunk.size = sizeof(float) * lump.size();
-	// Host visible = we can write to it directly
-	// Host coherent = Write operation happens right on the location,
-	// we don't have to worry about sync
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible |
-		vk::MemoryPropertyFlagBits::eHostCoherent;
-
-	// Copy to temp location in GPU
-	vkUtil::BufferData tempBufferData = vkUtil::create_buffer(inputChunk);
 
-	void* memoryLocation = finalizationChunk.logicalDevice.mapMemory(
-		tempBufferData.bufferMemory, 0, inputChunk.size);
-
-	memcpy(memoryLocation, lump.data(), inputChunk.size);
-
-	finalizationChunk.logicalDevice.unmapMemory(tempBufferData.bufferMemory);
-
-	// Copy from temp GPU location to high performance area
+	// High performance area, filled from the upload queue's staging ring
 	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst
 		| vk::BufferUsageFlagBits::eVertexBuffer;
 	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
 
+	// Written on the transfer queue, read on the graphics queue
+	inputChunk.queueFamilyIndices = {
+		finalizationChunk.graphicsQueueFamilyIdx,
+		finalizationChunk.uploadQueue.get_queue_family_idx()
+	};
+
 	vertexBufferData = vkUtil::create_buffer(inputChunk);
 
-	vkUtil::copy_buffer(tempBufferData, vertexBufferData,
-		inputChunk.size, finalizationChunk.queue,
-		finalizationChunk.commandBuffer);
+	// No waiting here: the renderer checks isReady() before drawing
+	finalizationChunk.uploadQueue.upload_buffer(lump.data(), inputChunk.size, vertexBufferData.buffer);
+	uploadTicket = finalizationChunk.uploadQueue.flush();
+}
 
-	// free temp buffer
-	finalizationChunk.logicalDevice.destroyBuffer(tempBufferData.buffer);
-	finalizationChunk.logicalDevice.freeMemory(tempBufferData.bufferMemory);
+bool Scene::isReady(vkUtil::UploadQueue& uploadQueue) const
+{
+	return uploadQueue.is_complete(uploadTicket);
 }
 
 
-void Scene::cleanup(const vk::Device& logicalDevice) const
+void Scene::cleanup(const vk::Device& logicalDevice, vkUtil::MemoryAllocator& allocator)
 {
-	logicalDevice.destroyBuffer(vertexBufferData.buffer);
-	logicalDevice.freeMemory(vertexBufferData.bufferMemory);
+	vkUtil::destroy_buffer(logicalDevice, allocator, vertexBufferData);
 
 	delete this;
 }
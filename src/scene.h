@@ -2,15 +2,19 @@
 
 #include "config.h"
 #include "Entity.h"
+#include "Registry.h"
+#include "TransformSystem.h"
 #include "buffers.h"
+#include "upload.h"
 
 
 struct FinalizationChunk
 {
 	const vk::Device& logicalDevice;
 	const vk::PhysicalDevice& physicalDevice;
-	const vk::Queue& queue;
-	const vk::CommandBuffer& commandBuffer;
+	vkUtil::MemoryAllocator& allocator;
+	vkUtil::UploadQueue& uploadQueue;
+	uint32_t graphicsQueueFamilyIdx;
 };
 
 class Scene
@@ -25,25 +29,51 @@ public:
 
 
 	void InitEntities(); 
-	std::vector<REntity> entities; 
+
+	Registry registry;
+	TransformSystem transforms;
+
+	// Creates an entity with a Name, Transform and MeshRenderer
+	Entity AddEntity(const std::string& name, const MeshType& meshType);
+
+	// Creates an entity with a Name, Transform and Shape, raymarched rather than rasterized
+	Entity AddShape(const std::string& name, const Shape& shape);
+	void DestroyEntity(Entity entity);
+	void ClearEntities();
+
+	// The entity must have been created by AddEntity()
+	Transform& GetTransform(Entity entity);
+
+	// Parents child's transform to parent's (an invalid Entity to unparent)
+	// Returns false, changing nothing, if that would create a cycle
+	bool SetParent(Entity child, Entity parent);
 
 
 
 
 public:
 
-	void consume(const MeshType& mesh, const std::vector<float>& vertexData);
+	// Meshes that aren't cullable (e.g. ones already in clip space) are never frustum culled
+	void consume(const MeshType& mesh, const std::vector<float>& vertexData, bool cullable = true);
 	void finalize(const FinalizationChunk& finalizationChunk);
 
+	// True once the vertex data uploaded by finalize() has landed on the GPU
+	bool isReady(vkUtil::UploadQueue& uploadQueue) const;
+
 	vk::Buffer getVertexBuffer() const;
 
 	std::pair<size_t, size_t> lookupOffsetSize(const MeshType& meshType);
 
-	void cleanup(const vk::Device& logicalDevice) const;
+	// Local space bounding sphere: xyz = center, w = radius (negative = never culled)
+	glm::vec4 lookupBounds(const MeshType& meshType);
+
+	void cleanup(const vk::Device& logicalDevice, vkUtil::MemoryAllocator& allocator);
 
 private:
 	vkUtil::BufferData vertexBufferData;
+	vkUtil::UploadTicket uploadTicket;
 	std::unordered_map<MeshType, std::pair<size_t, size_t>> offsets_sizes;
+	std::unordered_map<MeshType, glm::vec4> bounds;
 	size_t offset;
 
 	std::vector<float> lump;
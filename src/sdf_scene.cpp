@@ -0,0 +1,266 @@
+#include "sdf_scene.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace vkUtil
+{
+	size_t pack_shapes(const std::vector<Shape>& shapes, const std::vector<uint32_t>& transformIndices,
+		const glm::mat4* worldMatrices, const uint64_t* versions, ShapeTable& table)
+	{
+		size_t count = shapes.size();
+
+		// New records start out with a version no transform has, so they're packed below
+		table.shapes.resize(count);
+		table.revisions.resize(count, 0);
+		table.sources.resize(count);
+		table.transformVersions.resize(count, 0);
+
+		size_t packed = 0;
+
+		for (size_t ii = 0; ii < count; ii++)
+		{
+			uint32_t dense = transformIndices[ii];
+
+			// Versions are unique, so a shape swapped into this slot by a removal is caught too
+			if (table.transformVersions[ii] == versions[dense] && table.sources[ii] == shapes[ii])
+			{
+				continue;
+			}
+
+			SdfShape& record = table.shapes[ii];
+			record.center = glm::vec3(worldMatrices[dense][3]);
+			record.shapeType = shapes[ii].shapeType;
+			record.parameters = shapes[ii].parameters;
+
+			table.sources[ii] = shapes[ii];
+			table.transformVersions[ii] = versions[dense];
+			table.revisions[ii] = table.nextRevision++;
+
+			packed++;
+		}
+
+		return packed;
+	}
+
+	glm::vec3 shape_half_extents(const Shape& shape)
+	{
+		switch (shape.shapeType)
+		{
+		case SHAPE_SPHERE:
+			return glm::vec3(shape.parameters.x);
+
+		case SHAPE_BOX:
+		case SHAPE_ROUND_BOX:
+			return glm::vec3(shape.parameters);
+
+		default:
+			return glm::vec3(0.0f);
+		}
+	}
+
+	static float surface_area(const SdfBvhNode& node)
+	{
+		glm::vec3 size = glm::max(node.boundsMax - node.boundsMin, glm::vec3(0.0f));
+
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	static void set_leaf_bounds(const ShapeTable& table, uint32_t shapeIndex, SdfBvhNode& node)
+	{
+		glm::vec3 halfExtents = shape_half_extents(table.sources[shapeIndex]);
+
+		node.boundsMin = table.shapes[shapeIndex].center - halfExtents;
+		node.boundsMax = table.shapes[shapeIndex].center + halfExtents;
+	}
+
+	// Builds the subtree over bvh.buildShapes[first, last) at node index nodeIdx,
+	// returns the index past its last node
+	static uint32_t build_node(const ShapeTable& table, ShapeBvh& bvh, uint32_t nodeIdx, uint32_t parent,
+		size_t first, size_t last)
+	{
+		SdfBvhNode& node = bvh.nodes[nodeIdx];
+		bvh.parents[nodeIdx] = parent;
+		bvh.revisions[nodeIdx] = bvh.nextRevision++;
+
+		if (last - first == 1)
+		{
+			uint32_t shapeIndex = bvh.buildShapes[first];
+
+			set_leaf_bounds(table, shapeIndex, node);
+			node.rightChild = 0;
+			node.shapeIndex = shapeIndex;
+
+			bvh.shapeLeaves[shapeIndex] = nodeIdx;
+			bvh.shapeRevisions[shapeIndex] = table.revisions[shapeIndex];
+
+			return nodeIdx + 1;
+		}
+
+		// Median split along the longest axis of the centers
+		glm::vec3 centerMin(FLT_MAX);
+		glm::vec3 centerMax(-FLT_MAX);
+
+		for (size_t ii = first; ii < last; ii++)
+		{
+			centerMin = glm::min(centerMin, table.shapes[bvh.buildShapes[ii]].center);
+			centerMax = glm::max(centerMax, table.shapes[bvh.buildShapes[ii]].center);
+		}
+
+		glm::vec3 spread = centerMax - centerMin;
+		int axis = (spread.x > spread.y && spread.x > spread.z) ? 0 : (spread.y > spread.z ? 1 : 2);
+
+		size_t middle = first + (last - first) / 2;
+
+		std::nth_element(bvh.buildShapes.begin() + first, bvh.buildShapes.begin() + middle,
+			bvh.buildShapes.begin() + last, [&table, axis](uint32_t a, uint32_t b)
+			{
+				return table.shapes[a].center[axis] < table.shapes[b].center[axis];
+			});
+
+		uint32_t right = build_node(table, bvh, nodeIdx + 1, nodeIdx, first, middle);
+		uint32_t end = build_node(table, bvh, right, nodeIdx, middle, last);
+
+		// the vector didn't grow while building, so the reference is still good
+		node.boundsMin = glm::min(bvh.nodes[nodeIdx + 1].boundsMin, bvh.nodes[right].boundsMin);
+		node.boundsMax = glm::max(bvh.nodes[nodeIdx + 1].boundsMax, bvh.nodes[right].boundsMax);
+		node.rightChild = right;
+		node.shapeIndex = SDF_BVH_INNER_NODE;
+
+		bvh.cost += surface_area(node);
+
+		return end;
+	}
+
+	static void build_bvh(const ShapeTable& table, ShapeBvh& bvh)
+	{
+		size_t shapeCount = table.shapes.size();
+		size_t nodeCount = shapeCount > 0 ? 2 * shapeCount - 1 : 0;
+
+		bvh.nodes.resize(nodeCount);
+		bvh.revisions.resize(nodeCount);
+		bvh.parents.resize(nodeCount);
+		bvh.shapeLeaves.resize(shapeCount);
+		bvh.shapeRevisions.resize(shapeCount);
+
+		bvh.buildShapes.resize(shapeCount);
+
+		for (size_t ii = 0; ii < shapeCount; ii++)
+		{
+			bvh.buildShapes[ii] = static_cast<uint32_t>(ii);
+		}
+
+		bvh.cost = 0.0f;
+
+		if (shapeCount > 0)
+		{
+			build_node(table, bvh, 0, SDF_BVH_INNER_NODE, 0, shapeCount);
+		}
+
+		bvh.builtCost = bvh.cost;
+	}
+
+	bool bvh_overlaps(const ShapeBvh& bvh, glm::vec3 boundsMin, glm::vec3 boundsMax, float margin)
+	{
+		if (bvh.nodes.empty())
+		{
+			return false;
+		}
+
+		// Inner node bounds hold their leaves', so the margin applies all the way down
+		glm::vec3 low = boundsMin - glm::vec3(margin);
+		glm::vec3 high = boundsMax + glm::vec3(margin);
+
+		// median splits keep the tree balanced, so this is deep enough for any shape count
+		uint32_t stack[64];
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			uint32_t nodeIdx = stack[--stackSize];
+
+			const SdfBvhNode& node = bvh.nodes[nodeIdx];
+
+			if (node.boundsMin.x > high.x || node.boundsMin.y > high.y || node.boundsMin.z > high.z
+				|| node.boundsMax.x < low.x || node.boundsMax.y < low.y || node.boundsMax.z < low.z)
+			{
+				continue;
+			}
+
+			if (node.shapeIndex != SDF_BVH_INNER_NODE)
+			{
+				return true;
+			}
+
+			stack[stackSize++] = nodeIdx + 1;
+			stack[stackSize++] = node.rightChild;
+		}
+
+		return false;
+	}
+
+	size_t update_shape_bvh(const ShapeTable& table, ShapeBvh& bvh)
+	{
+		size_t shapeCount = table.shapes.size();
+
+		if (bvh.shapeLeaves.size() != shapeCount)
+		{
+			build_bvh(table, bvh);
+
+			return bvh.nodes.size();
+		}
+
+		size_t changed = 0;
+
+		for (size_t ii = 0; ii < shapeCount; ii++)
+		{
+			if (bvh.shapeRevisions[ii] == table.revisions[ii])
+			{
+				continue;
+			}
+
+			bvh.shapeRevisions[ii] = table.revisions[ii];
+
+			uint32_t nodeIdx = bvh.shapeLeaves[ii];
+			set_leaf_bounds(table, static_cast<uint32_t>(ii), bvh.nodes[nodeIdx]);
+			bvh.revisions[nodeIdx] = bvh.nextRevision++;
+			changed++;
+
+			// Refit the ancestors, up to the first one the change doesn't reach
+			for (uint32_t parent = bvh.parents[nodeIdx]; parent != SDF_BVH_INNER_NODE; parent = bvh.parents[parent])
+			{
+				SdfBvhNode& node = bvh.nodes[parent];
+				const SdfBvhNode& left = bvh.nodes[parent + 1];
+				const SdfBvhNode& right = bvh.nodes[node.rightChild];
+
+				glm::vec3 boundsMin = glm::min(left.boundsMin, right.boundsMin);
+				glm::vec3 boundsMax = glm::max(left.boundsMax, right.boundsMax);
+
+				if (boundsMin == node.boundsMin && boundsMax == node.boundsMax)
+				{
+					break;
+				}
+
+				bvh.cost -= surface_area(node);
+
+				node.boundsMin = boundsMin;
+				node.boundsMax = boundsMax;
+
+				bvh.cost += surface_area(node);
+
+				bvh.revisions[parent] = bvh.nextRevision++;
+				changed++;
+			}
+		}
+
+		if (bvh.cost > SDF_BVH_REBUILD_RATIO * bvh.builtCost)
+		{
+			build_bvh(table, bvh);
+
+			return bvh.nodes.size();
+		}
+
+		return changed;
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Entity.h"
+
+namespace vkUtil
+{
+	// One SDF primitive as read by the raymarch shaders (std430)
+	struct SdfShape
+	{
+		glm::vec3 center;
+		uint32_t shapeType;
+
+		// Same meaning as Shape::parameters
+		glm::vec4 parameters;
+	};
+
+	static_assert(sizeof(SdfShape) == 32, "SdfShape must match the raymarch shaders' layout");
+
+	// shapeIndex of inner BVH nodes
+	constexpr uint32_t SDF_BVH_INNER_NODE = 0xFFFFFFFF;
+
+	// Refit trees are rebuilt once their nodes' summed surface area grows past this multiple
+	// of what it was when built, moving shapes slowly loosen the tree
+	constexpr float SDF_BVH_REBUILD_RATIO = 2.0f;
+
+	// One node of the shape BVH as read by the raymarch shaders (std430).
+	// Nodes are stored depth first: an inner node's left child directly follows it
+	struct SdfBvhNode
+	{
+		glm::vec3 boundsMin;
+
+		// inner nodes only
+		uint32_t rightChild;
+
+		glm::vec3 boundsMax;
+
+		// leaves hold a single shape, SDF_BVH_INNER_NODE for inner nodes
+		uint32_t shapeIndex;
+	};
+
+	static_assert(sizeof(SdfBvhNode) == 32, "SdfBvhNode must match the raymarch shaders' layout");
+
+	// The scene's shapes packed for upload, kept in step with the Shape pool
+	struct ShapeTable
+	{
+		// Same order as the Shape pool's packed array
+		std::vector<SdfShape> shapes;
+
+		// Bumped whenever a record is repacked
+		// Frames upload the records whose revision they haven't written yet
+		std::vector<uint64_t> revisions;
+
+		// What each record was packed from
+		std::vector<Shape> sources;
+		std::vector<uint64_t> transformVersions;
+
+		uint64_t nextRevision = 1;
+	};
+
+	// Bounding volume hierarchy over a ShapeTable's shapes, one shape per leaf
+	struct ShapeBvh
+	{
+		std::vector<SdfBvhNode> nodes;
+
+		// Same scheme as ShapeTable::revisions, per node
+		std::vector<uint64_t> revisions;
+
+		std::vector<uint32_t> parents;
+
+		// leaf node of each shape
+		std::vector<uint32_t> shapeLeaves;
+
+		// ShapeTable revision each leaf's bounds were taken from
+		std::vector<uint64_t> shapeRevisions;
+
+		// summed surface area of the inner nodes, now and when last built
+		float cost = 0.0f;
+		float builtCost = 0.0f;
+
+		uint64_t nextRevision = 1;
+
+		// scratch for building
+		std::vector<uint32_t> buildShapes;
+	};
+
+	/// <summary>
+	/// Repacks the records whose shape or transform changed since the last call.
+	/// Pure CPU work, so it can be checked without a device
+	/// </summary>
+	/// <param name="shapes">a Shape pool's packed array</param>
+	/// <param name="transformIndices">packed transform index of each shape</param>
+	/// <param name="worldMatrices">the transform system's packed world matrices, up to date</param>
+	/// <param name="versions">the transform system's packed versions</param>
+	/// <returns>Records repacked</returns>
+	size_t pack_shapes(const std::vector<Shape>& shapes, const std::vector<uint32_t>& transformIndices,
+		const glm::mat4* worldMatrices, const uint64_t* versions, ShapeTable& table);
+
+	/// <summary>
+	/// Brings the BVH in step with the table: refits the leaves (and their ancestors) of repacked shapes,
+	/// or rebuilds the tree when shapes were added or removed, or refitting loosened it too much.
+	/// Pure CPU work, like pack_shapes
+	/// </summary>
+	/// <returns>Nodes changed</returns>
+	size_t update_shape_bvh(const ShapeTable& table, ShapeBvh& bvh);
+
+	// Whether any leaf of the BVH, grown by margin on every side, overlaps the box
+	bool bvh_overlaps(const ShapeBvh& bvh, glm::vec3 boundsMin, glm::vec3 boundsMax, float margin);
+
+	// Half the size of the box around the shape's center that holds all of it
+	glm::vec3 shape_half_extents(const Shape& shape);
+
+	/// <summary>
+	/// Copies the records whose revision differs from the one last written to destination,
+	/// in runs of consecutive stale records
+	/// </summary>
+	/// <param name="writtenRevisions">revision of each record in destination, updated</param>
+	template <typename T>
+	void write_stale_records(const std::vector<T>& records, const std::vector<uint64_t>& revisions,
+		std::vector<uint64_t>& writtenRevisions, void* destination)
+	{
+		size_t count = records.size();
+		T* target = static_cast<T*>(destination);
+
+		writtenRevisions.resize(count, 0);
+
+		size_t ii = 0;
+
+		while (ii < count)
+		{
+			if (writtenRevisions[ii] == revisions[ii])
+			{
+				ii++;
+				continue;
+			}
+
+			size_t first = ii;
+
+			while (ii < count && writtenRevisions[ii] != revisions[ii])
+			{
+				writtenRevisions[ii] = revisions[ii];
+				ii++;
+			}
+
+			memcpy(target + first, records.data() + first, sizeof(T) * (ii - first));
+		}
+	}
+}
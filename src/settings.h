@@ -0,0 +1,147 @@
+#pragma once
+
+#include "config.h"
+
+// How finished frames are handed to the display
+enum class PresentPolicy
+{
+	// Lowest latency, may tear
+	IMMEDIATE,
+
+	// Low latency without tearing, frames that miss a refresh are dropped
+	MAILBOX,
+
+	// Vsync, frames queue up behind each other
+	FIFO,
+
+	// Vsync, but a late frame is shown right away (and may tear) instead of waiting a whole refresh
+	FIFO_RELAXED,
+
+	COUNT
+};
+
+constexpr size_t PRESENT_POLICY_COUNT = static_cast<size_t>(PresentPolicy::COUNT);
+
+inline const char* present_policy_name(PresentPolicy policy)
+{
+	switch (policy)
+	{
+	case PresentPolicy::IMMEDIATE:
+		return "immediate";
+	case PresentPolicy::MAILBOX:
+		return "mailbox";
+	case PresentPolicy::FIFO:
+		return "fifo";
+	case PresentPolicy::FIFO_RELAXED:
+		return "fifo_relaxed";
+	default:
+		return "unknown";
+	}
+}
+
+inline vk::PresentModeKHR present_policy_mode(PresentPolicy policy)
+{
+	switch (policy)
+	{
+	case PresentPolicy::IMMEDIATE:
+		return vk::PresentModeKHR::eImmediate;
+	case PresentPolicy::MAILBOX:
+		return vk::PresentModeKHR::eMailbox;
+	case PresentPolicy::FIFO_RELAXED:
+		return vk::PresentModeKHR::eFifoRelaxed;
+	default:
+		return vk::PresentModeKHR::eFifo;
+	}
+}
+
+inline bool parse_present_policy(const std::string& name, PresentPolicy& policy)
+{
+	for (size_t ii = 0; ii < PRESENT_POLICY_COUNT; ii++)
+	{
+		if (name == present_policy_name(static_cast<PresentPolicy>(ii)))
+		{
+			policy = static_cast<PresentPolicy>(ii);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// How the raymarch pass steps along its rays, can be changed while running
+struct RaymarchSettings
+{
+	// Step by the distance the SDF returns (sphere tracing) instead of by fixedStep
+	bool sphereTracing = true;
+
+	// Distance per step when not sphere tracing
+	float fixedStep = 0.01f;
+
+	// Steps before a ray gives up
+	uint32_t maxSteps = 128;
+
+	// Rays that travel this far without hitting anything miss
+	float maxDistance = 100.0f;
+
+	// A ray hits once it's closer than hitEpsilon * (1 + distance travelled),
+	// so far away surfaces need less precision, like the pixels covering them
+	float hitEpsilon = 0.001f;
+
+	// Over-relaxation of sphere tracing steps (1 = plain sphere tracing, below 2).
+	// Overshooting steps are taken back and the ray goes on without relaxation
+	float relaxation = 1.6f;
+
+	// Color pixels by the steps their ray took instead of what they hit
+	bool showSteps = false;
+
+	// Add up every ray's steps on the GPU, see Engine::get_raymarch_step_counters()
+	// Costs a few atomics per pixel, and needs fragmentStoresAndAtomics
+	bool collectStepCounters = false;
+
+	// Sample a sparse brick map of baked distances where there's one, instead of walking the BVH every step.
+	// Bricks are rebaked around shapes that move, and the exact distance is still taken near surfaces.
+	// Needs DeviceCapabilities::brickCache
+	bool brickCache = false;
+
+	// Cone march 8x8 pixel tiles first (at an eighth of the resolution on each axis), and start every ray
+	// at the distance its tile's cone got to without touching anything
+	bool conePrepass = true;
+};
+
+// Engine options that have to be known when the engine is built
+// (the presentation options can also be changed while running)
+struct EngineSettings
+{
+	// Pipeline cache loaded at startup and written back at shutdown
+	// Empty keeps the cache in memory only
+	std::string pipelineCacheFile = "pipeline_cache.bin";
+
+	// Frames the CPU may record ahead of the GPU
+	// More overlaps CPU and GPU work better, fewer cuts input latency
+	uint32_t framesInFlight = 2;
+
+	// Falls back to FIFO when the surface doesn't support it
+	PresentPolicy presentPolicy = PresentPolicy::MAILBOX;
+
+	// Swapchain images to ask for, clamped to what the surface allows
+	// 0 asks for 2 more than the surface's minimum
+	uint32_t swapchainImageCount = 0;
+
+	// CPU frame rate cap, 0 for none
+	double frameRateLimit = 0.0;
+
+	// Frustum cull in a compute pass and draw from the indirect commands it fills,
+	// instead of recording one draw per batch with every instance
+	// Devices without drawIndirectFirstInstance draw from the CPU regardless
+	// Off by default: shader.vert doesn't apply the model and view projection matrices yet,
+	// so the pass would cull against bounds that don't match what's drawn
+	bool gpuCulling = false;
+
+	// Threads of the engine's job system, the one calling render() included.
+	// They share transform updates, frame preparation and draw recording
+	// (only CPU driven draws are split, GPU culled ones are a few indirect draws at most)
+	// 0 uses every hardware thread, 1 does everything on the calling thread
+	uint32_t workerThreads = 0;
+
+	RaymarchSettings raymarch;
+};
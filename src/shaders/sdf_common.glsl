@@ -0,0 +1,150 @@
+// Shapes, their BVH and the distance to them, shared by shader_raymarch.frag and brick_bake.comp
+// Include after the push constant block: map() reads Parameters.shapeCount
+
+// Scene data, packed on the CPU from the scene's Shape components (see vkUtil::SdfShape)
+struct Shape
+{
+	vec3 center;
+	uint shapeType;
+
+	// sphere: x = radius
+	// box: xyz = half extents
+	// round box: xyz = half extents, w = rounding
+	vec4 parameters;
+};
+
+layout(std430, binding = 0) readonly buffer shapeBuffer
+{
+	Shape shapes[];
+} ShapeData;
+
+// BVH over the shapes, depth first (see vkUtil::SdfBvhNode)
+struct BvhNode
+{
+	vec3 boundsMin;
+	uint rightChild;
+	vec3 boundsMax;
+	uint shapeIndex;
+};
+
+layout(std430, binding = 1) readonly buffer bvhBuffer
+{
+	BvhNode nodes[];
+} BvhData;
+
+
+// SDF functions
+// From: https://iquilezles.org/articles/distfunctions/
+float Sphere(vec3 p, vec3 center, float radius);
+float Box(vec3 p, vec3 center, vec3 size);
+float RoundBox(vec3 p, vec3 center, vec3 size, float rounding);
+float SampleSDF(vec3 p, Shape shape);
+
+// Matches ShapeType in Entity.h
+#define SPHERE 0
+#define BOX 1
+#define ROUND_BOX 2
+
+// Matches vkUtil::SDF_BVH_INNER_NODE
+#define INNER_NODE 0xFFFFFFFFu
+
+// Deep enough for any tree the CPU builds (median splits keep it balanced)
+#define BVH_STACK_SIZE 32
+
+// Distance from p to the box, 0 inside it
+float BoundsDistance(vec3 p, vec3 boundsMin, vec3 boundsMax)
+{
+	return length(max(max(boundsMin - p, p - boundsMax), 0.0));
+}
+
+// Distance to the closest shape
+// Shapes lie within their node's bounds, so nodes farther away than the closest shape so far are skipped
+float map(vec3 p)
+{
+	float d = 99999.0f;
+
+	if (Parameters.shapeCount == 0)
+	{
+		return d;
+	}
+
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint nodeIdx = stack[--stackSize];
+		BvhNode node = BvhData.nodes[nodeIdx];
+
+		if (BoundsDistance(p, node.boundsMin, node.boundsMax) >= d)
+		{
+			continue;
+		}
+
+		if (node.shapeIndex != INNER_NODE)
+		{
+			d = min(SampleSDF(p, ShapeData.shapes[node.shapeIndex]), d);
+			continue;
+		}
+
+		uint left = nodeIdx + 1;
+		uint right = node.rightChild;
+
+		// Nearer child on top, so it tightens d before the other one is tested
+		BvhNode leftNode = BvhData.nodes[left];
+		BvhNode rightNode = BvhData.nodes[right];
+
+		float leftDistance = BoundsDistance(p, leftNode.boundsMin, leftNode.boundsMax);
+		float rightDistance = BoundsDistance(p, rightNode.boundsMin, rightNode.boundsMax);
+
+		if (leftDistance < rightDistance)
+		{
+			stack[stackSize++] = right;
+			stack[stackSize++] = left;
+		}
+		else
+		{
+			stack[stackSize++] = left;
+			stack[stackSize++] = right;
+		}
+	}
+
+	return d;
+}
+
+
+float Sphere(vec3 p, vec3 center, float radius)
+{
+	return distance(p, center) - radius;
+}
+
+float Box(vec3 p, vec3 center, vec3 size)
+{
+	vec3 q = abs(p - center) - size;
+	return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+}
+
+float RoundBox(vec3 p, vec3 center, vec3 size, float rounding)
+{
+    vec3 q = abs(p - center) - size + rounding;
+    return length(max(q, 0.0)) + min(max(q.x,max(q.y,q.z)),0.0) - rounding;
+}
+
+// Returns the dis to the given shape
+float SampleSDF(vec3 p, Shape shape)
+{
+	switch(shape.shapeType)
+	{
+		case SPHERE:
+			return Sphere(p, shape.center, shape.parameters.x);
+
+		case BOX:
+			return Box(p, shape.center, shape.parameters.xyz);
+
+		case ROUND_BOX:
+			return RoundBox(p, shape.center, shape.parameters.xyz, shape.parameters.w);
+	}
+
+	return 1.0f;
+}
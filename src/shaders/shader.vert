@@ -13,6 +13,15 @@ layout(std140, binding = 1) readonly buffer storageBuffer
 	mat4 model[];
 } ObjectData;
 
+// Model slots that survived GPU culling, compacted per draw (see cull.comp)
+layout(std430, binding = 2) readonly buffer visibleBuffer
+{
+	uint slot[];
+} VisibleData;
+
+// Set when drawing from the culling pass's indirect commands
+layout(constant_id = 0) const bool CULLED_INSTANCES = false;
+
 layout(location = 0) in vec4 vertexColor;
 layout(location = 1) in vec4 vertexPosition;
 layout(location = 2) in vec2 uv;
@@ -25,7 +34,9 @@ layout(location = 0) out vec4 fragColor;
 
 void main()
 {
-	// camData.viewProjection * ObjectData.model[gl_InstanceIndex] *
+	uint modelSlot = CULLED_INSTANCES ? VisibleData.slot[gl_InstanceIndex] : gl_InstanceIndex;
+
+	// camData.viewProjection * ObjectData.model[modelSlot] *
 	gl_Position = vertexPosition;
 	fragColor = vertexColor;
 
@@ -1,2 +1,8 @@
 %VULKAN_SDK%\Bin\glslc.exe shader.frag -o fragment.spv
 %VULKAN_SDK%\Bin\glslc.exe shader.vert -o vertex.spv
+%VULKAN_SDK%\Bin\glslc.exe cull.comp -o cull.spv
+%VULKAN_SDK%\Bin\glslc.exe shader_raymarch.vert -o raymarch_vertex.spv
+%VULKAN_SDK%\Bin\glslc.exe shader_raymarch.frag -o raymarch_fragment.spv
+%VULKAN_SDK%\Bin\glslc.exe -DSTEP_COUNTERS shader_raymarch.frag -o raymarch_fragment_counters.spv
+%VULKAN_SDK%\Bin\glslc.exe brick_bake.comp -o brick_bake.spv
+%VULKAN_SDK%\Bin\glslc.exe cone_prepass.comp -o cone_prepass.spv
@@ -1,53 +1,127 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 fragColor;
+layout(location = 0) in vec4 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
-const float WIDTH = 800.0f;
-const float HEIGHT = 600.0f;
 
+// Added up over every pixel when COLLECT_STEP_COUNTERS is set (see vkUtil::RaymarchStepCounters)
+// Only the STEP_COUNTERS build writes it: without fragmentStoresAndAtomics, fragment shaders may not
+// even contain writes to storage buffers, so the default build declares it readonly and never touches it
+#ifdef STEP_COUNTERS
+layout(std430, binding = 2) buffer stepCounterBuffer
+#else
+layout(std430, binding = 2) readonly buffer stepCounterBuffer
+#endif
+{
+	uint rayCount;
+	uint hitCount;
+	uint stepCount;
+	uint maxSteps;
+} StepCounters;
+
+// See vkUtil::RaymarchPushConstants
+layout(push_constant) uniform RaymarchParameters
+{
+	vec2 resolution;
+	uint shapeCount;
 
+	uint maxSteps;
 
-// Example data 
+	// Brick map volume: xyz its lowest corner, w the width of a brick
+	vec4 brickVolume;
 
-struct Shape
-{
-	int shapeType;
-	int startP;
-};
+	float maxDistance;
+	float hitEpsilon;
+	float relaxation;
+
+	// 0 when sphere tracing
+	float fixedStep;
+
+	uint flags;
+} Parameters;
+
+// Parameters.flags
+#define SHOW_STEPS 1u
+#define COLLECT_STEP_COUNTERS 2u
+#define USE_BRICK_CACHE 4u
+#define CONE_PREPASS 8u
+
+// Shapes (binding 0), BVH (binding 1) and map()
+#include "sdf_common.glsl"
+
+// Baked distance bricks, BRICK_SAMPLES^3 texels each (see vkUtil::BrickAtlas)
+layout(binding = 3) uniform sampler3D brickAtlas;
 
-Shape shapes[] = 
+// Atlas slot of every brick of the volume, x fastest (see vkUtil::BrickMap::slots)
+layout(std430, binding = 4) readonly buffer brickIndirectionBuffer
 {
-	{0, 0}
-};
+	uint slots[];
+} BrickIndirection;
+
+// Distance from the eye each 8x8 pixel tile's rays are clear up to, written by cone_prepass.comp
+layout(binding = 5, r32f) uniform readonly image2D coneDepth;
+
+// vkUtil::CONE_TILE_SIZE
+#define CONE_TILE_SIZE 8
+
+// Match brick_map.h
+#define BRICK_GRID_SIZE 64u
+#define BRICK_SAMPLES 8u
+#define BRICK_ATLAS_BRICKS 32u
+#define BRICK_BAND 0.5f
+#define BRICK_EMPTY 0xFFFFFFFFu
+
+// Distance to the scene from the brick map, or a negative number where it has nothing better than map():
+// bricks without storage hold nothing, and far from the shapes the BVH walk is cheap anyway,
+// it's near them, where many shapes' bounds overlap, that the cache pays off
+float CachedDistance(vec3 p)
+{
+	vec3 volumeMin = Parameters.brickVolume.xyz;
+	float brickSize = Parameters.brickVolume.w;
+
+	vec3 local = (p - volumeMin) / brickSize;
 
-float parameters[] = 
-{ 
-	// Sphere 
-	0.0f, 0.0f, -1.0f,	// Center 
-	1.0f				// Radius 
-};
+	if (any(lessThan(local, vec3(0.0f))) || any(greaterThanEqual(local, vec3(BRICK_GRID_SIZE))))
+	{
+		return -1.0f;
+	}
+
+	uvec3 brick = uvec3(local);
+	uint slot = BrickIndirection.slots[(brick.z * BRICK_GRID_SIZE + brick.y) * BRICK_GRID_SIZE + brick.x];
+
+	if (slot == BRICK_EMPTY)
+	{
+		return -1.0f;
+	}
 
+	uvec3 slotCoord = uvec3(slot % BRICK_ATLAS_BRICKS, (slot / BRICK_ATLAS_BRICKS) % BRICK_ATLAS_BRICKS,
+		slot / (BRICK_ATLAS_BRICKS * BRICK_ATLAS_BRICKS));
 
-// SDF functions 
-// From: https://iquilezles.org/articles/distfunctions/
-float Sphere(vec3 p, vec3 center, float radius);
-float Box(vec3 p, vec3 center, vec3 size);
-float RoundBox(vec3 p, vec3 center, vec3 size, float rounding);
-float SampleSDF(vec3 pos, int type, int startP);
+	// The brick's corners are the centers of its first and last texels,
+	// so filtering never mixes in a neighbouring slot
+	vec3 texel = vec3(slotCoord * BRICK_SAMPLES) + 0.5f + fract(local) * float(BRICK_SAMPLES - 1);
 
-#define SPHERE 0
+	return texture(brickAtlas, texel / float(BRICK_ATLAS_BRICKS * BRICK_SAMPLES)).r;
+}
 
-float map(vec3 p)
+// Distance used to march: the cached one where there is one, refined with map() close to a surface,
+// where filtering the samples isn't precise enough to place a hit
+float SceneDistance(vec3 p)
 {
-    float d =  RoundBox(p, vec3(-1, 0, -5), vec3(1, 1, 1), 0.1); //distance(p, vec3(-1, 0, -5)) - 1.;     // sphere at (-1,0,5) with radius 1
-    //d = min(d, Box(p, vec3(2, 0, -3), vec3(1, 1, 1)));    // second sphere
-   // d = min(d, distance(p, vec3(-2, 0, -2)) - 1.);   // and another
-    //d = min(d, p.y + 1.);                            // horizontal plane at y = -1
-    return d;
+	if ((Parameters.flags & USE_BRICK_CACHE) == 0)
+	{
+		return map(p);
+	}
+
+	float d = CachedDistance(p);
+	float refineDistance = 2.0f * Parameters.brickVolume.w / float(BRICK_SAMPLES - 1);
+
+	return d < refineDistance ? map(p) : d;
 }
 
+
 //
 // Calculate the normal by taking the central differences on the distance field.
 //
@@ -100,83 +174,124 @@ vec3 calcNormal(vec3 p)
 //    return color;
 //}
 
-void main()
+// Hits get less precise with distance, like the pixels covering them
+bool IsHit(float distanceToScene, float t)
 {
-    //outColor = allCalcs(gl_FragCoord.xy);
-
-    // Default color is screen UV 
-	outColor = vec4(1.0, 1.0, 1.0, 1.0); //fragColor;
-	vec2 uv = fragColor.xy;
+	return distanceToScene <= Parameters.hitEpsilon * (1.0f + t);
+}
 
+// Steps a fixed distance at a time, from t = start
+bool MarchFixed(vec3 origin, vec3 direction, float start, out uint steps)
+{
+	float t = start;
 
-	int stepMax = 100;
-	// TODO: Adjust to be current sample distance for
-	//		 dynamic adjustments 
-	float stepSize = 0.01f;
-	float threshold = 0.01f; 
+	for (steps = 0; steps < Parameters.maxSteps && t <= Parameters.maxDistance; steps++)
+	{
+		if (IsHit(SceneDistance(origin + direction * t), t))
+		{
+			return true;
+		}
 
-	vec3 pos = vec3(uv, 0.0f);
+		t += Parameters.fixedStep;
+	}
 
-	float sceneMap = 99999.0f; 
+	return false;
+}
 
+// Enhanced sphere tracing (over-relaxed, Keinert et al. 2014):
+// steps relaxation times the distance to the scene, which is safe as long as the spheres
+// around the last two points overlap. When they don't, the step overshot: it's taken back
+// and the ray goes on with plain sphere tracing
+bool SphereTrace(vec3 origin, vec3 direction, float start, out uint steps)
+{
+	float relaxation = Parameters.relaxation;
+	float t = start;
+	float stepLength = 0.0f;
+	float previousRadius = 0.0f;
 
-	for(int s = 0; s < stepMax; s++)
+	for (steps = 0; steps < Parameters.maxSteps && t <= Parameters.maxDistance; steps++)
 	{
+		float radius = SceneDistance(origin + direction * t);
 
-		// Brute force scene check 
-		for(int i = 0; i < shapes.length(); i++)
+		bool overshot = relaxation > 1.0f && radius + previousRadius < stepLength;
+
+		if (overshot)
 		{
-			sceneMap = min(SampleSDF(pos, shapes[i].shapeType, shapes[i].startP), 
-							sceneMap);
+			stepLength -= relaxation * stepLength;
+			relaxation = 1.0f;
 		}
-
-		//outColor = vec4(1.0f, 0.0f, 0.0f, 0.0f);
-		if (sceneMap <= threshold)
+		else
 		{
-			outColor = vec4(1.0, 0.0f, 0.0f, 1.0f);
-			return;
+			if (IsHit(radius, t))
+			{
+				return true;
+			}
+
+			stepLength = radius * relaxation;
 		}
 
-		pos += normalize(vec3(uv, -1.0)) * stepSize;
+		previousRadius = radius;
+		t += stepLength;
 	}
-}
 
-
-
-float Sphere(vec3 p, vec3 center, float radius)
-{
-	return distance(p, center) - radius;
+	return false;
 }
 
-float Box(vec3 p, vec3 center, vec3 size)
+// Blue (few steps) to red (the whole budget)
+vec3 StepColor(uint steps)
 {
-	vec3 q = abs(p - center) - size;
-	return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
-}
+	float heat = clamp(float(steps) / float(Parameters.maxSteps), 0.0f, 1.0f);
 
-float RoundBox(vec3 p, vec3 center, vec3 size, float rounding)
-{   
-    vec3 q = abs(p - center) - size + rounding;
-    return length(max(q, 0.0)) + min(max(q.x,max(q.y,q.z)),0.0) - rounding;
+	return clamp(vec3(4.0f * heat - 2.0f, 2.0f - abs(4.0f * heat - 2.0f), 2.0f - 4.0f * heat), 0.0f, 1.0f);
 }
 
-// Returns the dis to the given shape 
-float SampleSDF(vec3 p, int type, int startP)
+void main()
 {
-	switch(type)
+    //outColor = allCalcs(gl_FragCoord.xy);
+
+	vec2 uv = fragColor.xy;
+
+	vec3 origin = vec3(uv, 0.0f);
+	vec3 direction = normalize(vec3(uv, -1.0));
+
+	// The ray goes through the eye (0, 0, 1), and its tile's cone was clear up to that far from it
+	float start = 0.0f;
+
+	if ((Parameters.flags & CONE_PREPASS) != 0)
+	{
+		float clearDistance = imageLoad(coneDepth, ivec2(gl_FragCoord.xy) / CONE_TILE_SIZE).r;
+		start = max(clearDistance - length(vec3(uv, -1.0f)), 0.0f);
+	}
+
+	uint steps;
+	bool hit = Parameters.fixedStep > 0.0f
+		? MarchFixed(origin, direction, start, steps)
+		: SphereTrace(origin, direction, start, steps);
+
+#ifdef STEP_COUNTERS
+	if ((Parameters.flags & COLLECT_STEP_COUNTERS) != 0)
 	{
-		case SPHERE:
+		atomicAdd(StepCounters.rayCount, 1u);
+		atomicAdd(StepCounters.hitCount, hit ? 1u : 0u);
+		atomicAdd(StepCounters.stepCount, steps);
+		atomicMax(StepCounters.maxSteps, steps);
+	}
+#endif
 
-			return Sphere(
-				// Ray point 
-				p, 
-				// Sphere Center 
-				vec3(parameters[startP + 0], parameters[startP + 1], parameters[startP + 2]), 
-				// Sphere radius 
-				parameters[startP + 3]);
+	// Misses took steps too, so every pixel is shown
+	if ((Parameters.flags & SHOW_STEPS) != 0)
+	{
+		outColor = vec4(StepColor(steps), 1.0f);
+		return;
+	}
 
-			break;
+	if (hit)
+	{
+		outColor = vec4(1.0, 0.0f, 0.0f, 1.0f);
+		return;
 	}
 
-	return 1.0f;
-}
\ No newline at end of file
+	// Drawn over the meshes, so pixels that hit nothing keep what's under them
+	discard;
+}
+
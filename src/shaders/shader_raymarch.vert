@@ -1,36 +1,26 @@
 #version 450
 
-layout(binding = 0) uniform UBO
-{
-	mat4 view;
-	mat4 projection;
-	mat4 viewProjection;
-} camData;
-
+// Fullscreen triangle (TRIANGLE_FULLSCREEN), already in clip space
 layout(location = 0) in vec4 vertexColor;
 layout(location = 1) in vec4 vertexPosition;
 layout(location = 2) in vec2 uv;
 
-layout(push_constant) uniform constants
+// Shared with shader_raymarch.frag, see vkUtil::RaymarchPushConstants
+layout(push_constant) uniform RaymarchParameters
 {
-	mat4 model;
-} ObjectData;
+	vec2 resolution;
+	uint shapeCount;
+} Parameters;
 
 layout(location = 0) out vec4 fragColor;
 
-
-#define width 800.0f
-#define height 600.0f
-
 void main()
 {
-// camData.viewProjection * ObjectData.model * 
 	gl_Position = vertexPosition;
-	fragColor = vertexColor;
 
+	// Screen position, x in [-1, 1], y scaled by the aspect ratio
 	vec2 uvN = 2.0 * uv - 1.0;
-    uvN = vec2(uvN.x, uvN.y * height / width);
+	uvN = vec2(uvN.x, uvN.y * Parameters.resolution.y / Parameters.resolution.x);
 
 	fragColor = vec4(uvN, 0.0, 1.0);
-	//fragColor = vec4(uvN, 0.0, 1.0);
-}
\ No newline at end of file
+}
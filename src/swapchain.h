@@ -23,6 +23,7 @@ namespace vkInit
 		vk::Extent2D extent;
 		uint32_t minImageCount;
 		uint32_t imageCount;
+		vk::PresentModeKHR presentMode;
 	};
 
 
@@ -128,12 +129,13 @@ namespace vkInit
 	}
 
 
-	vk::PresentModeKHR choose_swapchain_present_mode(std::vector<vk::PresentModeKHR> presentModes)
+	vk::PresentModeKHR choose_swapchain_present_mode(std::vector<vk::PresentModeKHR> presentModes,
+		vk::PresentModeKHR preferredMode)
 	{
 		// Check if our preferred presentMode is available
 		for (vk::PresentModeKHR presentMode : presentModes)
 		{
-			if (presentMode == vk::PresentModeKHR::eMailbox)
+			if (presentMode == preferredMode)
 			{
 				return presentMode;
 			}
@@ -144,6 +146,23 @@ namespace vkInit
 	}
 
 
+	// 0 requests 2 images more than the minimum, to increase frame rate
+	uint32_t choose_swapchain_image_count(uint32_t requestedCount, vk::SurfaceCapabilitiesKHR capabilities)
+	{
+		uint32_t imageCount = requestedCount == 0
+			? capabilities.minImageCount + 2
+			: std::max(requestedCount, capabilities.minImageCount);
+
+		// maxImageCount == 0 => no upper limit
+		if (capabilities.maxImageCount > 0)
+		{
+			imageCount = std::min(imageCount, capabilities.maxImageCount);
+		}
+
+		return imageCount;
+	}
+
+
 	vk::Extent2D choose_swapchain_extent(uint32_t width, uint32_t height, vk::SurfaceCapabilitiesKHR capabilities)
 	{
 		// UINT32_MAX => You're allowed to have the image extent differ from the window extent
@@ -173,7 +192,11 @@ namespace vkInit
 	}
 
 
-	SwapchainBundle create_swapchain(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, int width, int height, bool debug)
+	// Passing the swapchain being replaced as oldSwapchain lets the driver reuse its resources
+	// and keep presenting its images until the new ones are ready
+	SwapchainBundle create_swapchain(vk::Device logicalDevice, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface,
+		int width, int height, vk::PresentModeKHR preferredPresentMode, uint32_t requestedImageCount,
+		vk::SwapchainKHR oldSwapchain, bool debug)
 	{
 		if (debug)
 		{
@@ -184,15 +207,11 @@ namespace vkInit
 
 		vk::SurfaceFormatKHR format = choose_swapchain_surface_format(support.formats);
 
-		vk::PresentModeKHR presentMode = choose_swapchain_present_mode(support.presentModes);
+		vk::PresentModeKHR presentMode = choose_swapchain_present_mode(support.presentModes, preferredPresentMode);
 
 		vk::Extent2D extent = choose_swapchain_extent(width, height, support.capabilities);
 
-		// Increase frame rate by requesting 1 additional image
-		uint32_t imageCount = std::min(
-			support.capabilities.maxImageCount,
-			support.capabilities.minImageCount + 2
-		);
+		uint32_t imageCount = choose_swapchain_image_count(requestedImageCount, support.capabilities);
 
 
 		// flags, surface, minImageCount, imageFormat, imageColorSpace, imageExtent
@@ -221,7 +240,7 @@ namespace vkInit
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
 
-		createInfo.oldSwapchain = vk::SwapchainKHR(nullptr);
+		createInfo.oldSwapchain = oldSwapchain;
 
 
 		SwapchainBundle bundle{};
@@ -279,6 +298,7 @@ namespace vkInit
 
 		bundle.minImageCount = support.capabilities.minImageCount;
 		bundle.imageCount = imageCount;
+		bundle.presentMode = presentMode;
 
 		return bundle;
 	}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal checks for the CPU tests: failures are printed and counted, the run carries on
+namespace vkTest
+{
+	inline int& failure_count()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	inline void check(bool condition, const char* expression, const char* file, int line)
+	{
+		if (!condition)
+		{
+			std::printf("%s(%d): check failed: %s\n", file, line, expression);
+			failure_count()++;
+		}
+	}
+}
+
+#define CHECK(expression) vkTest::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+// Test suites, one per file
+void run_draw_list_tests();
+void run_transform_system_tests();
+void run_registry_tests();
@@ -0,0 +1,125 @@
+#include "check.h"
+
+#include "../draw_list.h"
+
+#include <random>
+
+using vkUtil::DrawBatch;
+using vkUtil::DrawKey;
+using vkUtil::DrawList;
+
+static MeshRenderer renderer(MeshType meshType, uint32_t material, uint32_t pipeline = 0)
+{
+	return MeshRenderer{ meshType, material, pipeline };
+}
+
+// Renderers with different keys taking turns: one batch per key, in order of first appearance
+static void interleaved_keys()
+{
+	std::vector<MeshRenderer> renderers = {
+		renderer(TRIANGLE, 0), renderer(PENTAGON, 0), renderer(TRIANGLE, 0),
+		renderer(TRIANGLE, 1), renderer(PENTAGON, 0), renderer(TRIANGLE, 0)
+	};
+
+	DrawList drawList;
+	vkUtil::build_draw_list(renderers, drawList);
+
+	std::vector<DrawBatch> expected = {
+		DrawBatch{ DrawKey{ 0, 0, TRIANGLE }, 0, 3 },
+		DrawBatch{ DrawKey{ 0, 0, PENTAGON }, 3, 2 },
+		DrawBatch{ DrawKey{ 0, 1, TRIANGLE }, 5, 1 }
+	};
+
+	CHECK(drawList.batches == expected);
+	CHECK(drawList.instances == std::vector<uint32_t>({ 0, 2, 5, 1, 4, 3 }));
+}
+
+// Batches are grouped by pipeline, and keep their order of first appearance within a pipeline
+static void grouped_by_pipeline()
+{
+	std::vector<MeshRenderer> renderers = {
+		renderer(TRIANGLE, 0, 1), renderer(TRIANGLE, 0, 0), renderer(PENTAGON, 0, 1),
+		renderer(HEXAGON, 0, 0), renderer(TRIANGLE, 0, 1), renderer(TRIANGLE, 0, 0)
+	};
+
+	DrawList drawList;
+	vkUtil::build_draw_list(renderers, drawList);
+
+	std::vector<DrawBatch> expected = {
+		DrawBatch{ DrawKey{ 0, 0, TRIANGLE }, 0, 2 },
+		DrawBatch{ DrawKey{ 0, 0, HEXAGON }, 2, 1 },
+		DrawBatch{ DrawKey{ 1, 0, TRIANGLE }, 3, 2 },
+		DrawBatch{ DrawKey{ 1, 0, PENTAGON }, 5, 1 }
+	};
+
+	CHECK(drawList.batches == expected);
+	CHECK(drawList.instances == std::vector<uint32_t>({ 1, 5, 3, 0, 4, 2 }));
+}
+
+// On random renderers: firstInstance is the prefix sum of the counts,
+// and every batch's slots hold its own renderers, in their original order
+static void first_instance_prefix_sums()
+{
+	std::mt19937 random(7);
+	std::uniform_int_distribution<uint32_t> meshType(0, 3);
+	std::uniform_int_distribution<uint32_t> small(0, 2);
+
+	std::vector<MeshRenderer> renderers;
+
+	for (uint32_t ii = 0; ii < 1000; ii++)
+	{
+		renderers.push_back(renderer(static_cast<MeshType>(meshType(random)), small(random), small(random)));
+	}
+
+	DrawList drawList;
+	vkUtil::build_draw_list(renderers, drawList);
+
+	CHECK(drawList.instances.size() == renderers.size());
+
+	uint32_t firstInstance = 0;
+
+	for (size_t ii = 0; ii < drawList.batches.size(); ii++)
+	{
+		const DrawBatch& batch = drawList.batches[ii];
+
+		CHECK(batch.firstInstance == firstInstance);
+		CHECK(batch.instanceCount > 0);
+		CHECK(ii == 0 || drawList.batches[ii - 1].key.pipeline <= batch.key.pipeline);
+
+		for (uint32_t slot = batch.firstInstance; slot < batch.firstInstance + batch.instanceCount; slot++)
+		{
+			const MeshRenderer& drawn = renderers[drawList.instances[slot]];
+
+			CHECK((DrawKey{ drawn.pipeline, drawn.material, drawn.meshType } == batch.key));
+			CHECK(slot == batch.firstInstance || drawList.instances[slot - 1] < drawList.instances[slot]);
+		}
+
+		firstInstance += batch.instanceCount;
+	}
+
+	CHECK(firstInstance == renderers.size());
+}
+
+// Nothing to draw, also after a list that had batches
+static void empty_input()
+{
+	DrawList drawList;
+	vkUtil::build_draw_list({}, drawList);
+
+	CHECK(drawList.batches.empty());
+	CHECK(drawList.instances.empty());
+
+	vkUtil::build_draw_list({ renderer(TRIANGLE, 0) }, drawList);
+	vkUtil::build_draw_list({}, drawList);
+
+	CHECK(drawList.batches.empty());
+	CHECK(drawList.instances.empty());
+}
+
+void run_draw_list_tests()
+{
+	interleaved_keys();
+	grouped_by_pipeline();
+	first_instance_prefix_sums();
+	empty_input();
+}
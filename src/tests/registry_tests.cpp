@@ -0,0 +1,91 @@
+#include "check.h"
+
+#include "../Registry.h"
+
+// A destroyed entity's index is reused with a new generation, and the old ID is turned away everywhere
+static void stale_entity_rejected()
+{
+	Registry registry;
+
+	Entity first = registry.Create();
+	Entity second = registry.Create();
+	registry.Add<Name>(first, Name{ "first" });
+	registry.Add<Name>(second, Name{ "second" });
+
+	registry.Destroy(first);
+	Entity reused = registry.Create();
+
+	CHECK(reused.index == first.index);
+	CHECK(reused.generation != first.generation);
+
+	CHECK(!registry.IsValid(first));
+	CHECK(registry.IsValid(reused));
+	CHECK(registry.IsValid(second));
+
+	// The new entity doesn't inherit the old one's components, and the old ID can't reach the new one's
+	CHECK(!registry.Has<Name>(reused));
+	registry.Add<Name>(reused, Name{ "reused" });
+
+	CHECK(!registry.Has<Name>(first));
+	CHECK(registry.TryGet<Name>(first) == nullptr);
+	CHECK(registry.Get<Name>(reused).name == "reused");
+
+	// Adding through the old ID neither replaces the new entity's component nor orphans it
+	CHECK(registry.Add<Name>(first, Name{ "stale" }) == nullptr);
+	CHECK(registry.Get<Name>(reused).name == "reused");
+	CHECK(registry.Pool<Name>().Size() == 2);
+
+	// Same straight on the pool, which doesn't know which generation is live
+	CHECK(registry.Pool<Name>().Add(first, Name{ "stale" }) == nullptr);
+	CHECK(registry.Get<Name>(reused).name == "reused");
+	CHECK(registry.Pool<Name>().Size() == 2);
+
+	// Destroying the stale ID again leaves the new entity alone
+	registry.Destroy(first);
+
+	CHECK(registry.IsValid(reused));
+	CHECK(registry.Size() == 2);
+}
+
+// Clear retires the generation of every live entity, already free indices stay usable
+static void clear_bumps_generations()
+{
+	Registry registry;
+
+	std::vector<Entity> entities;
+
+	for (int ii = 0; ii < 8; ii++)
+	{
+		entities.push_back(registry.Create());
+		registry.Add<Name>(entities.back(), Name{ std::to_string(ii) });
+	}
+
+	// One already free index, whose generation was bumped by Destroy
+	registry.Destroy(entities[3]);
+
+	registry.Clear();
+
+	CHECK(registry.Size() == 0);
+	CHECK(registry.Pool<Name>().Size() == 0);
+
+	for (const Entity& entity : entities)
+	{
+		CHECK(!registry.IsValid(entity));
+	}
+
+	// Every index comes back with a generation none of the old IDs had
+	for (size_t ii = 0; ii < entities.size(); ii++)
+	{
+		Entity created = registry.Create();
+
+		CHECK(registry.IsValid(created));
+		CHECK(created.index < entities.size());
+		CHECK(created.generation != entities[created.index].generation);
+	}
+}
+
+void run_registry_tests()
+{
+	stale_entity_rejected();
+	clear_bumps_generations();
+}
@@ -0,0 +1,17 @@
+#include "check.h"
+
+// CPU tests of engine code that doesn't need a device (no Vulkan or glfw calls)
+// Exits with the number of failed checks, so 0 means everything passed
+int main()
+{
+	run_draw_list_tests();
+	run_transform_system_tests();
+	run_registry_tests();
+
+	if (vkTest::failure_count() == 0)
+	{
+		std::printf("All checks passed\n");
+	}
+
+	return vkTest::failure_count();
+}
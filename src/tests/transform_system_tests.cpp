@@ -0,0 +1,302 @@
+#include "check.h"
+
+#include "../TransformSystem.h"
+
+#include <random>
+#include <unordered_set>
+
+// Reaches the scalar path and the cached local matrices
+struct TransformSystemTests
+{
+	static glm::mat4 compute_local_matrix(const TransformSystem& system, TransformHandle handle)
+	{
+		return system.ComputeLocalMatrix(system.GetDenseIndex(handle));
+	}
+
+	static const glm::mat4& local_matrix(const TransformSystem& system, TransformHandle handle)
+	{
+		return system.localMatrices[system.GetDenseIndex(handle)];
+	}
+};
+
+// Both paths do the same float math, the tolerance only covers the compiler fusing the scalar one
+// (and that difference carried down a parent chain)
+static bool nearly_equal(const glm::mat4& a, const glm::mat4& b)
+{
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			float x = a[column][row], y = b[column][row];
+			float scale = std::max(1.0f, std::max(std::fabs(x), std::fabs(y)));
+
+			if (std::fabs(x - y) > 1e-5f * scale)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static void randomize(TransformSystem& system, TransformHandle handle, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.8f, 1.2f);
+	std::normal_distribution<float> rotation(0.0f, 1.0f);
+
+	glm::vec4 q(rotation(random), rotation(random), rotation(random), rotation(random));
+	float length = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+
+	system.SetPosition(handle, glm::vec3(position(random), position(random), position(random)));
+	system.SetRotation(handle, glm::vec4(q.x / length, q.y / length, q.z / length, q.w / length));
+	system.SetScale(handle, glm::vec3(scale(random), scale(random), scale(random)));
+}
+
+// Every version in use is different
+static bool unique_versions(const TransformSystem& system)
+{
+	std::unordered_set<uint64_t> seen;
+
+	for (size_t dense = 0; dense < system.Size(); dense++)
+	{
+		if (!seen.insert(system.GetVersions()[dense]).second)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// SIMD batches against ComputeLocalMatrix, with counts that leave an unaligned tail
+static void batches_match_scalar()
+{
+	std::mt19937 random(11);
+
+	for (uint32_t count : { 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u, 9u, 13u, 1003u })
+	{
+		TransformSystem system;
+		std::vector<TransformHandle> handles;
+
+		for (uint32_t ii = 0; ii < count; ii++)
+		{
+			handles.push_back(system.Create());
+			randomize(system, handles.back(), random);
+		}
+
+		system.UpdateWorldMatrices();
+
+		for (TransformHandle handle : handles)
+		{
+			glm::mat4 expected = TransformSystemTests::compute_local_matrix(system, handle);
+
+			CHECK(nearly_equal(TransformSystemTests::local_matrix(system, handle), expected));
+			CHECK(nearly_equal(system.GetWorldMatrices()[system.GetDenseIndex(handle)], expected));
+		}
+
+		// Only a few dirty transforms: their batches are redone whole, the clean lanes must come out the same
+		for (uint32_t ii = 0; ii < count; ii += 3)
+		{
+			randomize(system, handles[ii], random);
+		}
+
+		system.UpdateWorldMatrices();
+
+		for (TransformHandle handle : handles)
+		{
+			CHECK(nearly_equal(TransformSystemTests::local_matrix(system, handle),
+				TransformSystemTests::compute_local_matrix(system, handle)));
+		}
+
+		CHECK(unique_versions(system));
+	}
+}
+
+// Transforms the test created, and the parents it gave them
+struct Hierarchy
+{
+	std::vector<TransformHandle> handles;
+	std::vector<bool> alive;
+
+	// Slot of the parent, -1 for roots
+	std::vector<int> parents;
+
+	// Whether ancestor is slot or one of its ancestors
+	bool is_ancestor(int ancestor, int slot) const
+	{
+		for (; slot >= 0 && alive[slot]; slot = parents[slot])
+		{
+			if (slot == ancestor)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+// Naive reference: parent's world matrix times the local one, straight from the test's own hierarchy
+static glm::mat4 reference_world(const TransformSystem& system, const Hierarchy& hierarchy, int slot)
+{
+	glm::mat4 local = TransformSystemTests::compute_local_matrix(system, hierarchy.handles[slot]);
+	int parent = hierarchy.parents[slot];
+
+	if (parent < 0 || !hierarchy.alive[parent])
+	{
+		return local;
+	}
+
+	return reference_world(system, hierarchy, parent) * local;
+}
+
+static void check_world_matrices(const TransformSystem& system, const Hierarchy& hierarchy)
+{
+	bool allMatch = true;
+
+	for (size_t slot = 0; slot < hierarchy.handles.size(); slot++)
+	{
+		if (!hierarchy.alive[slot])
+		{
+			continue;
+		}
+
+		TransformHandle handle = hierarchy.handles[slot];
+		glm::mat4 expected = reference_world(system, hierarchy, static_cast<int>(slot));
+
+		allMatch = allMatch && nearly_equal(system.GetWorldMatrices()[system.GetDenseIndex(handle)], expected);
+		allMatch = allMatch && nearly_equal(system.GetWorldMatrix(handle), expected);
+	}
+
+	CHECK(allMatch);
+	CHECK(unique_versions(system));
+}
+
+// Parents every slot in [first, last) at random, and checks SetParent turns down cycles
+static void reparent(TransformSystem& system, Hierarchy& hierarchy, size_t first, size_t last, std::mt19937& random)
+{
+	std::uniform_int_distribution<size_t> pick(0, hierarchy.handles.size() - 1);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+	bool cyclesRefused = true;
+
+	for (size_t slot = first; slot < last; slot++)
+	{
+		if (!hierarchy.alive[slot])
+		{
+			continue;
+		}
+
+		// Some roots stay, so the update has subtrees to split between jobs
+		if (chance(random) < 0.3f)
+		{
+			system.SetParent(hierarchy.handles[slot], TransformHandle{});
+			hierarchy.parents[slot] = -1;
+			continue;
+		}
+
+		size_t parent = pick(random);
+
+		if (!hierarchy.alive[parent])
+		{
+			continue;
+		}
+
+		bool cycle = hierarchy.is_ancestor(static_cast<int>(slot), static_cast<int>(parent));
+		bool parented = system.SetParent(hierarchy.handles[slot], hierarchy.handles[parent]);
+
+		cyclesRefused = cyclesRefused && parented == !cycle;
+
+		if (parented)
+		{
+			hierarchy.parents[slot] = static_cast<int>(parent);
+		}
+	}
+
+	CHECK(cyclesRefused);
+}
+
+// World matrices against the reference after parenting, destroying (orphaning children),
+// reusing handles and moving transforms, each of which re-sorts the packed arrays
+static void hierarchy_matches_reference(vkUtil::JobSystem* jobs, uint32_t count)
+{
+	std::mt19937 random(23);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+	TransformSystem system;
+	Hierarchy hierarchy;
+
+	for (uint32_t ii = 0; ii < count; ii++)
+	{
+		hierarchy.handles.push_back(system.Create());
+		hierarchy.alive.push_back(true);
+		hierarchy.parents.push_back(-1);
+
+		randomize(system, hierarchy.handles.back(), random);
+	}
+
+	reparent(system, hierarchy, 0, count, random);
+	system.UpdateWorldMatrices(jobs);
+	check_world_matrices(system, hierarchy);
+
+	// Destroy some, their children become roots
+	for (size_t slot = 0; slot < hierarchy.handles.size(); slot++)
+	{
+		if (chance(random) < 0.1f)
+		{
+			system.Destroy(hierarchy.handles[slot]);
+			hierarchy.alive[slot] = false;
+		}
+	}
+
+	system.UpdateWorldMatrices(jobs);
+	check_world_matrices(system, hierarchy);
+
+	// New transforms reuse the freed handles, the orphans' old parent handles must not reach them
+	size_t firstNew = hierarchy.handles.size();
+
+	for (uint32_t ii = 0; ii < count / 20; ii++)
+	{
+		hierarchy.handles.push_back(system.Create());
+		hierarchy.alive.push_back(true);
+		hierarchy.parents.push_back(-1);
+
+		randomize(system, hierarchy.handles.back(), random);
+	}
+
+	reparent(system, hierarchy, firstNew, hierarchy.handles.size(), random);
+	reparent(system, hierarchy, 0, firstNew / 10, random);
+
+	system.UpdateWorldMatrices(jobs);
+	check_world_matrices(system, hierarchy);
+
+	// Move a few without touching the hierarchy: only their subtrees change
+	for (size_t slot = 0; slot < hierarchy.handles.size(); slot += 7)
+	{
+		if (hierarchy.alive[slot])
+		{
+			randomize(system, hierarchy.handles[slot], random);
+		}
+	}
+
+	system.UpdateWorldMatrices(jobs);
+	check_world_matrices(system, hierarchy);
+}
+
+void run_transform_system_tests()
+{
+	batches_match_scalar();
+
+	hierarchy_matches_reference(nullptr, 2000);
+
+	// Enough transforms for the update to be split into jobs
+	vkUtil::JobSystem jobs;
+	jobs.init(4);
+
+	hierarchy_matches_reference(&jobs, 40000);
+	hierarchy_matches_reference(nullptr, 40000);
+
+	jobs.destroy();
+}
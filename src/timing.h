@@ -0,0 +1,114 @@
+#pragma once
+
+#include "config.h"
+#include <array>
+#include <chrono>
+
+namespace vkUtil
+{
+	// CPU-side phases of a frame, in the order render() goes through them
+	enum class FramePhase
+	{
+		FENCE_WAIT,
+		ACQUIRE,
+		IMGUI_BUILD,
+		PREPARE_FRAME,
+		RECORD_DRAW_COMMANDS,
+		SUBMIT,
+		PRESENT,
+		FRAME_LIMIT,
+		COUNT
+	};
+
+	constexpr size_t FRAME_PHASE_COUNT = static_cast<size_t>(FramePhase::COUNT);
+
+	inline const char* frame_phase_name(FramePhase phase)
+	{
+		switch (phase)
+		{
+		case FramePhase::FENCE_WAIT:
+			return "fence_wait";
+		case FramePhase::ACQUIRE:
+			return "acquire";
+		case FramePhase::IMGUI_BUILD:
+			return "imgui_build";
+		case FramePhase::PREPARE_FRAME:
+			return "prepare_frame";
+		case FramePhase::RECORD_DRAW_COMMANDS:
+			return "record_draw_commands";
+		case FramePhase::SUBMIT:
+			return "submit";
+		case FramePhase::PRESENT:
+			return "present";
+		case FramePhase::FRAME_LIMIT:
+			return "frame_limit";
+		default:
+			return "unknown";
+		}
+	}
+
+	// Per-frame CPU time (ms) split by phase
+	// Phases that a frame skips (e.g. acquire/present when headless) stay at 0
+	struct FrameTimings
+	{
+		std::array<double, FRAME_PHASE_COUNT> phaseMs{};
+		double totalMs = 0.0;
+
+		double& operator[](FramePhase phase)
+		{
+			return phaseMs[static_cast<size_t>(phase)];
+		}
+
+		double operator[](FramePhase phase) const
+		{
+			return phaseMs[static_cast<size_t>(phase)];
+		}
+	};
+
+	// Where engine construction time goes
+	struct StartupTimings
+	{
+		double totalMs = 0.0;
+
+		// Scene + ImGui pipeline creation
+		double pipelineMs = 0.0;
+
+		bool pipelineCacheLoaded = false;
+	};
+
+	// Stopwatch for splitting a frame into phases
+	class CpuTimer
+	{
+	public:
+		CpuTimer()
+		{
+			start();
+		}
+
+		void start()
+		{
+			begin = std::chrono::steady_clock::now();
+			last = begin;
+		}
+
+		// ms since the previous lap (or start), then starts the next lap
+		double lap()
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(now - last).count();
+			last = now;
+
+			return ms;
+		}
+
+		// ms since start
+		double total() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point begin;
+		std::chrono::steady_clock::time_point last;
+	};
+}
@@ -0,0 +1,298 @@
+#include "upload.h"
+
+namespace vkUtil
+{
+	// Keeps staged copies nicely aligned for any future image uploads
+	static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+	void UploadQueue::init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice,
+		MemoryAllocator& allocator, const vk::Queue& queue, uint32_t queueFamilyIdx, bool debug)
+	{
+		this->device = device;
+		this->physicalDevice = physicalDevice;
+		this->allocator = &allocator;
+		this->queue = queue;
+		this->queueFamilyIdx = queueFamilyIdx;
+		this->debug = debug;
+
+		vk::CommandPoolCreateInfo poolInfo = {};
+		poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+		poolInfo.queueFamilyIndex = queueFamilyIdx;
+
+		try
+		{
+			commandPool = device.createCommandPool(poolInfo);
+		}
+		catch (vk::SystemError err)
+		{
+			throw std::runtime_error("Failed to create upload command pool :/\n");
+		}
+
+		BufferInput input;
+		input.logicalDevice = device;
+		input.physicalDevice = physicalDevice;
+		input.allocator = &allocator;
+		input.size = STAGING_RING_SIZE;
+		input.usage = vk::BufferUsageFlagBits::eTransferSrc;
+		input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible
+			| vk::MemoryPropertyFlagBits::eHostCoherent;
+
+		stagingRing = create_buffer(input);
+
+		if (debug)
+		{
+			std::cout << "Created upload queue on queue family " << queueFamilyIdx << "\n";
+		}
+	}
+
+	void UploadQueue::destroy()
+	{
+		flush();
+
+		while (!inFlight.empty())
+		{
+			retire_oldest(true);
+		}
+
+		for (Batch& batch : freeBatches)
+		{
+			device.destroyFence(batch.fence);
+		}
+
+		freeBatches.clear();
+
+		destroy_buffer(device, *allocator, stagingRing);
+		device.destroyCommandPool(commandPool);
+	}
+
+	UploadQueue::Batch UploadQueue::make_batch()
+	{
+		Batch batch;
+
+		vk::CommandBufferAllocateInfo allocInfo = {};
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+		allocInfo.commandBufferCount = 1;
+
+		batch.commandBuffer = device.allocateCommandBuffers(allocInfo)[0];
+		batch.fence = device.createFence(vk::FenceCreateInfo{});
+
+		return batch;
+	}
+
+	void UploadQueue::begin_batch()
+	{
+		if (isRecording)
+		{
+			return;
+		}
+
+		if (freeBatches.empty())
+		{
+			recording = make_batch();
+		}
+		else
+		{
+			recording = std::move(freeBatches.back());
+			freeBatches.pop_back();
+		}
+
+		recording.ticket = nextTicket;
+		recording.ringBytes = 0;
+
+		recording.commandBuffer.reset();
+
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		recording.commandBuffer.begin(beginInfo);
+
+		isRecording = true;
+	}
+
+	bool UploadQueue::allocate_staging(vk::DeviceSize size, vk::DeviceSize& offset)
+	{
+		// Empty ring, so start over from the front
+		if (ringUsed == 0)
+		{
+			ringHead = 0;
+		}
+
+		vk::DeviceSize alignedHead = (ringHead + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+		vk::DeviceSize needed;
+
+		if (alignedHead + size <= STAGING_RING_SIZE)
+		{
+			offset = alignedHead;
+			needed = (alignedHead - ringHead) + size;
+		}
+		else
+		{
+			// Wrap around, the tail end of the ring is wasted until this batch retires
+			offset = 0;
+			needed = (STAGING_RING_SIZE - ringHead) + size;
+		}
+
+		if (ringUsed + needed > STAGING_RING_SIZE)
+		{
+			return false;
+		}
+
+		ringUsed += needed;
+		ringHead = offset + size;
+		recording.ringBytes += needed;
+
+		return true;
+	}
+
+	UploadTicket UploadQueue::upload_buffer(const void* data, vk::DeviceSize size,
+		const vk::Buffer& dst, vk::DeviceSize dstOffset)
+	{
+		collect();
+		begin_batch();
+
+		vk::BufferCopy copyRegion{};
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+
+		if (size > STAGING_RING_SIZE)
+		{
+			// Too big for the ring, so it gets a staging buffer of its own
+			BufferInput input;
+			input.logicalDevice = device;
+			input.physicalDevice = physicalDevice;
+			input.allocator = allocator;
+			input.size = size;
+			input.usage = vk::BufferUsageFlagBits::eTransferSrc;
+			input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible
+				| vk::MemoryPropertyFlagBits::eHostCoherent;
+			input.strategy = AllocationStrategy::LINEAR;
+
+			BufferData staging = create_buffer(input);
+			memcpy(staging.allocation.mappedData, data, size);
+
+			copyRegion.srcOffset = 0;
+			recording.commandBuffer.copyBuffer(staging.buffer, dst, 1, &copyRegion);
+			recording.oversizeBuffers.push_back(staging);
+
+			return recording.ticket;
+		}
+
+		vk::DeviceSize offset = 0;
+
+		// Ring is full: submit what we have and wait for the oldest batches to free up space
+		while (!allocate_staging(size, offset))
+		{
+			if (recording.ringBytes > 0 || !recording.oversizeBuffers.empty())
+			{
+				flush();
+				begin_batch();
+			}
+			else if (!inFlight.empty())
+			{
+				retire_oldest(true);
+			}
+		}
+
+		memcpy(static_cast<char*>(stagingRing.allocation.mappedData) + offset, data, size);
+
+		copyRegion.srcOffset = offset;
+		recording.commandBuffer.copyBuffer(stagingRing.buffer, dst, 1, &copyRegion);
+
+		return recording.ticket;
+	}
+
+	UploadTicket UploadQueue::flush()
+	{
+		if (!isRecording)
+		{
+			// nothing queued, so everything issued so far is what callers wait on
+			return nextTicket - 1;
+		}
+
+		// Make the copies available to whichever queue reads the data next.
+		// Consumers check is_complete() (i.e. the batch fence) before recording any use of it.
+		vk::MemoryBarrier barrier{};
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+
+		recording.commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+			vk::DependencyFlags(), 1, &barrier, 0, nullptr, 0, nullptr);
+
+		recording.commandBuffer.end();
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &recording.commandBuffer;
+
+		queue.submit(1, &submitInfo, recording.fence);
+
+		UploadTicket ticket = recording.ticket;
+		nextTicket++;
+
+		inFlight.push_back(std::move(recording));
+		recording = Batch{};
+		isRecording = false;
+
+		return ticket;
+	}
+
+	void UploadQueue::retire_oldest(bool wait)
+	{
+		Batch& batch = inFlight.front();
+
+		if (wait)
+		{
+			device.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX);
+		}
+
+		device.resetFences(1, &batch.fence);
+
+		for (BufferData& staging : batch.oversizeBuffers)
+		{
+			destroy_buffer(device, *allocator, staging);
+		}
+
+		batch.oversizeBuffers.clear();
+
+		// Batches retire in submission order, so the ring tail simply moves forward
+		ringUsed -= batch.ringBytes;
+		completedTicket = batch.ticket;
+
+		freeBatches.push_back(std::move(batch));
+		inFlight.erase(inFlight.begin());
+	}
+
+	void UploadQueue::collect()
+	{
+		while (!inFlight.empty() && device.getFenceStatus(inFlight.front().fence) == vk::Result::eSuccess)
+		{
+			retire_oldest(false);
+		}
+	}
+
+	bool UploadQueue::is_complete(UploadTicket ticket)
+	{
+		collect();
+
+		return ticket <= completedTicket;
+	}
+
+	void UploadQueue::wait(UploadTicket ticket)
+	{
+		if (isRecording && ticket >= recording.ticket)
+		{
+			flush();
+		}
+
+		while (ticket > completedTicket && !inFlight.empty())
+		{
+			retire_oldest(true);
+		}
+	}
+
+	uint32_t UploadQueue::get_queue_family_idx() const
+	{
+		return queueFamilyIdx;
+	}
+}
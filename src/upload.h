@@ -0,0 +1,85 @@
+#pragma once
+
+#include "config.h"
+#include "buffers.h"
+
+namespace vkUtil
+{
+	// Identifies a batch of uploads, ticket n completes before ticket n + 1
+	using UploadTicket = uint64_t;
+
+	// Batches staging copies through a persistent, persistently mapped staging ring,
+	// and submits them on the transfer queue (a dedicated one when the device has it).
+	// Completion is tracked with one fence per batch, so nothing on the render path
+	// ever has to wait for the queue to go idle.
+	class UploadQueue
+	{
+	public:
+		static constexpr vk::DeviceSize STAGING_RING_SIZE = 16ULL * 1024 * 1024;
+
+		void init(const vk::Device& device, const vk::PhysicalDevice& physicalDevice,
+			MemoryAllocator& allocator, const vk::Queue& queue, uint32_t queueFamilyIdx, bool debug);
+
+		// Waits for everything in flight, then frees all resources
+		void destroy();
+
+		// Stages data and queues a copy into dst
+		// Returns the ticket of the batch the copy belongs to (submitted on the next flush)
+		UploadTicket upload_buffer(const void* data, vk::DeviceSize size,
+			const vk::Buffer& dst, vk::DeviceSize dstOffset = 0);
+
+		// Submits all queued copies, returns their ticket
+		UploadTicket flush();
+
+		// Non-blocking
+		bool is_complete(UploadTicket ticket);
+
+		void wait(UploadTicket ticket);
+
+		// Retires finished batches and recycles their staging space
+		void collect();
+
+		uint32_t get_queue_family_idx() const;
+
+	private:
+		struct Batch
+		{
+			vk::CommandBuffer commandBuffer;
+			vk::Fence fence;
+			UploadTicket ticket = 0;
+
+			// staging ring bytes held by this batch (incl. wrap-around padding)
+			vk::DeviceSize ringBytes = 0;
+
+			// uploads too big for the ring get their own temporary staging buffer
+			std::vector<BufferData> oversizeBuffers;
+		};
+
+		vk::Device device;
+		vk::PhysicalDevice physicalDevice;
+		MemoryAllocator* allocator = nullptr;
+		vk::Queue queue;
+		uint32_t queueFamilyIdx = 0;
+		bool debug = false;
+
+		vk::CommandPool commandPool;
+
+		BufferData stagingRing;
+		vk::DeviceSize ringHead = 0;
+		vk::DeviceSize ringUsed = 0;
+
+		// submitted batches, oldest first
+		std::vector<Batch> inFlight;
+		std::vector<Batch> freeBatches;
+		Batch recording;
+		bool isRecording = false;
+
+		UploadTicket nextTicket = 1;
+		UploadTicket completedTicket = 0;
+
+		Batch make_batch();
+		void begin_batch();
+		bool allocate_staging(vk::DeviceSize size, vk::DeviceSize& offset);
+		void retire_oldest(bool wait);
+	};
+}